@@ -10,10 +10,276 @@
 #include "globals.h"
 #include "symtab.h"
 #include "util.h"
+#include "interface.h"
+#include "frame.h"
+#include "timing.h"
+#include <stdarg.h>
+#include <pthread.h>
 
 static ScopeEntryRec *rootScope = NULL;
 static ScopeEntryRec *activeScope = NULL;
 
+/* checkScope is the scope cursor used by checkTreeNode.
+ * It follows enterScope only (never restored on exit),
+ * exactly as the original typeCheck traversal did.
+ * Each checking thread has its own cursor
+ */
+static _Thread_local ScopeEntryRec *checkScope = NULL;
+
+/* Diagnostics are collected as records rather than text.
+ * Each phase (building, checking) gathers its records in
+ * phaseDiagnostics, or in diagBuffer when that is set
+ * (used by the fused, parallel and incremental modes),
+ * and prints them at the end of the phase sorted by line
+ * with duplicates removed. With --max-errors=N analysis
+ * stops once N distinct diagnostics have been collected
+ */
+typedef enum
+{
+	RedefinitionDiag,
+	UndeclaredFunctionDiag,
+	UndeclaredVariableDiag,
+	VoidVariableDiag,
+	IndexNotIntegerDiag,
+	IndexNotArrayDiag,
+	InvalidCallDiag,
+	InvalidReturnDiag,
+	InvalidAssignmentDiag,
+	InvalidOperationDiag,
+	InvalidConditionDiag
+} DiagnosticKind;
+
+typedef struct DiagnosticRec
+{
+	DiagnosticKind kind;
+	int lineno;
+	char *name;
+	int *previousLines;
+	int previousCount;
+	int order;
+} DiagnosticRec;
+
+typedef struct DiagBufferRec
+{
+	DiagnosticRec *records;
+	int count;
+	int capacity;
+	int *slots;
+	int slotCount;
+} DiagBufferRec;
+
+static DiagBufferRec phaseDiagnostics;
+static _Thread_local DiagBufferRec *diagBuffer = NULL;
+
+/* errorsLeft = how many diagnostics the unit may print
+ * (-1 if there is no limit); stopAnalysis is set once the
+ * limit has been reached
+ */
+static int errorsLeft = -1;
+static int stopAnalysis = FALSE;
+
+static unsigned hashDiagnostic(DiagnosticRec *diagnostic)
+{
+	unsigned hash = (unsigned)diagnostic->kind * 31u + (unsigned)diagnostic->lineno;
+	char *c;
+	int i;
+	if (diagnostic->name != NULL)
+		for (c = diagnostic->name; *c != '\0'; ++c) hash = hash * 31u + (unsigned char)*c;
+	for (i = 0; i < diagnostic->previousCount; ++i) hash = hash * 31u + (unsigned)diagnostic->previousLines[i];
+	/* keys of nearby lines differ only in a few low bits;
+	 * mix them so that linear probing does not cluster
+	 */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+static int sameDiagnostic(DiagnosticRec *a, DiagnosticRec *b)
+{
+	if (a->kind != b->kind || a->lineno != b->lineno || a->previousCount != b->previousCount) return FALSE;
+	if ((a->name == NULL) != (b->name == NULL)) return FALSE;
+	if (a->name != NULL && strcmp(a->name, b->name) != 0) return FALSE;
+	return a->previousCount == 0 || memcmp(a->previousLines, b->previousLines, a->previousCount * sizeof(int)) == 0;
+}
+
+/* slots is an open-addressed index of the records,
+ * kept at most half full
+ */
+static void rehashDiagnostics(DiagBufferRec *buffer)
+{
+	int i;
+	buffer->slotCount = buffer->slotCount == 0 ? 64 : buffer->slotCount * 2;
+	free(buffer->slots);
+	buffer->slots = (int *)malloc(buffer->slotCount * sizeof(int));
+	for (i = 0; i < buffer->slotCount; ++i) buffer->slots[i] = -1;
+	for (i = 0; i < buffer->count; ++i)
+	{
+		unsigned slot = hashDiagnostic(&buffer->records[i]) & (buffer->slotCount - 1);
+		while (buffer->slots[slot] >= 0) slot = (slot + 1) & (buffer->slotCount - 1);
+		buffer->slots[slot] = i;
+	}
+}
+
+/* addDiagnostic stores a copy of diagnostic in buffer
+ * unless an identical one is already there
+ */
+static void addDiagnostic(DiagBufferRec *buffer, DiagnosticRec *diagnostic)
+{
+	DiagnosticRec *copy;
+	unsigned slot;
+
+	if ((buffer->count + 1) * 2 > buffer->slotCount) rehashDiagnostics(buffer);
+	slot = hashDiagnostic(diagnostic) & (buffer->slotCount - 1);
+	while (buffer->slots[slot] >= 0)
+	{
+		if (sameDiagnostic(&buffer->records[buffer->slots[slot]], diagnostic)) return;
+		slot = (slot + 1) & (buffer->slotCount - 1);
+	}
+
+	if (buffer->count == buffer->capacity)
+	{
+		buffer->capacity = buffer->capacity == 0 ? 16 : buffer->capacity * 2;
+		buffer->records = (DiagnosticRec *)realloc(buffer->records, buffer->capacity * sizeof(DiagnosticRec));
+	}
+	copy = &buffer->records[buffer->count];
+	*copy = *diagnostic;
+	copy->order = buffer->count;
+	if (diagnostic->previousCount > 0)
+	{
+		copy->previousLines = (int *)malloc(diagnostic->previousCount * sizeof(int));
+		memcpy(copy->previousLines, diagnostic->previousLines, diagnostic->previousCount * sizeof(int));
+	}
+	buffer->slots[slot] = buffer->count++;
+}
+
+static void clearDiagnostics(DiagBufferRec *buffer)
+{
+	int i;
+	for (i = 0; i < buffer->count; ++i) free(buffer->records[i].previousLines);
+	buffer->count = 0;
+	for (i = 0; i < buffer->slotCount; ++i) buffer->slots[i] = -1;
+}
+
+static void freeDiagnostics(DiagBufferRec *buffer)
+{
+	clearDiagnostics(buffer);
+	free(buffer->records);
+	free(buffer->slots);
+	memset(buffer, 0, sizeof(DiagBufferRec));
+}
+
+static void copyDiagnostics(DiagBufferRec *to, DiagBufferRec *from)
+{
+	int i;
+	clearDiagnostics(to);
+	for (i = 0; i < from->count; ++i) addDiagnostic(to, &from->records[i]);
+}
+
+/* diagnosticsFull tells whether the buffer in use has
+ * as many diagnostics as the phase may print
+ */
+static int diagnosticsFull(void)
+{
+	DiagBufferRec *buffer = diagBuffer != NULL ? diagBuffer : &phaseDiagnostics;
+	return errorsLeft >= 0 && buffer->count >= errorsLeft;
+}
+
+/* mergeDiagnostics appends the records of a held-back
+ * buffer to the phase, in their original order
+ */
+static void mergeDiagnostics(DiagBufferRec *buffer)
+{
+	int i;
+	for (i = 0; i < buffer->count && !diagnosticsFull(); ++i) addDiagnostic(&phaseDiagnostics, &buffer->records[i]);
+}
+
+static void reportDiagnostic(DiagnosticKind kind, int lineno, char *name)
+{
+	DiagnosticRec diagnostic;
+	DiagBufferRec *buffer = diagBuffer != NULL ? diagBuffer : &phaseDiagnostics;
+	if (diagnosticsFull()) return;
+	diagnostic.kind = kind;
+	diagnostic.lineno = lineno;
+	diagnostic.name = name;
+	diagnostic.previousLines = NULL;
+	diagnostic.previousCount = 0;
+	addDiagnostic(buffer, &diagnostic);
+}
+
+static void printDiagnostic(DiagnosticRec *diagnostic)
+{
+	int i;
+	switch (diagnostic->kind)
+	{
+		case RedefinitionDiag:
+			fprintf(listing, "Error: Symbol \"%s\" is redefined at line %d (already defined at line", diagnostic->name, diagnostic->lineno);
+			for (i = 0; i < diagnostic->previousCount; ++i) fprintf(listing, " %d", diagnostic->previousLines[i]);
+			fprintf(listing, ")\n");
+			break;
+		case UndeclaredFunctionDiag:
+			fprintf(listing, "Error: undeclared function \"%s\" is called at line %d\n", diagnostic->name, diagnostic->lineno);
+			break;
+		case UndeclaredVariableDiag:
+			fprintf(listing, "Error: undeclared variable \"%s\" is used at line %d\n", diagnostic->name, diagnostic->lineno);
+			break;
+		case VoidVariableDiag:
+			fprintf(listing, "Error: The void-type variable is declared at line %d (name : \"%s\")\n", diagnostic->lineno, diagnostic->name);
+			break;
+		case IndexNotIntegerDiag:
+			fprintf(listing, "Error: Invalid array indexing at line %d (name : \"%s\"). indices should be integer\n", diagnostic->lineno, diagnostic->name);
+			break;
+		case IndexNotArrayDiag:
+			fprintf(listing, "Error: Invalid array indexing at line %d (name : \"%s\"). indexing can only allowed for int[] variables\n", diagnostic->lineno, diagnostic->name);
+			break;
+		case InvalidCallDiag:
+			fprintf(listing, "Error: Invalid function call at line %d (name : \"%s\")\n", diagnostic->lineno, diagnostic->name);
+			break;
+		case InvalidReturnDiag:
+			fprintf(listing, "Error: Invalid return at line %d\n", diagnostic->lineno);
+			break;
+		case InvalidAssignmentDiag:
+			fprintf(listing, "Error: invalid assignment at line %d\n", diagnostic->lineno);
+			break;
+		case InvalidOperationDiag:
+			fprintf(listing, "Error: invalid operation at line %d\n", diagnostic->lineno);
+			break;
+		case InvalidConditionDiag:
+			fprintf(listing, "Error: invalid condition at line %d\n", diagnostic->lineno);
+			break;
+	}
+}
+
+static int compareDiagnostics(const void *a, const void *b)
+{
+	const DiagnosticRec *x = (const DiagnosticRec *)a;
+	const DiagnosticRec *y = (const DiagnosticRec *)b;
+	if (x->lineno != y->lineno) return x->lineno < y->lineno ? -1 : 1;
+	return x->order - y->order;
+}
+
+/* flushDiagnostics prints the diagnostics of the unit,
+ * of both buildSymtab and typeCheck, sorted by line and
+ * otherwise in the order found
+ */
+static void flushDiagnostics(void)
+{
+	int i, phase;
+	if (phaseDiagnostics.count == 0) return;
+	phase = enterPhase(ListingPhase);
+	Error = TRUE;
+	qsort(phaseDiagnostics.records, phaseDiagnostics.count, sizeof(DiagnosticRec), compareDiagnostics);
+	for (i = 0; i < phaseDiagnostics.count; ++i) printDiagnostic(&phaseDiagnostics.records[i]);
+	if (diagnosticsFull())
+	{
+		stopAnalysis = TRUE;
+		fprintf(listing, "Too many errors (--max-errors=%d), analysis stopped\n", MaxErrors);
+	}
+	if (errorsLeft >= 0) errorsLeft -= phaseDiagnostics.count;
+	freeDiagnostics(&phaseDiagnostics);
+	leavePhase(phase);
+}
+
 /*
 fprintf(listing, "Error: undeclared function \"%s\" is called at line %d\n", name, lineno);
 fprintf(listing, "Error: undeclared variable \"%s\" is used at line %d\n", name, lineno);
@@ -27,91 +293,95 @@ fprintf(listing, "Error: invalid operation at line %d\n", lineno);
 fprintf(listing, "Error: invalid condition at line %d\n", lineno); 
 */
 
-
 static void handleRedefinitionError(char *name, int lineno, SymbolEntryList symbol) //check
 {
-	Error = TRUE;
-	fprintf(listing, "Error: Symbol \"%s\" is redefined at line %d (already defined at line", name, lineno);
+	DiagnosticRec diagnostic;
+	SymbolEntryList s;
+	int count = 0;
+
+	/* a placeholder left by an earlier undeclared use is
+	 * completed by InsertSymbol, not redefined
+	 */
+	for (s = symbol; s != NULL; s = s->next)
+		if (strcmp(name, s->name) == 0 && s->node != NULL) ++count;
+	if (count == 0) return;
+	symbol = ThawSymbol(symbol);
+	diagnostic.kind = RedefinitionDiag;
+	diagnostic.lineno = lineno;
+	diagnostic.name = name;
+	diagnostic.previousLines = (int *)malloc((count + 1) * sizeof(int));
+	diagnostic.previousCount = 0;
 	while (symbol != NULL)
 	{
-		if (strcmp(name, symbol->name) == 0)
+		if (strcmp(name, symbol->name) == 0 && symbol->node != NULL)
 		{
 			symbol->status = defined;
 			if (symbol->node->scope != NULL) symbol->node->scope->status = defined;
-			fprintf(listing, " %d", symbol->lineUsage->lineno);
+			diagnostic.previousLines[diagnostic.previousCount++] = symbol->lineUsage->lineno;
 		}
 		symbol = symbol->next;
 	}
-	fprintf(listing, ")\n");
+	if (!diagnosticsFull()) addDiagnostic(diagBuffer != NULL ? diagBuffer : &phaseDiagnostics, &diagnostic);
+	free(diagnostic.previousLines);
 }
 
 static SymbolEntryRec *UndeclaredFunctionError(ScopeEntryRec *activeScope, TreeNode *node)  // check
 {
-	Error = TRUE;
-	fprintf(listing, "Error: undeclared function \"%s\" is called at line %d\n", node->name, node->lineno);
+	reportDiagnostic(UndeclaredFunctionDiag, node->lineno, node->name);
 	return InsertSymbol(activeScope, node->name, Undetermined, FunctionSym, node->lineno, NULL);
 }
 
 static SymbolEntryRec *UndeclaredVariableError(ScopeEntryRec *activeScope, TreeNode *node) //check
 {
-	Error = TRUE;
-	fprintf(listing, "Error: undeclared variable \"%s\" is used at line %d\n", node->name, node->lineno);
+	reportDiagnostic(UndeclaredVariableDiag, node->lineno, node->name);
 	return InsertSymbol(activeScope, node->name, Undetermined, VariableSym, node->lineno, NULL);
 }
 
 static void handleVoidTypeVariableError(char *name, int lineno) // check
 {
-	fprintf(listing, "Error: The void-type variable is declared at line %d (name : \"%s\")\n", lineno, name);
-	Error = TRUE;
+	reportDiagnostic(VoidVariableDiag, lineno, name);
 }
 
 static void handleArrayIndexingError(char *name, int lineno) //check
 {
-	fprintf(listing, "Error: Invalid array indexing at line %d (name : \"%s\"). indices should be integer\n", lineno, name);
-	Error = TRUE;
+	reportDiagnostic(IndexNotIntegerDiag, lineno, name);
 }
 
 static void handleArrayIndexingError2(char *name, int lineno)
 {
-	fprintf(listing, "Error: Invalid array indexing at line %d (name : \"%s\"). indexing can only allowed for int[] variables\n", lineno, name);
-	Error = TRUE;
+	reportDiagnostic(IndexNotArrayDiag, lineno, name);
 }
 
 static void handleInvalidFunctionCallError(char *name, int lineno) //check
 {
-	fprintf(listing, "Error: Invalid function call at line %d (name : \"%s\")\n", lineno, name);
-	Error = TRUE;
+	reportDiagnostic(InvalidCallDiag, lineno, name);
 }
 
 static void handleInvalidReturnError(int lineno) //check
 {
-	fprintf(listing, "Error: Invalid return at line %d\n", lineno);
-	Error = TRUE;
+	reportDiagnostic(InvalidReturnDiag, lineno, NULL);
 }
 
 static void handleInvalidAssignmentError(int lineno)
 {
-	fprintf(listing, "Error: invalid assignment at line %d\n", lineno);
-	Error = TRUE;
+	reportDiagnostic(InvalidAssignmentDiag, lineno, NULL);
 }
 
 static void handleInvalidOperationError(int lineno)  // check
 {
-	fprintf(listing, "Error: invalid operation at line %d\n", lineno);
-	Error = TRUE;
+	reportDiagnostic(InvalidOperationDiag, lineno, NULL);
 }
 
 static void handleInvalidConditionError(int lineno)
 {
-	fprintf(listing, "Error: invalid condition at line %d\n", lineno);
-	Error = TRUE;
+	reportDiagnostic(InvalidConditionDiag, lineno, NULL);
 }
 
 
 
 static void traverseTree(TreeNode *t, void (*preProc)(TreeNode *), void (*postProc)(TreeNode *))
 {
-	if (t != NULL)
+	if (t != NULL && !diagnosticsFull())
 	{
 		preProc(t);
 		int i;
@@ -122,15 +392,36 @@ static void traverseTree(TreeNode *t, void (*preProc)(TreeNode *), void (*postPr
 	}
 }
 
+/* traverseDeclaration visits one top-level declaration
+ * and its subtree, but not the declarations after it
+ */
+static void traverseDeclaration(TreeNode *t, void (*preProc)(TreeNode *), void (*postProc)(TreeNode *))
+{
+	preProc(t);
+	int i;
+	for (i = 0; i < MAXCHILDREN; i++) traverseTree(t->child[i], preProc, postProc);
+	postProc(t);
+}
+
 static void enterScope(TreeNode *t)
 {
-	if (t->scope != NULL) activeScope = t->scope;
+	if (t->scope != NULL) checkScope = t->scope;
 }
 static void exitScope(TreeNode *t)
 {
 	if (t->scope != NULL) activeScope = t->scope->parentScope;
 }
 
+static void declareFunction(TreeNode *t)
+{
+	SymbolEntryRec *symbol = SearchSymbolInScope(rootScope, t->name);
+	if (symbol != NULL) handleRedefinitionError(t->name, t->lineno, symbol);
+	InsertSymbol(rootScope, t->name, t->type, FunctionSym, t->lineno, t);
+}
+
+static void recordGlobalRef(TreeNode *t, SymbolKind kind, SymbolEntryRec *symbol);
+static int recordingRefs = FALSE;
+
 static void addTreeNode(TreeNode *t)
 {
 	switch (t->kind)
@@ -145,9 +436,7 @@ static void addTreeNode(TreeNode *t)
 		}
 		case FuncDecl:
 		{
-			SymbolEntryRec *symbol = SearchSymbolInScope(rootScope, t->name);
-			if (symbol != NULL) handleRedefinitionError(t->name, t->lineno, symbol);
-			InsertSymbol(activeScope, t->name, t->type, FunctionSym, t->lineno, t);
+			declareFunction(t);
 			activeScope = t->scope = InsertScope(t->name, activeScope, t);
 			break;
 		}
@@ -174,6 +463,7 @@ static void addTreeNode(TreeNode *t)
 		case CallExpr:
 		{
 			SymbolEntryRec *functionNode = SearchSymbolByKind(rootScope, t->name, FunctionSym);
+			if (recordingRefs) recordGlobalRef(t, FunctionSym, functionNode);
 			if (functionNode == NULL) functionNode = UndeclaredFunctionError(rootScope, t);
 			else
 				InsertSymbolIntoScope(rootScope, t->name, t->lineno);
@@ -182,6 +472,7 @@ static void addTreeNode(TreeNode *t)
 		case VarAccessExpr:
 		{
 			SymbolEntryRec *symbol = SearchSymbolByKind(activeScope, t->name, VariableSym);
+			if (recordingRefs && (symbol == NULL || symbol->scope == rootScope)) recordGlobalRef(t, VariableSym, symbol);
 			if (symbol == NULL) symbol = UndeclaredVariableError(activeScope, t);
 			else
 				InsertSymbolIntoScope(activeScope, t->name, t->lineno);
@@ -200,15 +491,12 @@ static void addTreeNode(TreeNode *t)
 }
 
 
-void buildSymtab(TreeNode *syntaxTree)
+static void insertBuiltins(void)
 {
-	rootScope = InsertScope("global", NULL, NULL);
-	activeScope = rootScope;
-
 	TreeNode *input = newTreeNode(FuncDecl);
 	input->lineno = 0;
 	input->type = Integer;
-	input->name = copyString("input");
+	input->name = CopyName("input");
 	input->child[0] = newTreeNode(Params);
 	input->child[0]->lineno = 0;
 	input->child[0]->type = Void;
@@ -217,24 +505,489 @@ void buildSymtab(TreeNode *syntaxTree)
 	TreeNode *output = newTreeNode(FuncDecl);
 	output->lineno = 0;
 	output->type = Void;
-	output->name = copyString("output");
+	output->name = CopyName("output");
 	TreeNode *param = newTreeNode(Params);
 	param->lineno = 0;
 	param->type = Integer;
-	param->name = copyString("value");
+	param->name = CopyName("value");
 	output->child[0] = param;
 
 	InsertSymbol(rootScope, input->name, input->type, FunctionSym, input->lineno, input);
 	InsertSymbol(rootScope, output->name, output->type, FunctionSym, output->lineno, output);
 	ScopeEntryRec *outputScope = InsertScope("output", rootScope, output);
 	InsertSymbol(outputScope, param->name, param->type, VariableSym, param->lineno,param);
+}
+
+/* Type diagnostics of the fused and parallel modes are
+ * held per top-level declaration and printed in source
+ * order, so the output matches the serial two-pass path.
+ * A pending segment still has to be (re)checked
+ */
+typedef struct DeclarationSegmentRec
+{
+	TreeNode *declaration;
+	DiagBufferRec diagnostics;
+	int pending;
+	struct FunctionStateRec *function;
+} DeclarationSegmentRec;
+
+static DeclarationSegmentRec *segments = NULL;
+static int segmentCount = 0;
+
+/* segments before mergedSegments have been checked and
+ * their diagnostics added to phaseDiagnostics
+ */
+static int mergedSegments = 0;
+
+static void allocSegments(TreeNode *syntaxTree)
+{
+	TreeNode *t;
+	int i = 0;
+
+	segmentCount = 0;
+	mergedSegments = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling) ++segmentCount;
+	segments = (DeclarationSegmentRec *)calloc(segmentCount + 1, sizeof(DeclarationSegmentRec));
+	for (t = syntaxTree; t != NULL; t = t->sibling, ++i) segments[i].declaration = t;
+}
+
+static void mergeCheckedSegments(void)
+{
+	while (mergedSegments < segmentCount && !segments[mergedSegments].pending && !diagnosticsFull())
+		mergeDiagnostics(&segments[mergedSegments++].diagnostics);
+}
+
+static void freeSegments(void)
+{
+	int i;
+	for (i = 0; i < segmentCount; ++i) freeDiagnostics(&segments[i].diagnostics);
+	free(segments);
+	segments = NULL;
+	segmentCount = 0;
+	mergedSegments = 0;
+}
+
+static void flushSegments(void)
+{
+	for (; mergedSegments < segmentCount; ++mergedSegments)
+		mergeDiagnostics(&segments[mergedSegments].diagnostics);
+	freeSegments();
+	flushDiagnostics();
+}
+
+/* In fused mode each top-level declaration is built and
+ * type-checked in a single traversal. A declaration that
+ * calls a function not declared yet is left pending and
+ * re-checked once the table is complete
+ */
+static DiagBufferRec *fusedDiagnostics = NULL;
+static int forwardCall = FALSE;
+
+static void addFusedTreeNode(TreeNode *t);
+static void checkFusedTreeNode(TreeNode *t);
+
+static void buildSymtabFused(TreeNode *syntaxTree)
+{
+	int i;
+
+	allocSegments(syntaxTree);
+	checkScope = rootScope;
+	for (i = 0; i < segmentCount && !diagnosticsFull(); ++i)
+	{
+		forwardCall = FALSE;
+		fusedDiagnostics = &segments[i].diagnostics;
+		traverseDeclaration(segments[i].declaration, addFusedTreeNode, checkFusedTreeNode);
+		segments[i].pending = forwardCall;
+	}
+}
+
+/* Incremental re-analysis (--watch). For every top-level
+ * function the previous run keeps its analyzed subtree and
+ * scopes, its diagnostics and its references to global
+ * symbols. The subtree is copied out of the unit before it
+ * is analyzed, so that it and its scopes live in an arena
+ * of the function's own and the unit can be freed. The first reference to each global name is a
+ * dependency and remembers the signature it resolved to
+ * (0 if it did not resolve). A function is reused when its
+ * body is unchanged and every dependency still resolves to
+ * the same signature; otherwise it is rebuilt and re-checked
+ */
+typedef struct GlobalRefRec
+{
+	char *name;
+	SymbolKind kind;
+	int lineno;
+	int found;
+	int dependency;
+	unsigned signature;
+	struct GlobalRefRec *next;
+	struct GlobalRefRec *nextDependency;
+} GlobalRefRec;
+
+typedef struct FunctionStateRec
+{
+	char *name;
+	unsigned fingerprint;
+	int lineno;
+	Arena arena;
+	TreeNode *node;
+	TreeNode *children[MAXCHILDREN];
+	ScopeEntryRec *scope;
+	ScopeEntryRec *firstScope;
+	ScopeEntryRec *lastScope;
+	GlobalRefRec *refs;
+	GlobalRefRec *lastRef;
+	GlobalRefRec *dependencies;
+	DiagBufferRec buildDiagnostics;
+	DiagBufferRec checkDiagnostics;
+	struct FunctionStateRec *next;
+	struct FunctionStateRec *nextWithName;
+} FunctionStateRec;
+
+#define STATE_TABLE_SIZE 1024
+
+static FunctionStateRec *functionStates = NULL;
+static FunctionStateRec *recordState = NULL;
+static int discardStates = FALSE;
+
+static unsigned hashName(char *name)
+{
+	unsigned h = 2166136261u;
+	while (*name != '\0') h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h;
+}
+
+/* symbolSignature summarizes everything type checking
+ * reads from a global symbol
+ */
+static unsigned symbolSignature(SymbolEntryRec *symbol)
+{
+	unsigned signature;
+	TreeNode *param;
+	if (symbol == NULL) return 0;
+	signature = 1 + (symbol->status == undeclared ? 2 : 0) + 4 * symbol->kind;
+	signature = signature * 31 + symbol->type;
+	if (symbol->kind == FunctionSym && symbol->node != NULL)
+		for (param = symbol->node->child[0]; param != NULL; param = param->sibling)
+			signature = signature * 31 + param->type + 8 * param->conflict;
+	return signature;
+}
+
+/* fingerprintNode hashes a subtree as it comes from the
+ * parser, with line numbers relative to baseLine
+ */
+static unsigned fingerprintNode(TreeNode *t, int baseLine)
+{
+	unsigned h = 2166136261u;
+	TreeNode *child;
+	int i;
+	h = (h ^ t->kind) * 16777619u;
+	h = (h ^ t->type) * 16777619u;
+	h = (h ^ (unsigned)t->val) * 16777619u;
+	h = (h ^ (unsigned)t->token) * 16777619u;
+	h = (h ^ (unsigned)t->conflict) * 16777619u;
+	h = (h ^ (unsigned)(t->lineno - baseLine)) * 16777619u;
+	if (t->name != NULL) h = (h ^ hashName(t->name)) * 16777619u;
+	for (i = 0; i < MAXCHILDREN; i++)
+	{
+		h = (h ^ (0x100u + i)) * 16777619u;
+		for (child = t->child[i]; child != NULL; child = child->sibling)
+			h = (h ^ fingerprintNode(child, baseLine)) * 16777619u;
+	}
+	return h;
+}
+
+static void recordGlobalRef(TreeNode *t, SymbolKind kind, SymbolEntryRec *symbol)
+{
+	GlobalRefRec *dependency = recordState->dependencies;
+	GlobalRefRec *ref = (GlobalRefRec *)malloc(sizeof(GlobalRefRec));
+	ref->name = t->name;
+	ref->kind = kind;
+	ref->lineno = t->lineno;
+	ref->found = symbol != NULL;
+	ref->signature = symbolSignature(symbol);
+	ref->next = NULL;
+	ref->nextDependency = NULL;
+
+	while (dependency != NULL && (dependency->kind != kind || strcmp(dependency->name, t->name) != 0))
+		dependency = dependency->nextDependency;
+	ref->dependency = dependency == NULL;
+	if (ref->dependency)
+	{
+		ref->nextDependency = recordState->dependencies;
+		recordState->dependencies = ref;
+	}
+
+	if (recordState->lastRef == NULL) recordState->refs = ref;
+	else
+		recordState->lastRef->next = ref;
+	recordState->lastRef = ref;
+}
+
+static void addIncrementalTreeNode(TreeNode *t)
+{
+	addTreeNode(t);
+	if (t == recordState->node) diagBuffer = &recordState->buildDiagnostics;
+}
+
+/* copyTree copies the sibling list t into the arena in use */
+static TreeNode *copyTree(TreeNode *t)
+{
+	TreeNode *head = NULL, *last = NULL, *copy;
+	int i;
+	for (; t != NULL; t = t->sibling)
+	{
+		copy = (TreeNode *)unitAlloc(sizeof(TreeNode));
+		*copy = *t;
+		copy->name = CopyName(t->name);
+		for (i = 0; i < MAXCHILDREN; i++) copy->child[i] = copyTree(t->child[i]);
+		copy->sibling = NULL;
+		copy->lastSibling = NULL;
+		if (last == NULL) head = copy;
+		else
+			last->sibling = copy;
+		last = copy;
+	}
+	if (head != NULL && head != last) head->lastSibling = last;
+	return head;
+}
+
+/* recordFunction analyzes function t in the arena of
+ * state, after moving t's subtree there
+ */
+static void recordFunction(FunctionStateRec *state, TreeNode *t)
+{
+	ScopeEntryRec *before = LastScope();
+	int i;
+	useArena(&state->arena);
+	state->name = CopyName(t->name);
+	for (i = 0; i < MAXCHILDREN; i++) t->child[i] = state->children[i] = copyTree(t->child[i]);
+	state->node = t;
+	state->lineno = t->lineno;
+	recordState = state;
+	recordingRefs = TRUE;
+	traverseDeclaration(t, addIncrementalTreeNode, exitScope);
+	recordingRefs = FALSE;
+	recordState = NULL;
+	diagBuffer = NULL;
+	useArena(NULL);
+	state->scope = t->scope;
+	state->firstScope = before->next;
+	state->lastScope = LastScope();
+	mergeDiagnostics(&state->buildDiagnostics);
+}
+
+static int dependenciesUnchanged(FunctionStateRec *state)
+{
+	GlobalRefRec *dependency;
+	for (dependency = state->dependencies; dependency != NULL; dependency = dependency->nextDependency)
+		if (symbolSignature(SearchSymbolByKind(rootScope, dependency->name, dependency->kind)) != dependency->signature)
+			return FALSE;
+	return TRUE;
+}
+
+static void shiftTreeLines(TreeNode *t, int delta)
+{
+	int i;
+	for (; t != NULL; t = t->sibling)
+	{
+		t->lineno += delta;
+		for (i = 0; i < MAXCHILDREN; i++) shiftTreeLines(t->child[i], delta);
+	}
+}
+
+/* reuseFunction puts the analyzed body of an unchanged
+ * function under its freshly parsed declaration node t and
+ * replays the function's effects on the global scope. The
+ * frozen tables of its scopes went with the previous unit
+ */
+static void reuseFunction(FunctionStateRec *state, TreeNode *t)
+{
+	int delta = t->lineno - state->lineno;
+	ScopeEntryRec *scope;
+	GlobalRefRec *ref;
+	int i;
+
+	declareFunction(t);
+	for (i = 0; i < MAXCHILDREN; i++) t->child[i] = state->children[i];
+	t->scope = state->scope;
+	state->firstScope->parentScope = rootScope;
+	AppendScopes(state->firstScope, state->lastScope);
+	for (scope = state->firstScope; scope != NULL; scope = scope->next)
+	{
+		scope->functionNode = t;
+		scope->frozen = NULL;
+		if (delta != 0)
+			for (i = 0; i < HASH_TABLE_SIZE; ++i)
+			{
+				SymbolEntryRec *symbol;
+				for (symbol = scope->symbols[i]; symbol != NULL; symbol = symbol->next)
+				{
+					LineUsageRec *line;
+					for (line = symbol->lineUsage; line != NULL; line = line->next) line->lineno += delta;
+				}
+			}
+	}
+	if (delta != 0)
+	{
+		for (i = 0; i < MAXCHILDREN; i++) shiftTreeLines(t->child[i], delta);
+		for (ref = state->refs; ref != NULL; ref = ref->next) ref->lineno += delta;
+	}
+
+	mergeDiagnostics(&state->buildDiagnostics);
+	for (ref = state->refs; ref != NULL; ref = ref->next)
+	{
+		if (ref->kind == FunctionSym && SearchSymbolByKind(rootScope, ref->name, FunctionSym) == NULL)
+			InsertSymbol(rootScope, ref->name, Undetermined, FunctionSym, ref->lineno, NULL);
+		else if (ref->found)
+			InsertSymbolIntoScope(rootScope, ref->name, ref->lineno);
+	}
+	state->node = t;
+	state->lineno = t->lineno;
+}
+
+static void freeFunctionState(FunctionStateRec *state)
+{
+	GlobalRefRec *ref = state->refs;
+	while (ref != NULL)
+	{
+		GlobalRefRec *next = ref->next;
+		free(ref);
+		ref = next;
+	}
+	freeDiagnostics(&state->buildDiagnostics);
+	freeDiagnostics(&state->checkDiagnostics);
+	freeArena(&state->arena);
+	free(state);
+}
+
+static void buildSymtabIncremental(TreeNode *syntaxTree)
+{
+	FunctionStateRec **previous = (FunctionStateRec **)calloc(STATE_TABLE_SIZE, sizeof(FunctionStateRec *));
+	FunctionStateRec *state;
+	FunctionStateRec *lastState = NULL;
+	int rebuilt = 0;
+	int functions = 0;
+	int i;
+
+	/* index the previous run by name, keeping source order,
+	 * unless it was only partly analyzed
+	 */
+	state = functionStates;
+	functionStates = NULL;
+	while (state != NULL)
+	{
+		FunctionStateRec *next = state->next;
+		FunctionStateRec **slot = &previous[hashName(state->name) % STATE_TABLE_SIZE];
+		if (discardStates)
+		{
+			freeFunctionState(state);
+			state = next;
+			continue;
+		}
+		while (*slot != NULL) slot = &(*slot)->nextWithName;
+		state->next = NULL;
+		state->nextWithName = NULL;
+		*slot = state;
+		state = next;
+	}
+	discardStates = FALSE;
+
+	allocSegments(syntaxTree);
+	for (i = 0; i < segmentCount && !diagnosticsFull(); ++i)
+	{
+		TreeNode *t = segments[i].declaration;
+		FunctionStateRec **slot;
+		unsigned fingerprint;
+
+		segments[i].pending = TRUE;
+		if (t->kind != FuncDecl)
+		{
+			traverseDeclaration(t, addTreeNode, exitScope);
+			continue;
+		}
 
-	traverseTree(syntaxTree, addTreeNode, exitScope);
+		++functions;
+		fingerprint = fingerprintNode(t, t->lineno);
+		slot = &previous[hashName(t->name) % STATE_TABLE_SIZE];
+		while (*slot != NULL && strcmp((*slot)->name, t->name) != 0) slot = &(*slot)->nextWithName;
+		state = *slot;
+		if (state != NULL) *slot = state->nextWithName;
 
-	if (TraceAnalyze)
+		if (state != NULL && state->fingerprint == fingerprint
+			&& (t->lineno == state->lineno || (state->buildDiagnostics.count == 0 && state->checkDiagnostics.count == 0))
+			&& dependenciesUnchanged(state))
+		{
+			reuseFunction(state, t);
+			copyDiagnostics(&segments[i].diagnostics, &state->checkDiagnostics);
+			segments[i].pending = FALSE;
+		}
+		else
+		{
+			if (state != NULL) freeFunctionState(state);
+			state = (FunctionStateRec *)calloc(1, sizeof(FunctionStateRec));
+			state->fingerprint = fingerprint;
+			recordFunction(state, t);
+			++rebuilt;
+		}
+		segments[i].function = state;
+		state->next = NULL;
+		state->nextWithName = NULL;
+		if (lastState == NULL) functionStates = state;
+		else
+			lastState->next = state;
+		lastState = state;
+	}
+
+	/* functions that disappeared from the source */
+	for (i = 0; i < STATE_TABLE_SIZE; ++i)
+	{
+		state = previous[i];
+		while (state != NULL)
+		{
+			FunctionStateRec *next = state->nextWithName;
+			freeFunctionState(state);
+			state = next;
+		}
+	}
+	free(previous);
+
+	if (TraceAnalyze) fprintf(listing, "\nIncremental: %d of %d functions rebuilt\n", rebuilt, functions);
+}
+
+void buildSymtab(TreeNode *syntaxTree)
+{
+	int i, phase;
+	errorsLeft = MaxErrors > 0 ? MaxErrors : -1;
+	stopAnalysis = FALSE;
+	ResetScopes();
+	rootScope = InsertScope("global", NULL, NULL);
+	activeScope = rootScope;
+	insertBuiltins();
+	for (i = 0; i < ImportCount; ++i)
+		if (!ReadInterface(ImportFiles[i], rootScope))
+		{
+			fprintf(stderr, "Cannot import interface %s\n", ImportFiles[i]);
+			exit(1);
+		}
+
+	if (IncrementalAnalyze) buildSymtabIncremental(syntaxTree);
+	else if (FusedAnalyze) buildSymtabFused(syntaxTree);
+	else
+		traverseTree(syntaxTree, addTreeNode, exitScope);
+	/* the diagnostics are printed by typeCheck, with its own */
+	if (diagnosticsFull()) stopAnalysis = TRUE;
+
+	phase = enterPhase(ListingPhase);
+	if (SymtabFormat != SymtabNone) ExportSymbolTable(listing, rootScope, SymtabFormat);
+	else if (TraceAnalyze)
 	{
 		DisplaySymbolTable(listing, rootScope);
 	}
+	leavePhase(phase);
+	layoutFrames(syntaxTree, rootScope);
+	/* the table is complete; checking only reads it */
+	FreezeScopes();
 }
 
 static void checkTreeNode(TreeNode *t)
@@ -251,9 +1004,9 @@ static void checkTreeNode(TreeNode *t)
 		case ReturnStmt:
 		{
 			if (
-				(t->child[0] != NULL && t->child[0]->type != activeScope->functionNode->type)
+				(t->child[0] != NULL && t->child[0]->type != checkScope->functionNode->type)
 				||
-				(t->child[0] == NULL && activeScope->functionNode->type != Void)
+				(t->child[0] == NULL && checkScope->functionNode->type != Void)
 			) handleInvalidReturnError(t->lineno);
 			break;
 		}
@@ -327,7 +1080,7 @@ static void checkTreeNode(TreeNode *t)
 		}
 		case VarAccessExpr:
 		{
-			SymbolEntryRec *symbol = SearchSymbolByKind(activeScope, t->name, VariableSym);
+			SymbolEntryRec *symbol = SearchSymbolByKind(checkScope, t->name, VariableSym);
 			if (symbol->status == undeclared)
 			{
 				t->type = symbol->type;
@@ -360,6 +1113,134 @@ static void checkTreeNode(TreeNode *t)
 	}
 }
 
+static void addFusedTreeNode(TreeNode *t)
+{
+	addTreeNode(t);
+	enterScope(t);
+}
+
+static void checkFusedTreeNode(TreeNode *t)
+{
+	if (t->kind == CallExpr)
+	{
+		SymbolEntryRec *function = SearchSymbolByKind(rootScope, t->name, FunctionSym);
+		if (function->status == undeclared) forwardCall = TRUE;
+	}
+	diagBuffer = fusedDiagnostics;
+	checkTreeNode(t);
+	diagBuffer = NULL;
+	exitScope(t);
+}
+
+static void checkSegment(DeclarationSegmentRec *segment)
+{
+	clearDiagnostics(&segment->diagnostics);
+	checkScope = rootScope;
+	diagBuffer = &segment->diagnostics;
+	traverseDeclaration(segment->declaration, enterScope, checkTreeNode);
+	diagBuffer = NULL;
+}
+
+/* Pending segments are handed out to the checking
+ * threads in order through nextSegment. Finished
+ * segments are merged in order, so the threads can
+ * stop as soon as the error limit is reached
+ */
+static int nextSegment = 0;
+static pthread_mutex_t segmentLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *checkSegmentsWorker(void *unused)
+{
+	int i = -1;
+	(void)unused;
+	for (;;)
+	{
+		pthread_mutex_lock(&segmentLock);
+		if (i >= 0) segments[i].pending = FALSE;
+		mergeCheckedSegments();
+		while (nextSegment < segmentCount && !segments[nextSegment].pending) ++nextSegment;
+		i = diagnosticsFull() ? segmentCount : nextSegment++;
+		pthread_mutex_unlock(&segmentLock);
+		if (i >= segmentCount) break;
+		checkSegment(&segments[i]);
+	}
+	return NULL;
+}
+
+static void checkPendingSegments(int jobs)
+{
+	pthread_t *threads;
+	int started = 0;
+	int i;
+
+	nextSegment = 0;
+	if (jobs <= 1)
+	{
+		checkSegmentsWorker(NULL);
+		return;
+	}
+
+	threads = (pthread_t *)malloc(jobs * sizeof(pthread_t));
+	for (i = 0; i < jobs; ++i)
+		if (pthread_create(&threads[started], NULL, checkSegmentsWorker, NULL) == 0) ++started;
+	/* the main thread finishes the work if no thread could start */
+	if (started == 0) checkSegmentsWorker(NULL);
+	for (i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+	free(threads);
+}
+
 void typeCheck(TreeNode *syntaxTree) {
+	if (stopAnalysis)
+	{
+		/* the tree was only partly analyzed; nothing of
+		 * this run may be reused by the next one, which
+		 * frees it (the unit still uses its memory)
+		 */
+		discardStates = TRUE;
+		freeSegments();
+		flushDiagnostics();
+		return;
+	}
+	if (IncrementalAnalyze)
+	{
+		int i;
+		checkPendingSegments(CheckJobs);
+		for (i = 0; i < segmentCount; ++i)
+			if (segments[i].function != NULL)
+				copyDiagnostics(&segments[i].function->checkDiagnostics, &segments[i].diagnostics);
+		flushSegments();
+		return;
+	}
+	if (FusedAnalyze)
+	{
+		checkPendingSegments(CheckJobs);
+		flushSegments();
+		return;
+	}
+	if (CheckJobs > 1)
+	{
+		int i;
+		allocSegments(syntaxTree);
+		for (i = 0; i < segmentCount; ++i) segments[i].pending = TRUE;
+		checkPendingSegments(CheckJobs);
+		flushSegments();
+		return;
+	}
+	checkScope = activeScope;
 	traverseTree(syntaxTree, enterScope, checkTreeNode);
+	flushDiagnostics();
+}
+
+void listFrames(TreeNode *syntaxTree)
+{
+	printFrames(listing, syntaxTree, rootScope);
+}
+
+void emitInterface(char *path)
+{
+	if (!WriteInterface(path, rootScope))
+	{
+		fprintf(stderr, "Unable to write interface %s\n", path);
+		exit(1);
+	}
 }
@@ -11,13 +11,32 @@
 #include "globals.h"
 
 /* Function buildSymtab constructs the symbol 
- * table by preorder traversal of the syntax tree
+ * table by preorder traversal of the syntax tree.
+ * If FusedAnalyze is set, type checking is done in
+ * the same traversal. Diagnostics are held back
+ * until typeCheck is called
  */
 void buildSymtab(TreeNode *);
 
 /* Procedure typeCheck performs type checking 
  * by a postorder syntax tree traversal
+ * (in fused mode it only re-checks declarations
+ * with forward calls), then prints the diagnostics
+ * of the unit sorted by line.
+ * If CheckJobs > 1, top-level declarations are
+ * checked concurrently by that many threads
  */
 void typeCheck(TreeNode *);
 
+/* Procedure emitInterface writes the global declarations
+ * of the analyzed unit to the interface file path
+ * (see interface.h)
+ */
+void emitInterface(char *path);
+
+/* Procedure listFrames prints the frame layout that
+ * buildSymtab gave the variables (see frame.h)
+ */
+void listFrames(TreeNode *syntaxTree);
+
 #endif
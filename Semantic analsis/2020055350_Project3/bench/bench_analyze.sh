@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compare the two-pass and fused semantic analysis modes
+# on a generated program. Only analysis is timed: the
+# compiler is run with --no-code, so that code generation
+# and its optimizations do not hide the difference.
+# usage: bench_analyze.sh [compiler] [functions] [statements] [runs]
+
+CC_BIN=${1:-./cminus_semantic}
+FUNCS=${2:-300}
+STMTS=${3:-10}
+RUNS=${4:-5}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+SRC=$DIR/bench_large.cm
+
+"$(dirname "$0")/gen_program.sh" "$FUNCS" "$STMTS" > "$SRC"
+echo "program: $FUNCS functions x $STMTS loops ($(wc -l < "$SRC") lines)"
+
+run() {
+	start=$(date +%s.%N)
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		"$CC_BIN" --no-code $1 "$SRC" > /dev/null
+		i=$((i + 1))
+	done
+	end=$(date +%s.%N)
+	echo "$start $end $RUNS" | awk '{ printf "%.3f", ($2 - $1) / $3 }'
+}
+
+"$CC_BIN" --no-code "$SRC" > "$DIR/twopass.txt"
+"$CC_BIN" --no-code --fused "$SRC" > "$DIR/fused.txt"
+if cmp -s "$DIR/twopass.txt" "$DIR/fused.txt"; then echo "diagnostics: identical"
+else echo "diagnostics: DIFFER"; fi
+
+twopass=$(run "")
+fused=$(run --fused)
+echo "two-pass: ${twopass}s per run"
+echo "fused:    ${fused}s per run"
+echo "$twopass $fused" | awk '{ printf "speedup:  %.2fx\n", $1 / $2 }'
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Compile C-Minus programs to TM code and count the
+# instructions they take, the instructions they execute
+# and the data memory accesses (LD and ST) they make. Programs with
+# errors are skipped; input() reads INPUTS in turn, and
+# a program is stopped after LIMIT instructions (and left
+# out of the totals). FLAGS are passed to the compiler.
+# usage: bench_code.sh [compiler] [tm] program.cm...
+
+CC_BIN=${1:-./cminus_semantic}
+TM_BIN=${2:-./tm}
+shift 2
+INPUTS=${INPUTS:-"48 18 3 1 4 1 5 9 2 6"}
+LIMIT=${LIMIT:-1000000}
+FLAGS=${FLAGS:-}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+CC_BIN=$(cd "$(dirname "$CC_BIN")" && pwd)/$(basename "$CC_BIN")
+TM_BIN=$(cd "$(dirname "$TM_BIN")" && pwd)/$(basename "$TM_BIN")
+
+printf "%-16s %8s %10s %10s  %s\n" program code executed memory result
+total_code=0
+total_run=0
+total_mem=0
+for f in "$@"; do
+	name=$(basename "$f" .cm)
+	cp "$f" "$DIR/$name.cm"
+	(cd "$DIR" && "$CC_BIN" $FLAGS "$name.cm" > /dev/null)
+	[ -f "$DIR/$name.tm" ] || continue
+	code=$(grep -c '^ *[0-9]' "$DIR/$name.tm")
+	{ printf 'p\ng %d\n' "$LIMIT"; for v in $INPUTS; do echo "$v"; done; } |
+		"$TM_BIN" "$DIR/$name.tm" > "$DIR/$name.out"
+	run=$(sed -n 's/.*instructions executed = //p' "$DIR/$name.out")
+	mem=$(sed -n 's/.*memory accesses = //p' "$DIR/$name.out")
+	if grep -q '^HALT' "$DIR/$name.out"; then
+		result=halted
+		total_code=$((total_code + code))
+		total_run=$((total_run + run))
+		total_mem=$((total_mem + mem))
+	else result="stopped at $LIMIT"; fi
+	printf "%-16s %8d %10d %10d  %s\n" "$name" "$code" "$run" "$mem" "$result"
+done
+printf "%-16s %8d %10d %10d\n" total "$total_code" "$total_run" "$total_mem"
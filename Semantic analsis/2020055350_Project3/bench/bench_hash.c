@@ -0,0 +1,197 @@
+/****************************************************/
+/* File: bench_hash.c                               */
+/* Micro-benchmark of the symbol table hash family  */
+/****************************************************/
+
+/* usage: bench_hash [-n N] [file.cm ...]
+ * Builds one scope from each identifier set with each
+ * hash function and reports hashing cost, lookup
+ * throughput and how evenly the names spread over the
+ * buckets. The sets are the identifiers of the given
+ * files, N generated names v1..vN and N random names
+ */
+
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include <ctype.h>
+#include <time.h>
+
+#define LOOKUP_ROUNDS 200
+#define MAX_NAME 64
+
+typedef struct NameSet
+{
+	char *title;
+	char **names;
+	int count;
+	int capacity;
+} NameSet;
+
+static void addName(NameSet *set, const char *name)
+{
+	int i;
+	for (i = 0; i < set->count; ++i)
+		if (strcmp(set->names[i], name) == 0) return;
+	if (set->count == set->capacity)
+	{
+		set->capacity = set->capacity == 0 ? 256 : set->capacity * 2;
+		set->names = (char **)realloc(set->names, set->capacity * sizeof(char *));
+	}
+	set->names[set->count++] = strdup(name);
+}
+
+static int isKeyword(const char *s)
+{
+	static const char *keywords[] = {"int", "void", "if", "else", "while", "return", NULL};
+	int i;
+	for (i = 0; keywords[i] != NULL; ++i)
+		if (strcmp(s, keywords[i]) == 0) return TRUE;
+	return FALSE;
+}
+
+static void readIdentifiers(NameSet *set, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char name[MAX_NAME];
+	int length = 0;
+	int c;
+	if (f == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", path);
+		exit(1);
+	}
+	do
+	{
+		c = fgetc(f);
+		if (c != EOF && (isalpha(c) || (length > 0 && isdigit(c))))
+		{
+			if (length < MAX_NAME - 1) name[length++] = c;
+		}
+		else if (length > 0)
+		{
+			name[length] = '\0';
+			if (!isKeyword(name)) addName(set, name);
+			length = 0;
+		}
+	} while (c != EOF);
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *hashTitle(int kind)
+{
+	if (kind == ShiftHash) return "shift";
+	else if (kind == WordHash) return "word";
+	else
+		return "fnv1a";
+}
+
+static void measure(NameSet *set, int kind)
+{
+	char **names = (char **)malloc(set->count * sizeof(char *));
+	ScopeEntryRec *scope;
+	double start, hashTime, lookupTime, probes = 0;
+	volatile unsigned sink = 0;
+	int longest = 0, round, i;
+
+	SymtabHash = kind;
+	freeUnit();
+	ResetScopes();
+	scope = InsertScope("bench", NULL, NULL);
+
+	start = now();
+	for (round = 0; round < LOOKUP_ROUNDS; ++round)
+		for (i = 0; i < set->count; ++i) sink += HashName(set->names[i], strlen(set->names[i]), kind);
+	hashTime = now() - start;
+
+	for (i = 0; i < set->count; ++i)
+	{
+		names[i] = CopyName(set->names[i]);
+		InsertSymbol(scope, names[i], Integer, VariableSym, 0, NULL);
+	}
+
+	start = now();
+	for (round = 0; round < LOOKUP_ROUNDS; ++round)
+		for (i = 0; i < set->count; ++i)
+			if (SearchSymbolInScope(scope, names[i]) != NULL) ++sink;
+	lookupTime = now() - start;
+
+	for (i = 0; i < HASH_TABLE_SIZE; ++i)
+	{
+		SymbolEntryRec *symbol;
+		int length = 0;
+		for (symbol = scope->symbols[i]; symbol != NULL; symbol = symbol->next) ++length;
+		probes += length * (length + 1) / 2.0;
+		if (length > longest) longest = length;
+	}
+
+	printf("%-12s %-6s %7d %9.1f %12.2f %11.2f %8.2f %8d\n",
+		set->title, hashTitle(kind), set->count,
+		hashTime * 1e9 / ((double)LOOKUP_ROUNDS * set->count),
+		(double)LOOKUP_ROUNDS * set->count / lookupTime / 1e6,
+		probes / set->count,
+		1.0 + (set->count - 1) / (2.0 * HASH_TABLE_SIZE),
+		longest);
+	free(names);
+}
+
+int main(int argc, char *argv[])
+{
+	NameSet sets[3];
+	int setCount = 0;
+	int n = 2000;
+	int argi, i, kind;
+
+	listing = stdout;
+	memset(sets, 0, sizeof(sets));
+	argi = 1;
+	if (argi + 1 < argc && strcmp(argv[argi], "-n") == 0)
+	{
+		n = atoi(argv[argi + 1]);
+		argi += 2;
+	}
+
+	if (argi < argc)
+	{
+		sets[setCount].title = "source";
+		for (; argi < argc; ++argi) readIdentifiers(&sets[setCount], argv[argi]);
+		++setCount;
+	}
+
+	sets[setCount].title = "sequential";
+	for (i = 1; i <= n; ++i)
+	{
+		char name[MAX_NAME];
+		sprintf(name, "v%d", i);
+		addName(&sets[setCount], name);
+	}
+	++setCount;
+
+	sets[setCount].title = "random";
+	srand(12345);
+	while (sets[setCount].count < n)
+	{
+		char name[MAX_NAME];
+		int length = 2 + rand() % 11;
+		for (i = 0; i < length; ++i) name[i] = i > 0 && rand() % 4 == 0 ? '0' + rand() % 10 : 'a' + rand() % 26;
+		name[length] = '\0';
+		addName(&sets[setCount], name);
+	}
+	++setCount;
+
+	printf("%d buckets, %d lookup rounds\n", HASH_TABLE_SIZE, LOOKUP_ROUNDS);
+	printf("%-12s %-6s %7s %9s %12s %11s %8s %8s\n",
+		"set", "hash", "names", "ns/hash", "Mlookups/s", "probes/hit", "uniform", "longest");
+	for (i = 0; i < setCount; ++i)
+		for (kind = ShiftHash; kind <= WordHash; ++kind) measure(&sets[i], kind);
+
+	freeUnit();
+	return 0;
+}
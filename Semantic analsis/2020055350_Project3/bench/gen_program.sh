@@ -0,0 +1,37 @@
+#!/bin/sh
+# Generate a large, error-free C-Minus program for benchmarking.
+# usage: gen_program.sh <functions> <statements-per-function>
+
+FUNCS=${1:-300}
+STMTS=${2:-10}
+
+awk -v funcs="$FUNCS" -v stmts="$STMTS" 'BEGIN {
+	print "int g[100];";
+	print "int total;";
+	print "";
+	for (f = 0; f < funcs; f++) {
+		printf "int f%d(int a, int b[])\n{\n", f;
+		print "\tint i;";
+		print "\tint x;";
+		print "\tint t[10];";
+		print "\ti = 0;";
+		print "\tx = a;";
+		for (s = 0; s < stmts; s++) {
+			printf "\twhile (i < %d)\n\t{\n", s + 1;
+			print "\t\tint y;";
+			printf "\t\ty = x * %d + b[i] - t[i / 2];\n", s + 2;
+			print "\t\tif (y > total) total = y; else g[i] = y;";
+			if (f > 0) printf "\t\tx = f%d(y, t);\n", f - 1;
+			print "\t\ti = i + 1;";
+			print "\t}";
+		}
+		print "\treturn x;";
+		print "}";
+		print "";
+	}
+	print "void main(void)";
+	print "{";
+	print "\ttotal = 0;";
+	printf "\toutput(f%d(input(), g));\n", funcs - 1;
+	print "}";
+}'
@@ -0,0 +1,246 @@
+/****************************************************/
+/* File: callgraph.c                                */
+/* Call graph of a C-Minus program                  */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include "callgraph.h"
+
+/* nodes are found by name through buckets indexed with
+ * the hash CopyName stored with the name
+ */
+CallNodeRec *findCallNode(CallGraphRec *graph, char *name)
+{
+	CallNodeRec *node = graph->buckets[NameHash(name) & (graph->bucketCount - 1)];
+	while (node != NULL && strcmp(node->name, name) != 0) node = node->nextInBucket;
+	return node;
+}
+
+static CallNodeRec *addCallNode(CallGraphRec *graph, char *name, TreeNode *declaration)
+{
+	CallNodeRec *node = findCallNode(graph, name);
+	CallNodeRec **bucket;
+	if (node != NULL)
+	{
+		if (node->declaration == NULL) node->declaration = declaration;
+		return node;
+	}
+
+	node = (CallNodeRec *)unitAlloc(sizeof(CallNodeRec));
+	memset(node, 0, sizeof(CallNodeRec));
+	node->name = name;
+	node->declaration = declaration;
+	node->index = -1;
+	bucket = &graph->buckets[NameHash(name) & (graph->bucketCount - 1)];
+	node->nextInBucket = *bucket;
+	*bucket = node;
+	if (graph->lastNode == NULL) graph->nodes = node;
+	else
+		graph->lastNode->next = node;
+	graph->lastNode = node;
+	++graph->nodeCount;
+	return node;
+}
+
+/* The edge from the caller being walked to a callee is
+ * remembered in the callee (stampCaller, stampEdge), so
+ * repeated calls find it without a search
+ */
+static void addCall(CallGraphRec *graph, CallNodeRec *caller, TreeNode *call)
+{
+	CallNodeRec *callee = addCallNode(graph, call->name, NULL);
+	CallSiteRec *site = (CallSiteRec *)unitAlloc(sizeof(CallSiteRec));
+	CallEdgeRec *edge;
+
+	if (callee->stampCaller == caller) edge = callee->stampEdge;
+	else
+	{
+		edge = (CallEdgeRec *)unitAlloc(sizeof(CallEdgeRec));
+		edge->callee = callee;
+		edge->count = 0;
+		edge->sites = edge->lastSite = NULL;
+		edge->next = NULL;
+		if (caller->lastEdge == NULL) caller->edges = edge;
+		else
+			caller->lastEdge->next = edge;
+		caller->lastEdge = edge;
+		callee->stampCaller = caller;
+		callee->stampEdge = edge;
+		++callee->callers;
+		++graph->edgeCount;
+	}
+
+	site->lineno = call->lineno;
+	site->next = NULL;
+	if (edge->lastSite == NULL) edge->sites = site;
+	else
+		edge->lastSite->next = site;
+	edge->lastSite = site;
+	++edge->count;
+}
+
+static void collectCalls(CallGraphRec *graph, CallNodeRec *caller, TreeNode *t)
+{
+	int i;
+	for (; t != NULL; t = t->sibling)
+	{
+		for (i = 0; i < MAXCHILDREN; i++) collectCalls(graph, caller, t->child[i]);
+		if (t->kind == CallExpr) addCall(graph, caller, t);
+	}
+}
+
+/* markComponents numbers the strongly connected components
+ * with Tarjan's algorithm. The depth-first search keeps
+ * its own stack so that long call chains cannot overflow
+ * the C stack
+ */
+typedef struct SearchFrame
+{
+	CallNodeRec *node;
+	CallEdgeRec *edge;
+} SearchFrame;
+
+static void markComponents(CallGraphRec *graph)
+{
+	SearchFrame *frames = (SearchFrame *)malloc((graph->nodeCount + 1) * sizeof(SearchFrame));
+	CallNodeRec **stack = (CallNodeRec **)malloc((graph->nodeCount + 1) * sizeof(CallNodeRec *));
+	CallNodeRec *root;
+	int counter = 0, depth, top = 0;
+
+	for (root = graph->nodes; root != NULL; root = root->next)
+	{
+		if (root->index >= 0) continue;
+		depth = 0;
+		frames[0].node = root;
+		frames[0].edge = root->edges;
+		root->index = root->lowlink = counter++;
+		root->onStack = TRUE;
+		stack[top++] = root;
+
+		while (depth >= 0)
+		{
+			SearchFrame *frame = &frames[depth];
+			CallNodeRec *node = frame->node;
+			if (frame->edge != NULL)
+			{
+				CallNodeRec *callee = frame->edge->callee;
+				frame->edge = frame->edge->next;
+				if (callee == node) node->recursive = TRUE;
+				if (callee->index < 0)
+				{
+					callee->index = callee->lowlink = counter++;
+					callee->onStack = TRUE;
+					stack[top++] = callee;
+					++depth;
+					frames[depth].node = callee;
+					frames[depth].edge = callee->edges;
+				}
+				else if (callee->onStack && callee->index < node->lowlink)
+					node->lowlink = callee->index;
+				continue;
+			}
+
+			if (node->lowlink == node->index)
+			{
+				int first = top, i;
+				do
+					stack[--first]->onStack = FALSE;
+				while (stack[first] != node);
+				for (i = first; i < top; ++i)
+				{
+					stack[i]->scc = graph->sccCount;
+					if (top - first > 1) stack[i]->recursive = TRUE;
+				}
+				top = first;
+				++graph->sccCount;
+			}
+			--depth;
+			if (depth >= 0 && node->lowlink < frames[depth].node->lowlink)
+				frames[depth].node->lowlink = node->lowlink;
+		}
+	}
+	free(stack);
+	free(frames);
+}
+
+CallGraphRec *buildCallGraph(TreeNode *syntaxTree)
+{
+	CallGraphRec *graph = (CallGraphRec *)unitAlloc(sizeof(CallGraphRec));
+	TreeNode *t;
+	int declarations = 0;
+
+	memset(graph, 0, sizeof(CallGraphRec));
+	for (t = syntaxTree; t != NULL; t = t->sibling) ++declarations;
+	graph->bucketCount = 16;
+	while (graph->bucketCount < 2 * declarations) graph->bucketCount *= 2;
+	graph->buckets = (CallNodeRec **)unitAlloc(graph->bucketCount * sizeof(CallNodeRec *));
+	memset(graph->buckets, 0, graph->bucketCount * sizeof(CallNodeRec *));
+
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind == FuncDecl) addCallNode(graph, t->name, t);
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind == FuncDecl)
+		{
+			int i;
+			CallNodeRec *caller = findCallNode(graph, t->name);
+			for (i = 0; i < MAXCHILDREN; i++) collectCalls(graph, caller, t->child[i]);
+		}
+	markComponents(graph);
+	return graph;
+}
+
+static void exportDot(FILE *out, CallGraphRec *graph)
+{
+	CallNodeRec *node;
+	CallEdgeRec *edge;
+	fprintf(out, "digraph callgraph {\n");
+	for (node = graph->nodes; node != NULL; node = node->next)
+	{
+		fprintf(out, "  \"%s\"", node->name);
+		if (node->declaration == NULL && node->recursive) fprintf(out, " [shape=box, color=red]");
+		else if (node->declaration == NULL) fprintf(out, " [shape=box]");
+		else if (node->recursive) fprintf(out, " [color=red]");
+		fprintf(out, ";\n");
+	}
+	for (node = graph->nodes; node != NULL; node = node->next)
+		for (edge = node->edges; edge != NULL; edge = edge->next)
+			fprintf(out, "  \"%s\" -> \"%s\" [label=\"%d\"];\n", node->name, edge->callee->name, edge->count);
+	fprintf(out, "}\n");
+}
+
+static void exportJson(FILE *out, CallGraphRec *graph)
+{
+	CallNodeRec *node;
+	CallEdgeRec *edge;
+	CallSiteRec *site;
+	int first = TRUE;
+
+	fprintf(out, "{\n  \"functions\": [");
+	for (node = graph->nodes; node != NULL; node = node->next)
+	{
+		fprintf(out, "%s\n    {\"name\": \"%s\", \"defined\": %s, \"line\": %d, \"scc\": %d, \"recursive\": %s}",
+			node == graph->nodes ? "" : ",", node->name, node->declaration != NULL ? "true" : "false",
+			node->declaration != NULL ? node->declaration->lineno : 0, node->scc, node->recursive ? "true" : "false");
+	}
+	fprintf(out, "\n  ],\n  \"calls\": [");
+	for (node = graph->nodes; node != NULL; node = node->next)
+		for (edge = node->edges; edge != NULL; edge = edge->next)
+		{
+			fprintf(out, "%s\n    {\"caller\": \"%s\", \"callee\": \"%s\", \"count\": %d, \"lines\": [",
+				first ? "" : ",", node->name, edge->callee->name, edge->count);
+			for (site = edge->sites; site != NULL; site = site->next)
+				fprintf(out, "%d%s", site->lineno, site->next != NULL ? ", " : "");
+			fprintf(out, "]}");
+			first = FALSE;
+		}
+	fprintf(out, "\n  ]\n}\n");
+}
+
+void exportCallGraph(FILE *out, CallGraphRec *graph, int format)
+{
+	if (format == CallGraphJson) exportJson(out, graph);
+	else
+		exportDot(out, graph);
+}
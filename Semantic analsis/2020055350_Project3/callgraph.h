@@ -0,0 +1,88 @@
+/****************************************************/
+/* File: callgraph.h                                */
+/* Call graph of a C-Minus program                  */
+/****************************************************/
+
+#ifndef _CALLGRAPH_H_
+#define _CALLGRAPH_H_
+
+#include "globals.h"
+
+typedef struct CallSiteRec
+{
+	int lineno;
+	struct CallSiteRec *next;
+} CallSiteRec;
+
+/* one edge per (caller, callee) pair; count is the
+ * number of call sites, listed in source order
+ */
+typedef struct CallEdgeRec
+{
+	struct CallNodeRec *callee;
+	int count;
+	CallSiteRec *sites;
+	CallSiteRec *lastSite;
+	struct CallEdgeRec *next;
+} CallEdgeRec;
+
+/* declaration is NULL for functions that are called but
+ * not defined in the program (built-in, imported or
+ * undeclared). Functions in the same strongly connected
+ * component share scc; recursive marks the components
+ * whose functions can call themselves
+ */
+typedef struct CallNodeRec
+{
+	char *name;
+	TreeNode *declaration;
+	CallEdgeRec *edges;
+	CallEdgeRec *lastEdge;
+	int callers;
+	int scc;
+	int recursive;
+	int index;
+	int lowlink;
+	int onStack;
+	struct CallNodeRec *stampCaller;
+	CallEdgeRec *stampEdge;
+	struct CallNodeRec *next;
+	struct CallNodeRec *nextInBucket;
+} CallNodeRec;
+
+typedef struct CallGraphRec
+{
+	CallNodeRec *nodes;
+	CallNodeRec *lastNode;
+	int nodeCount;
+	int edgeCount;
+	int sccCount;
+	CallNodeRec **buckets;
+	int bucketCount;
+} CallGraphRec;
+
+typedef enum
+{
+	CallGraphNone,
+	CallGraphDot,
+	CallGraphJson
+} CallGraphFormatKind;
+
+/* Function buildCallGraph collects the calls made by
+ * every function of the analyzed syntax tree and marks
+ * the recursive components. The graph is allocated with
+ * the compilation unit
+ */
+CallGraphRec *buildCallGraph(TreeNode *syntaxTree);
+
+/* findCallNode returns the node of the function name,
+ * or NULL if it is neither defined nor called
+ */
+CallNodeRec *findCallNode(CallGraphRec *graph, char *name);
+
+/* Procedure exportCallGraph prints the graph in the given
+ * CallGraphFormatKind (Graphviz DOT or JSON)
+ */
+void exportCallGraph(FILE *out, CallGraphRec *graph, int format);
+
+#endif
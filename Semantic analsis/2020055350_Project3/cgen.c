@@ -1,7 +1,7 @@
 /****************************************************/
 /* File: cgen.c                                     */
 /* The code generator implementation                */
-/* for the TINY compiler                            */
+/* for the C-Minus compiler                         */
 /* (generates code for the TM machine)              */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
@@ -12,153 +12,530 @@
 #include "code.h"
 #include "cgen.h"
 
-/* tmpOffset is the memory offset for temps
-   It is decremented each time a temp is
-   stored, and incremeted when loaded again
-*/
+/* Activation records grow upward from the end of the
+ * global data, and mp points to the record of the
+ * running function:
+ *
+ *      0(mp)    return address
+ *    1+k(mp)    word k of the frame (parameters first,
+ *               then locals; see frame.h)
+ *    above      temporaries, then the record of a callee
+ *
+ * Word k of the global data is at k(gp); gp is never
+ * changed from 0, so an element of a global array is
+ * addressed by its index alone. An array parameter
+ * holds the address of element 0.
+ *
+ * The caller stores the arguments in the callee's
+ * record, moves mp to it and jumps with the return
+ * address in ac; the callee saves it, and returns with
+ * its value in ac by loading pc from 0(mp). The caller
+ * then moves mp back, so no control link is kept.
+ */
+#define FRAME_HEADER 1
+
+/* tmpOffset is the offset from mp of the next free
+ * word above the frame: temps are pushed there, and a
+ * callee's record starts there
+ */
 static int tmpOffset = 0;
 
+/* scope is the innermost scope of the code being
+ * generated, used to find the variables it names
+ */
+static ScopeEntryRec * scope = NULL;
+
+/* functions gives the label of each function's code;
+ * defined tells whether its body has been emitted
+ */
+typedef struct FunctionLabelRec
+{ char * name;
+  int label;
+  int defined;
+  struct FunctionLabelRec * next;
+} FunctionLabelRec;
+
+static FunctionLabelRec * functions = NULL;
+
+/* Function functionOf returns the record of
+ * function name, adding one if there is none
+ */
+static FunctionLabelRec * functionOf(char * name)
+{ FunctionLabelRec * l;
+  for (l = functions; l != NULL; l = l->next)
+    if (strcmp(l->name,name) == 0) return l;
+  l = (FunctionLabelRec *) malloc(sizeof(FunctionLabelRec));
+  l->name = name;
+  l->label = newLabel();
+  l->defined = FALSE;
+  l->next = functions;
+  functions = l;
+  return l;
+}
+
 /* prototype for internal recursive code generator */
 static void cGen (TreeNode * tree);
+static void genExp( TreeNode * tree, int b);
+
+/* Function isGlobal tells whether symbol is in
+ * the global data rather than in a frame
+ */
+static int isGlobal(SymbolEntryRec * symbol)
+{ return symbol->scope->parentScope == NULL; }
+
+/* Function isArrayParam tells whether symbol holds the
+ * address of an array rather than the array itself
+ */
+static int isArrayParam(SymbolEntryRec * symbol)
+{ return symbol->node != NULL && symbol->node->kind == Params &&
+         (symbol->type == IntegerArray || symbol->type == VoidArray);
+}
+
+static SymbolEntryRec * lookupVariable(TreeNode * tree)
+{ return SearchSymbolByKind(scope,tree->name,VariableSym); }
+
+/* varLoc and varBase give the address of the first
+ * word of symbol as a displacement from a register
+ */
+static int varLoc(SymbolEntryRec * symbol)
+{ return isGlobal(symbol) ? symbol->offset : FRAME_HEADER + symbol->offset; }
+
+static int varBase(SymbolEntryRec * symbol)
+{ return isGlobal(symbol) ? gp : mp; }
+
+/* Expressions are evaluated in registers ac (0) to
+ * NREGS-1 by Sethi-Ullman numbering. label gives the
+ * register need of a tree, the registers it takes
+ * when no temp is stored; a binary operation whose
+ * operands both need n takes n+1. The needier operand
+ * is evaluated first, where the order cannot be told
+ * from the result, so that the other one fits in the
+ * registers left. Past them, an operand is stored in a
+ * temp. A call destroys every register: it needs more
+ * than there are, so it is only evaluated with none in
+ * use
+ */
+#define NREGS 5
+#define MAX_NEED (NREGS + 1)
+
+/* effects of evaluating a tree, as found by label */
+#define SIDE_EFFECT 1  /* assigns, calls or does I/O */
+#define ASSIGNS 2      /* holds an assignment */
+#define READS_MEMORY 4 /* reads a global or an element */
+
+static int combineNeeds(int n1, int n2)
+{ int n = n1 == n2 ? n1 + 1 : n1 > n2 ? n1 : n2;
+  return n > MAX_NEED ? MAX_NEED : n;
+}
+
+/* Function label returns the register need of tree
+ * and adds the effects of evaluating it to effects.
+ * For an array access it is the need of the element
+ * address
+ */
+static int label(TreeNode * tree, int * effects)
+{ SymbolEntryRec * symbol;
+  TreeNode * arg;
+  int need;
+  switch (tree->kind) {
+    case VarAccessExpr :
+      symbol = lookupVariable(tree);
+      if (tree->child[0] == NULL)
+      { if (isGlobal(symbol)) *effects |= READS_MEMORY;
+        return 1;
+      }
+      *effects |= READS_MEMORY;
+      need = label(tree->child[0],effects);
+      /* the address of a parameter's element is
+       * added in a second register
+       */
+      return isArrayParam(symbol) && need < 2 ? 2 : need;
+    case AssignExpr :
+      *effects |= SIDE_EFFECT | ASSIGNS;
+      if (tree->child[0]->child[0] == NULL) return label(tree->child[1],effects);
+      need = label(tree->child[0],effects);
+      return combineNeeds(need,label(tree->child[1],effects));
+    case CallExpr :
+      *effects |= SIDE_EFFECT;
+      if (strcmp(tree->name,"input") == 0) return 1;
+      if (strcmp(tree->name,"output") == 0) return label(tree->child[0],effects);
+      for (arg = tree->child[0]; arg != NULL; arg = arg->sibling) label(arg,effects);
+      return MAX_NEED;
+    case OpExpr :
+      need = label(tree->child[0],effects);
+      return combineNeeds(need,label(tree->child[1],effects));
+    default :
+      return 1;
+  }
+}
+
+/* Function canReorder tells whether an operand with
+ * effects e2 may be evaluated before one with effects
+ * e1 that precedes it: e1 must have no side effect, and
+ * if e2 has one, it must not change what e1 reads. A
+ * scalar local can only be changed by an assignment
+ */
+static int canReorder(int e1, int e2)
+{ if (e1 & SIDE_EFFECT) return FALSE;
+  if (!(e2 & SIDE_EFFECT)) return TRUE;
+  return !(e1 & READS_MEMORY) && !(e2 & ASSIGNS);
+}
+
+/* Procedure genLeaf loads leaf tree into register reg.
+ * A variable naming a whole array stands for the
+ * address of its element 0
+ */
+static void genLeaf(TreeNode * tree, int reg)
+{ SymbolEntryRec * symbol;
+  if (tree->kind == ConstExpr)
+  { emitRM("LDC",reg,tree->val,0,"load const");
+    return;
+  }
+  symbol = lookupVariable(tree);
+  if ((symbol->type == IntegerArray || symbol->type == VoidArray) && !isArrayParam(symbol))
+    emitRM("LDA",reg,varLoc(symbol),varBase(symbol),"load array address");
+  else
+    emitRM("LD",reg,varLoc(symbol),varBase(symbol),"load id value");
+}
+
+/* Function genElement generates code for the index of
+ * the array access tree and leaves a base in register
+ * b; the element is at the returned displacement from it
+ */
+static int genElement(TreeNode * tree, int b)
+{ SymbolEntryRec * symbol = lookupVariable(tree);
+  genExp(tree->child[0],b);
+  if (isArrayParam(symbol))
+  { emitRM("LD",b+1,varLoc(symbol),mp,"load array parameter");
+    emitRO("ADD",b,b,b+1,"element address");
+    return 0;
+  }
+  if (isGlobal(symbol)) return varLoc(symbol);
+  emitRO("ADD",b,b,mp,"element address");
+  return varLoc(symbol);
+}
+
+/* Function genOperand evaluates tree into register b,
+ * or if address is set, the address of the array
+ * element tree, returning its displacement from b
+ */
+static int genOperand(TreeNode * tree, int b, int address)
+{ if (address) return genElement(tree,b);
+  genExp(tree,b);
+  return 0;
+}
+
+/* Procedure genOperands evaluates the operands p1 and
+ * p2 of an operation at base b, p1 as an element address
+ * if address is set (its displacement goes to disp).
+ * The registers that hold them are put in r1 and r2,
+ * one of them b
+ */
+static void genOperands(TreeNode * p1, TreeNode * p2, int b, int address,
+                        int * r1, int * r2, int * disp)
+{ int e1 = 0, e2 = 0;
+  int n1 = label(p1,&e1);
+  int n2 = label(p2,&e2);
+  int swap = n2 > n1 && canReorder(e1,e2);
+  TreeNode * first = swap ? p2 : p1;
+  TreeNode * second = swap ? p1 : p2;
+  int d1, d2, rFirst, rSecond;
+  d1 = genOperand(first,b,address && !swap);
+  if ((swap ? n1 : n2) < NREGS - b)
+  { d2 = genOperand(second,b+1,address && swap);
+    rFirst = b;
+    rSecond = b+1;
+  }
+  else
+  { /* out of registers: keep the first in a temp */
+    emitRM("ST",b,tmpOffset++,mp,"op: push operand");
+    d2 = genOperand(second,b,address && swap);
+    emitRM("LD",b+1,--tmpOffset,mp,"op: load operand");
+    rFirst = b+1;
+    rSecond = b;
+  }
+  *r1 = swap ? rSecond : rFirst;
+  *r2 = swap ? rFirst : rSecond;
+  *disp = swap ? d2 : d1;
+}
+
+/* Procedure genCall generates code for a call, leaving
+ * the value returned in register b. A function other
+ * than input and output is called with b = ac
+ */
+static void genCall( TreeNode * tree, int b)
+{ TreeNode * arg;
+  int frame = tmpOffset;
+  int argOffset = frame + FRAME_HEADER;
+  if (strcmp(tree->name,"input") == 0)
+  { emitRO("IN",b,0,0,"input");
+    return;
+  }
+  if (strcmp(tree->name,"output") == 0)
+  { genExp(tree->child[0],b);
+    emitRO("OUT",b,0,0,"output");
+    return;
+  }
+  if (TraceCode) emitComment("-> call");
+  /* each argument goes straight to the callee's frame;
+   * while it is computed, the ones already stored are
+   * kept below the temps
+   */
+  for (arg = tree->child[0]; arg != NULL; arg = arg->sibling)
+  { tmpOffset = argOffset + 1;
+    genExp(arg,ac);
+    emitRM("ST",ac,argOffset++,mp,"call: store argument");
+  }
+  tmpOffset = frame;
+  emitRM("LDA",mp,frame,mp,"call: push frame");
+  emitRM("LDA",ac,1,pc,"call: return address");
+  emitRM_Label("LDA",pc,functionOf(tree->name)->label,"call: jump to function");
+  emitRM("LDA",mp,-frame,mp,"call: pop frame");
+  if (TraceCode) emitComment("<- call");
+}
+
+/* Procedure genAssign generates code for assignment
+ * tree at base b; its value is left in register b only
+ * if keep is set
+ */
+static void genAssign( TreeNode * tree, int b, int keep)
+{ TreeNode * p1 = tree->child[0];
+  TreeNode * p2 = tree->child[1];
+  SymbolEntryRec * symbol;
+  int address, value, loc;
+  if (TraceCode) emitComment("-> assign") ;
+  if (p1->child[0] == NULL)
+  { symbol = lookupVariable(p1);
+    genExp(p2,b);
+    emitRM("ST",b,varLoc(symbol),varBase(symbol),"assign: store value");
+  }
+  else
+  { genOperands(p1,p2,b,TRUE,&address,&value,&loc);
+    emitRM("ST",value,loc,address,"assign: store element");
+    if (keep && value != b) emitRM("LDA",b,0,value,"assign: move value");
+  }
+  if (TraceCode)  emitComment("<- assign") ;
+}
+
+/* Function relopJump returns the jump taken when
+ * the value genCompare leaves for comparison op says
+ * it holds, or with negate set, that it fails
+ */
+static char * relopJump(TokenType op, int negate)
+{ if (negate)
+    op = op == LT ? GE : op == LE ? GT : op == GT ? LE :
+         op == GE ? LT : op == EQ ? NE : EQ;
+  return op == LT ? "JLT" : op == LE ? "JLE" : op == GT ? "JGT" :
+         op == GE ? "JGE" : op == EQ ? "JEQ" : "JNE";
+}
+
+static int isRelop(TokenType op)
+{ return op == LT || op == LE || op == GT || op == GE || op == EQ || op == NE; }
+
+/* Procedure genCompare leaves in register b a value
+ * that is negative, zero or positive as register left
+ * is less than, equal to or greater than register
+ * right. left - right does for == and !=, but for an
+ * ordering it overflows when the signs differ, so the
+ * signs are compared first
+ */
+static void genCompare( TokenType op, int b, int left, int right)
+{ if (op != EQ && op != NE)
+  { emitRM("JLT",left,3,pc,"compare: left negative");
+    emitRM("JGE",right,5,pc,"compare: same signs");
+    emitRM("LDC",b,1,0,"compare: greater");
+    emitRM("LDA",pc,4,pc,"compare: done");
+    emitRM("JLT",right,2,pc,"compare: same signs");
+    emitRM("LDC",b,-1,0,"compare: less");
+    emitRM("LDA",pc,1,pc,"compare: done");
+  }
+  emitRO("SUB",b,left,right,"op relational") ;
+}
+
+/* Procedure genBranch generates code for condition tree
+ * of a statement that jumps to label if the condition
+ * holds (sense TRUE) or fails (sense FALSE). A
+ * comparison jumps on the value genCompare leaves
+ * without making a 0 or 1 first, and a constant
+ * condition takes no test at all
+ */
+static void genBranch( TreeNode * tree, int sense, int label, char * c)
+{ int left, right, loc;
+  if (tree->kind == ConstExpr)
+  { if ((tree->val != 0) == sense) emitRM_Label("LDA",pc,label,c);
+  }
+  else if (tree->kind == OpExpr && isRelop(tree->token))
+  { if (TraceCode) emitComment("-> Op") ;
+    genOperands(tree->child[0],tree->child[1],ac,FALSE,&left,&right,&loc);
+    genCompare(tree->token,ac,left,right);
+    emitRM_Label(relopJump(tree->token,!sense),ac,label,c);
+    if (TraceCode)  emitComment("<- Op") ;
+  }
+  else
+  { genExp(tree,ac);
+    emitRM_Label(sense ? "JNE" : "JEQ",ac,label,c);
+  }
+}
 
 /* Procedure genStmt generates code at a statement node */
 static void genStmt( TreeNode * tree)
 { TreeNode * p1, * p2, * p3;
-  int savedLoc1,savedLoc2,currentLoc;
-  int loc;
-  switch (tree->kind.stmt) {
+  int label1,label2;
+  ScopeEntryRec * enclosing;
+  FunctionLabelRec * function;
+  switch (tree->kind) {
+
+      case FuncDecl :
+         if (tree->child[1] == NULL) break;
+         if (TraceCode) emitComment("-> function") ;
+         emitComment(tree->name);
+         enclosing = scope;
+         scope = tree->scope;
+         tmpOffset = FRAME_HEADER + scope->frameSize;
+         function = functionOf(tree->name);
+         placeLabel(function->label);
+         function->defined = TRUE;
+         emitRM("ST",ac,0,mp,"function: store return address");
+         cGen(tree->child[1]);
+         /* no return needed after a final return statement */
+         p1 = tree->child[1]->child[1];
+         while (p1 != NULL && p1->sibling != NULL) p1 = p1->sibling;
+         if (p1 == NULL || p1->kind != ReturnStmt)
+           emitRM("LD",pc,0,mp,"function: return");
+         scope = enclosing;
+         if (TraceCode) emitComment("<- function") ;
+         break; /* FuncDecl */
+
+      case VarDecl :
+         /* storage was laid out by layoutFrames */
+         break;
+
+      case CompStmt :
+         enclosing = scope;
+         if (tree->scope != NULL) scope = tree->scope;
+         cGen(tree->child[1]);
+         scope = enclosing;
+         break; /* CompStmt */
 
-      case IfK :
+      case IfStmt :
          if (TraceCode) emitComment("-> if") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
          p3 = tree->child[2] ;
          /* generate code for test expression */
-         cGen(p1);
-         savedLoc1 = emitSkip(1) ;
-         emitComment("if: jump to else belongs here");
+         label1 = newLabel() ;
+         genBranch(p1,FALSE,label1,p3 != NULL ? "if: jmp to else" : "if: jmp to end");
          /* recurse on then part */
          cGen(p2);
-         savedLoc2 = emitSkip(1) ;
-         emitComment("if: jump to end belongs here");
-         currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc1) ;
-         emitRM_Abs("JEQ",ac,currentLoc,"if: jmp to else");
-         emitRestore() ;
-         /* recurse on else part */
-         cGen(p3);
-         currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc2) ;
-         emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
-         emitRestore() ;
+         if (p3 != NULL)
+         { label2 = newLabel() ;
+           emitRM_Label("LDA",pc,label2,"jmp to end") ;
+           placeLabel(label1) ;
+           /* recurse on else part */
+           cGen(p3);
+           placeLabel(label2) ;
+         }
+         else placeLabel(label1) ;
          if (TraceCode)  emitComment("<- if") ;
-         break; /* if_k */
+         break; /* IfStmt */
 
-      case RepeatK:
-         if (TraceCode) emitComment("-> repeat") ;
+      case WhileStmt :
+         /* the test is placed after the body, so that an
+          * iteration takes one jump instead of two
+          */
+         if (TraceCode) emitComment("-> while") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
-         savedLoc1 = emitSkip(0);
-         emitComment("repeat: jump after body comes back here");
-         /* generate code for body */
-         cGen(p1);
-         /* generate code for test */
+         label1 = newLabel() ;
+         label2 = newLabel() ;
+         emitRM_Label("LDA",pc,label1,"while: jmp to test");
+         placeLabel(label2) ;
          cGen(p2);
-         emitRM_Abs("JEQ",ac,savedLoc1,"repeat: jmp back to body");
-         if (TraceCode)  emitComment("<- repeat") ;
-         break; /* repeat */
-
-      case AssignK:
-         if (TraceCode) emitComment("-> assign") ;
-         /* generate code for rhs */
-         cGen(tree->child[0]);
-         /* now store value */
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"assign: store value");
-         if (TraceCode)  emitComment("<- assign") ;
-         break; /* assign_k */
-
-      case ReadK:
-         emitRO("IN",ac,0,0,"read integer value");
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"read: store value");
-         break;
-      case WriteK:
-         /* generate code for expression to write */
-         cGen(tree->child[0]);
-         /* now output it */
-         emitRO("OUT",ac,0,0,"write ac");
+         placeLabel(label1) ;
+         genBranch(p1,TRUE,label2,"while: jmp back to body");
+         if (TraceCode)  emitComment("<- while") ;
+         break; /* WhileStmt */
+
+      case ReturnStmt :
+         if (TraceCode) emitComment("-> return") ;
+         if (tree->child[0] != NULL) genExp(tree->child[0],ac);
+         emitRM("LD",pc,0,mp,"return");
+         if (TraceCode)  emitComment("<- return") ;
+         break; /* ReturnStmt */
+
+      case AssignExpr :
+         /* expression statement: the value is not kept */
+         genAssign(tree,ac,FALSE);
          break;
+
       default:
+         /* expression statement */
+         genExp(tree,ac);
          break;
     }
 } /* genStmt */
 
-/* Procedure genExp generates code at an expression node */
-static void genExp( TreeNode * tree)
-{ int loc;
-  TreeNode * p1, * p2;
-  switch (tree->kind.exp) {
-
-    case ConstK :
-      if (TraceCode) emitComment("-> Const") ;
-      /* gen code to load integer constant using LDC */
-      emitRM("LDC",ac,tree->attr.val,0,"load const");
-      if (TraceCode)  emitComment("<- Const") ;
-      break; /* ConstK */
-    
-    case IdK :
-      if (TraceCode) emitComment("-> Id") ;
-      loc = st_lookup(tree->attr.name);
-      emitRM("LD",ac,loc,gp,"load id value");
-      if (TraceCode)  emitComment("<- Id") ;
-      break; /* IdK */
-
-    case OpK :
+/* Procedure genExp generates code at an expression
+ * node, leaving its value in register b
+ */
+static void genExp( TreeNode * tree, int b)
+{ int loc, left, right;
+  switch (tree->kind) {
+
+    case ConstExpr :
+      genLeaf(tree,b);
+      break; /* ConstExpr */
+
+    case VarAccessExpr :
+      if (tree->child[0] == NULL) genLeaf(tree,b);
+      else
+      { loc = genElement(tree,b);
+        emitRM("LD",b,loc,b,"load element");
+      }
+      break; /* VarAccessExpr */
+
+    case AssignExpr :
+      genAssign(tree,b,TRUE);
+      break; /* AssignExpr */
+
+    case CallExpr :
+      genCall(tree,b);
+      break; /* CallExpr */
+
+    case OpExpr :
          if (TraceCode) emitComment("-> Op") ;
-         p1 = tree->child[0];
-         p2 = tree->child[1];
-         /* gen code for ac = left arg */
-         cGen(p1);
-         /* gen code to push left operand */
-         emitRM("ST",ac,tmpOffset--,mp,"op: push left");
-         /* gen code for ac = right operand */
-         cGen(p2);
-         /* now load left operand */
-         emitRM("LD",ac1,++tmpOffset,mp,"op: load left");
-         switch (tree->attr.op) {
+         genOperands(tree->child[0],tree->child[1],b,FALSE,&left,&right,&loc);
+         switch (tree->token) {
             case PLUS :
-               emitRO("ADD",ac,ac1,ac,"op +");
+               emitRO("ADD",b,left,right,"op +");
                break;
             case MINUS :
-               emitRO("SUB",ac,ac1,ac,"op -");
+               emitRO("SUB",b,left,right,"op -");
                break;
             case TIMES :
-               emitRO("MUL",ac,ac1,ac,"op *");
+               emitRO("MUL",b,left,right,"op *");
                break;
             case OVER :
-               emitRO("DIV",ac,ac1,ac,"op /");
+               emitRO("DIV",b,left,right,"op /");
                break;
             case LT :
-               emitRO("SUB",ac,ac1,ac,"op <") ;
-               emitRM("JLT",ac,2,pc,"br if true") ;
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
+            case LE :
+            case GT :
+            case GE :
             case EQ :
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JEQ",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
+            case NE :
+               genCompare(tree->token,b,left,right);
+               emitRM(relopJump(tree->token,FALSE),b,2,pc,"br if true") ;
+               emitRM("LDC",b,0,0,"false case") ;
                emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
+               emitRM("LDC",b,1,0,"true case") ;
                break;
             default:
                emitComment("BUG: Unknown operator");
                break;
          } /* case op */
          if (TraceCode)  emitComment("<- Op") ;
-         break; /* OpK */
+         break; /* OpExpr */
 
     default:
       break;
@@ -169,44 +546,61 @@ static void genExp( TreeNode * tree)
  * tree traversal
  */
 static void cGen( TreeNode * tree)
-{ if (tree != NULL)
-  { switch (tree->nodekind) {
-      case StmtK:
-        genStmt(tree);
-        break;
-      case ExpK:
-        genExp(tree);
-        break;
-      default:
-        break;
-    }
-    cGen(tree->sibling);
+{ while (tree != NULL)
+  { genStmt(tree);
+    tree = tree->sibling;
   }
 }
 
 /**********************************************/
 /* the primary function of the code generator */
 /**********************************************/
-/* Procedure codeGen generates code to a code
- * file by traversal of the syntax tree. The
- * second parameter (codefile) is the file name
- * of the code file, and is used to print the
- * file name as a comment in the code file
+/* Procedure codeGen generates code into the
+ * code buffer by traversal of the syntax tree.
+ * The second parameter (codefile) is the file
+ * name of the code file, and is used to print
+ * the file name as a comment in the code file
  */
 void codeGen(TreeNode * syntaxTree, char * codefile)
 {  char * s = malloc(strlen(codefile)+7);
+   TreeNode * t;
+   FunctionLabelRec * f;
+   int globals = 0;
    strcpy(s,"File: ");
    strcat(s,codefile);
-   emitComment("TINY Compilation to TM Code");
+   emitComment("C-Minus Compilation to TM Code");
    emitComment(s);
-   /* generate standard prelude */
+   free(s);
+   for (t = syntaxTree; t != NULL; t = t->sibling)
+     if (t->kind == FuncDecl && t->scope != NULL)
+       globals = t->scope->parentScope->frameSize;
+   /* generate standard prelude: main's record
+    * starts after the global data
+    */
    emitComment("Standard prelude:");
-   emitRM("LD",mp,0,ac,"load maxaddress from location 0");
-   emitRM("ST",ac,0,ac,"clear location 0");
-   emitComment("End of standard prelude.");
-   /* generate code for TINY program */
-   cGen(syntaxTree);
-   /* finish */
+   emitRM("LDA",mp,globals,gp,"main frame follows the globals");
+   emitRM("LDA",ac,1,pc,"return address");
+   emitRM_Label("LDA",pc,functionOf("main")->label,"jump to main");
    emitComment("End of execution.");
    emitRO("HALT",0,0,0,"");
+   emitComment("End of standard prelude.");
+   /* generate code for C-Minus program */
+   tmpOffset = 0;
+   scope = NULL;
+   cGen(syntaxTree);
+   /* finish: a call to a function with no body
+    * is an error
+    */
+   for (f = functions; f != NULL; f = f->next)
+     if (!f->defined)
+     { fprintf(listing,"Code generation error: function %s has no body in this unit\n",f->name);
+       placeLabel(f->label);
+       Error = TRUE;
+     }
+   resolveLabels();
+   while (functions != NULL)
+   { f = functions->next;
+     free(functions);
+     functions = f;
+   }
 }
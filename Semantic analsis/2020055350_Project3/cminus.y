@@ -10,6 +10,7 @@
 #include "globals.h"
 
 #include "util.h"
+#include "symtab.h"
 
     #include "scan.h"
 
@@ -37,12 +38,7 @@ program: declaration_list {
         savedTree = $1;
     };
 declaration_list: declaration_list declaration {
-        YYSTYPE t = $1;
-        if (t != NULL) {
-            while (t -> sibling != NULL) t = t -> sibling;
-            t -> sibling = $2;
-            $$ = $1;
-        } else $$ = $2;
+        $$ = appendSibling($1, $2);
     } |
     declaration {
         $$ = $1;
@@ -98,12 +94,7 @@ params: param_list {
         $$ -> conflict = TRUE;
     };
 param_list: param_list COMMA param {
-        YYSTYPE t = $1;
-        if (t != NULL) {
-            while (t -> sibling != NULL) t = t -> sibling;
-            t -> sibling = $3;
-            $$ = $1;
-        } else $$ = $3;
+        $$ = appendSibling($1, $3);
     } |
     param {
         $$ = $1;
@@ -133,23 +124,13 @@ compound_stmt: LCURLY local_declarations statement_list RCURLY {
     $$ -> conflict = FALSE;
 };
 local_declarations: local_declarations var_declaration {
-        YYSTYPE t = $1;
-        if (t != NULL) {
-            while (t -> sibling != NULL) t = t -> sibling;
-            t -> sibling = $2;
-            $$ = $1;
-        } else $$ = $2;
+        $$ = appendSibling($1, $2);
     } |
     empty {
         $$ = $1;
     };
 statement_list: statement_list statement {
-        YYSTYPE t = $1;
-        if (t != NULL) {
-            while (t -> sibling != NULL) t = t -> sibling;
-            t -> sibling = $2;
-            $$ = $1;
-        } else $$ = $2;
+        $$ = appendSibling($1, $2);
     } |
     empty {
         $$ = $1;
@@ -172,7 +153,7 @@ statement: selection_stmt {
     };
 selection_stmt: IF LPAREN expression RPAREN statement ELSE statement {
         $$ = newTreeNode(IfStmt);
-        $$->lineno = $5->lineno;
+        $$->lineno = $5 != NULL ? $5->lineno : lineno;
         $$ -> conflict = TRUE;
         $$ -> child[0] = $3;
         $$ -> child[1] = $5;
@@ -180,7 +161,7 @@ selection_stmt: IF LPAREN expression RPAREN statement ELSE statement {
     } |
     IF LPAREN expression RPAREN statement {
         $$ = newTreeNode(IfStmt);
-        $$->lineno = $5->lineno;
+        $$->lineno = $5 != NULL ? $5->lineno : lineno;
         $$ -> child[0] = $3;
         $$ -> child[1] = $5;
         $$->conflict = FALSE;
@@ -193,7 +174,7 @@ expression_stmt: expression SEMI {
     };
 iteration_stmt: WHILE LPAREN expression RPAREN statement {
     $$ = newTreeNode(WhileStmt);
-    $$ -> lineno = $5->lineno;
+    $$ -> lineno = $5 != NULL ? $5->lineno : lineno;
     $$ -> child[0] = $3;
     $$ -> child[1] = $5;
 };
@@ -334,12 +315,7 @@ args: arg_list {
         $$ = $1;
     };
 arg_list: arg_list COMMA expression {
-        YYSTYPE t = $1;
-        if (t != NULL) {
-            while (t -> sibling != NULL) t = t -> sibling;
-            t -> sibling = $3;
-            $$ = $1;
-        } else $$ = $3;
+        $$ = appendSibling($1, $3);
     } |
     expression {
         $$ = $1;
@@ -347,7 +323,7 @@ arg_list: arg_list COMMA expression {
 id: ID {
     $$ = newTreeNode(Id);
     $$ -> lineno = lineno;
-    $$ -> name = copyString(tokenString);
+    $$ -> name = CopyName(tokenString);
 };
 number: NUM {
     $$ = newTreeNode(ConstExpr);
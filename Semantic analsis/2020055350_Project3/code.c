@@ -12,16 +12,81 @@
 /* TM location number for current instruction emission */
 static int emitLoc = 0 ;
 
-/* Highest TM location emitted so far
-   For use in conjunction with emitSkip,
-   emitBackup, and emitRestore */
-static int highEmitLoc = 0;
+/* the instructions emitted, indexed by location;
+ * codeSize is emitLoc, and codeCapacity the number
+ * of locations allocated
+ */
+Instruction * codeBuffer = NULL;
+int codeSize = 0;
+static int codeCapacity = 0;
+
+/* comment lines, each printed before the
+ * instruction at loc
+ */
+typedef struct
+{ int loc;
+  char * text;
+} CommentLine;
+
+static CommentLine * comments = NULL;
+static int commentCount = 0;
+static int commentCapacity = 0;
+
+/* labelLoc gives the location of each label, or -1
+ * while it is not placed; relocations lists the
+ * instructions that refer to a label
+ */
+typedef struct
+{ int loc;
+  int label;
+} Relocation;
+
+static int * labelLoc = NULL;
+static int labelCount = 0;
+static int labelCapacity = 0;
+static Relocation * relocations = NULL;
+static int relocationCount = 0;
+static int relocationCapacity = 0;
+
+static char * saveText( char * c)
+{ char * t = malloc(strlen(c)+1);
+  strcpy(t,c);
+  return t;
+}
+
+/* Procedure emit puts an instruction at emitLoc */
+static void emit( char * op, int isRM, int r, int s, int t,
+                  int d, int target, char * c)
+{ Instruction * i;
+  if (emitLoc == codeCapacity)
+  { codeCapacity = codeCapacity == 0 ? 256 : 2*codeCapacity;
+    codeBuffer = realloc(codeBuffer,codeCapacity*sizeof(Instruction));
+  }
+  i = &codeBuffer[emitLoc++];
+  i->op = op;
+  i->isRM = isRM;
+  i->r = r;
+  i->s = s;
+  i->t = t;
+  i->d = d;
+  i->target = target;
+  i->comment = TraceCode && c != NULL ? saveText(c) : NULL;
+  codeSize = emitLoc;
+}
 
 /* Procedure emitComment prints a comment line 
  * with comment c in the code file
  */
 void emitComment( char * c )
-{ if (TraceCode) fprintf(code,"* %s\n",c);}
+{ if (TraceCode)
+  { if (commentCount == commentCapacity)
+    { commentCapacity = commentCapacity == 0 ? 64 : 2*commentCapacity;
+      comments = realloc(comments,commentCapacity*sizeof(CommentLine));
+    }
+    comments[commentCount].loc = emitLoc;
+    comments[commentCount++].text = saveText(c);
+  }
+}
 
 /* Procedure emitRO emits a register-only
  * TM instruction
@@ -32,10 +97,7 @@ void emitComment( char * c )
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRO( char *op, int r, int s, int t, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emit(op,FALSE,r,s,t,0,-1,c);
 } /* emitRO */
 
 /* Procedure emitRM emits a register-to-memory
@@ -47,37 +109,57 @@ void emitRO( char *op, int r, int s, int t, char *c)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM( char * op, int r, int d, int s, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
+{ emit(op,TRUE,r,s,0,d,s == pc ? emitLoc+1+d : -1,c);
 } /* emitRM */
 
-/* Function emitSkip skips "howMany" code
- * locations for later backpatch. It also
- * returns the current code position
+/* Function newLabel returns a label for a code
+ * location not known yet
  */
-int emitSkip( int howMany)
-{  int i = emitLoc;
-   emitLoc += howMany ;
-   if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
-   return i;
-} /* emitSkip */
-
-/* Procedure emitBackup backs up to 
- * loc = a previously skipped location
+int newLabel(void)
+{ if (labelCount == labelCapacity)
+  { labelCapacity = labelCapacity == 0 ? 64 : 2*labelCapacity;
+    labelLoc = realloc(labelLoc,labelCapacity*sizeof(int));
+  }
+  labelLoc[labelCount] = -1;
+  return labelCount++;
+} /* newLabel */
+
+/* Procedure placeLabel puts label at the next
+ * instruction emitted
  */
-void emitBackup( int loc)
-{ if (loc > highEmitLoc) emitComment("BUG in emitBackup");
-  emitLoc = loc ;
-} /* emitBackup */
-
-/* Procedure emitRestore restores the current 
- * code position to the highest previously
- * unemitted position
+void placeLabel( int label)
+{ labelLoc[label] = emitLoc;
+} /* placeLabel */
+
+/* Procedure emitRM_Label emits a register-to-memory
+ * TM instruction that refers to a label
+ * op = the opcode
+ * r = target register
+ * label = the label referred to
+ * c = a comment to be printed if TraceCode is TRUE
+ */
+void emitRM_Label( char *op, int r, int label, char * c)
+{ if (relocationCount == relocationCapacity)
+  { relocationCapacity = relocationCapacity == 0 ? 64 : 2*relocationCapacity;
+    relocations = realloc(relocations,relocationCapacity*sizeof(Relocation));
+  }
+  relocations[relocationCount].loc = emitLoc;
+  relocations[relocationCount++].label = label;
+  emit(op,TRUE,r,pc,0,0,-1,c);
+} /* emitRM_Label */
+
+/* Procedure resolveLabels gives every reference
+ * in the relocation list the location of its label
  */
-void emitRestore(void)
-{ emitLoc = highEmitLoc;}
+void resolveLabels(void)
+{ int i;
+  for (i = 0; i < relocationCount; i++)
+  { int loc = labelLoc[relocations[i].label];
+    if (loc < 0) emitComment("BUG in resolveLabels");
+    codeBuffer[relocations[i].loc].target = loc;
+  }
+  relocationCount = 0;
+} /* resolveLabels */
 
 /* Procedure emitRM_Abs converts an absolute reference 
  * to a pc-relative reference when emitting a
@@ -88,10 +170,79 @@ void emitRestore(void)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM_Abs( char *op, int r, int a, char * c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",
-               emitLoc,op,r,a-(emitLoc+1),pc);
-  ++emitLoc ;
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emit(op,TRUE,r,pc,0,a-(emitLoc+1),a,c);
 } /* emitRM_Abs */
+
+/* Procedure removeInstructions drops the instructions
+ * whose op was set to NULL, closing the gaps
+ */
+void removeInstructions(void)
+{ int * newLoc = malloc((codeSize+1)*sizeof(int));
+  int i, n = 0;
+  for (i = 0; i < codeSize; i++)
+  { newLoc[i] = n;
+    if (codeBuffer[i].op != NULL) n++;
+  }
+  newLoc[codeSize] = n;
+  /* a reference to a removed location goes to the
+   * next one kept
+   */
+  for (i = codeSize-1; i >= 0; i--)
+    if (codeBuffer[i].op == NULL) newLoc[i] = newLoc[i+1];
+  n = 0;
+  for (i = 0; i < codeSize; i++)
+    if (codeBuffer[i].op != NULL)
+    { Instruction in = codeBuffer[i];
+      if (in.target >= 0 && in.target <= codeSize)
+        in.target = newLoc[in.target];
+      codeBuffer[n++] = in;
+    }
+    else free(codeBuffer[i].comment);
+  for (i = 0; i < commentCount; i++)
+    if (comments[i].loc <= codeSize)
+      comments[i].loc = newLoc[comments[i].loc];
+  free(newLoc);
+  codeSize = emitLoc = n;
+} /* removeInstructions */
+
+/* Procedure writeCode writes the code emitted so far
+ * to the code file in location order
+ */
+void writeCode(void)
+{ int i, c = 0;
+  for (i = 0; i <= codeSize; i++)
+  { while (c < commentCount && comments[c].loc <= i)
+      fprintf(code,"* %s\n",comments[c++].text);
+    if (i < codeSize && codeBuffer[i].op != NULL)
+    { Instruction * in = &codeBuffer[i];
+      if (!in->isRM)
+        fprintf(code,"%3d:  %5s  %d,%d,%d ",i,in->op,in->r,in->s,in->t);
+      else
+      { if (in->target >= 0) in->d = in->target-(i+1);
+        fprintf(code,"%3d:  %5s  %d,%d(%d) ",i,in->op,in->r,in->d,in->s);
+      }
+      if (TraceCode && in->comment != NULL) fprintf(code,"\t%s",in->comment) ;
+      fprintf(code,"\n") ;
+    }
+  }
+  while (c < commentCount) fprintf(code,"* %s\n",comments[c++].text);
+  discardCode();
+} /* writeCode */
+
+/* Procedure discardCode empties the code buffer */
+void discardCode(void)
+{ int i;
+  for (i = 0; i < codeSize; i++) free(codeBuffer[i].comment);
+  for (i = 0; i < commentCount; i++) free(comments[i].text);
+  free(codeBuffer);
+  free(comments);
+  free(labelLoc);
+  free(relocations);
+  codeBuffer = NULL;
+  comments = NULL;
+  labelLoc = NULL;
+  relocations = NULL;
+  codeSize = codeCapacity = commentCount = commentCapacity = 0;
+  labelCount = labelCapacity = relocationCount = relocationCapacity = 0;
+  emitLoc = 0;
+} /* discardCode */
@@ -12,8 +12,9 @@
 /* pc = program counter  */
 #define  pc 7
 
-/* mp = "memory pointer" points
- * to top of memory (for temp storage)
+/* mp = "memory pointer" points to the
+ * activation record of the running
+ * function (locals and temp storage)
  */
 #define  mp 6
 
@@ -29,6 +30,28 @@
 /* 2nd accumulator */
 #define  ac1 1
 
+/* The instructions are kept in memory, in location
+ * order, until writeCode puts them in the code file,
+ * so that a pass such as peephole can still change
+ * them. An instruction that addresses relative to pc
+ * (its s is pc) keeps the location it refers to in
+ * target; the displacement is worked out when the
+ * code is written
+ */
+typedef struct
+{ char * op;      /* opcode, NULL once removed */
+  int isRM;       /* register-to-memory form */
+  int r, s, t;    /* registers (t of RO only) */
+  int d;          /* displacement of RM */
+  int target;     /* location referred to, or -1 */
+  char * comment;
+} Instruction;
+
+extern Instruction * codeBuffer;
+
+/* codeSize = the number of locations emitted */
+extern int codeSize;
+
 /* code emitting utilities */
 
 /* Procedure emitComment prints a comment line 
@@ -56,22 +79,29 @@ void emitRO( char *op, int r, int s, int t, char *c);
  */
 void emitRM( char * op, int r, int d, int s, char *c);
 
-/* Function emitSkip skips "howMany" code
- * locations for later backpatch. It also
- * returns the current code position
+/* Function newLabel returns a label for a code
+ * location not known yet; placeLabel puts it at
+ * the next instruction emitted
  */
-int emitSkip( int howMany);
+int newLabel(void);
+void placeLabel( int label);
 
-/* Procedure emitBackup backs up to 
- * loc = a previously skipped location
+/* Procedure emitRM_Label emits a register-to-memory
+ * TM instruction that refers to a label, such as
+ * a jump; the reference is kept in a relocation
+ * list until resolveLabels
+ * op = the opcode
+ * r = target register
+ * label = the label referred to
+ * c = a comment to be printed if TraceCode is TRUE
  */
-void emitBackup( int loc);
+void emitRM_Label( char *op, int r, int label, char * c);
 
-/* Procedure emitRestore restores the current 
- * code position to the highest previously
- * unemitted position
+/* Procedure resolveLabels gives every reference
+ * in the relocation list the location of its
+ * label; all of them must be placed by then
  */
-void emitRestore(void);
+void resolveLabels(void);
 
 /* Procedure emitRM_Abs converts an absolute reference 
  * to a pc-relative reference when emitting a
@@ -83,4 +113,22 @@ void emitRestore(void);
  */
 void emitRM_Abs( char *op, int r, int a, char * c);
 
+/* Procedure removeInstructions drops the instructions
+ * whose op was set to NULL, closing the gaps: a target
+ * or comment at a removed location moves to the next
+ * one kept
+ */
+void removeInstructions(void);
+
+/* Procedure writeCode writes the code emitted so far
+ * to the code file in location order and empties the
+ * buffer for the next unit
+ */
+void writeCode(void);
+
+/* Procedure discardCode empties the buffer without
+ * writing it, for a unit with errors
+ */
+void discardCode(void);
+
 #endif
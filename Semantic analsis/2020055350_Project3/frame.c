@@ -0,0 +1,155 @@
+/****************************************************/
+/* File: frame.c                                    */
+/* Frame layout of C-Minus functions                */
+/****************************************************/
+
+#include "globals.h"
+#include "frame.h"
+
+static int variableSize(TreeNode *t)
+{
+	if (t->kind == VarDecl && (t->type == IntegerArray || t->type == VoidArray) && t->child[0] != NULL)
+		return t->child[0]->val > 0 ? t->child[0]->val : 1;
+	return 1;
+}
+
+/* placeVariables numbers the declarations t from offset in
+ * scope and returns the offset after them
+ */
+static int placeVariables(TreeNode *t, ScopeEntryRec *scope, int offset)
+{
+	for (; t != NULL; t = t->sibling)
+	{
+		SymbolEntryRec *symbol;
+		if (t->name == NULL || (t->kind == Params && t->type == Void)) continue;
+		symbol = SearchSymbolInScope(scope, t->name);
+		if (symbol == NULL) continue;
+		symbol->offset = offset;
+		offset += variableSize(t);
+	}
+	return offset;
+}
+
+/* layoutStatements places the locals of the blocks in t,
+ * each block starting at offset, and returns the highest
+ * offset in use
+ */
+static int layoutStatements(TreeNode *t, ScopeEntryRec *scope, int offset)
+{
+	int extent = offset;
+	for (; t != NULL; t = t->sibling)
+	{
+		int i, end;
+		if (t->kind == CompStmt)
+		{
+			ScopeEntryRec *blockScope = t->scope != NULL ? t->scope : scope;
+			int next = placeVariables(t->child[0], blockScope, offset);
+			end = layoutStatements(t->child[1], blockScope, next);
+		}
+		else
+		{
+			end = offset;
+			for (i = 0; i < MAXCHILDREN; i++)
+			{
+				int childEnd = layoutStatements(t->child[i], scope, offset);
+				if (childEnd > end) end = childEnd;
+			}
+		}
+		if (end > extent) extent = end;
+	}
+	return extent;
+}
+
+/* imported = declared in rootScope by an interface file,
+ * whose declarations have no line
+ */
+static int imported(SymbolEntryRec *symbol)
+{
+	return symbol->kind == VariableSym && symbol->node != NULL && symbol->node->lineno == 0;
+}
+
+void layoutFrames(TreeNode *syntaxTree, ScopeEntryRec *rootScope)
+{
+	TreeNode *t;
+	SymbolEntryRec *symbol;
+	int globals = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+	{
+		if (t->kind == VarDecl)
+		{
+			symbol = SearchSymbolByKind(rootScope, t->name, VariableSym);
+			if (symbol == NULL) continue;
+			symbol->offset = globals;
+			globals += variableSize(t);
+		}
+		else if (t->kind == FuncDecl && t->scope != NULL)
+		{
+			int params = placeVariables(t->child[0], t->scope, 0);
+			t->scope->frameSize = layoutStatements(t->child[1], t->scope, params);
+		}
+	}
+	/* imported variables follow this unit's own */
+	for (symbol = rootScope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+		if (imported(symbol))
+		{
+			symbol->offset = globals;
+			globals += variableSize(symbol->node);
+		}
+	rootScope->frameSize = globals;
+}
+
+static void printVariables(FILE *out, TreeNode *t, ScopeEntryRec *scope, int *unshared)
+{
+	for (; t != NULL; t = t->sibling)
+	{
+		SymbolEntryRec *symbol;
+		if (t->name == NULL || (t->kind == Params && t->type == Void)) continue;
+		symbol = SearchSymbolInScope(scope, t->name);
+		if (symbol == NULL) continue;
+		fprintf(out, "  %-13s  %-12s  %6d  %4d\n", t->name, scope->name, symbol->offset, variableSize(t));
+		*unshared += variableSize(t);
+	}
+}
+
+static void printBlocks(FILE *out, TreeNode *t, ScopeEntryRec *scope, int *unshared)
+{
+	int i;
+	for (; t != NULL; t = t->sibling)
+		if (t->kind == CompStmt)
+		{
+			ScopeEntryRec *blockScope = t->scope != NULL ? t->scope : scope;
+			printVariables(out, t->child[0], blockScope, unshared);
+			printBlocks(out, t->child[1], blockScope, unshared);
+		}
+		else
+			for (i = 0; i < MAXCHILDREN; i++) printBlocks(out, t->child[i], scope, unshared);
+}
+
+void printFrames(FILE *out, TreeNode *syntaxTree, ScopeEntryRec *rootScope)
+{
+	TreeNode *t;
+	SymbolEntryRec *symbol;
+	fprintf(out, "\n\n< Frame Layout >\n");
+	fprintf(out, "  Symbol Name    Scope Name    Offset  Size\n");
+	fprintf(out, "  -------------  ------------  ------  ----\n");
+	fprintf(out, "global data: %d words\n", rootScope->frameSize);
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind == VarDecl)
+		{
+			symbol = SearchSymbolByKind(rootScope, t->name, VariableSym);
+			if (symbol != NULL) fprintf(out, "  %-13s  %-12s  %6d  %4d\n", t->name, rootScope->name, symbol->offset, variableSize(t));
+		}
+	for (symbol = rootScope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+		if (imported(symbol))
+			fprintf(out, "  %-13s  %-12s  %6d  %4d\n", symbol->name, "(imported)", symbol->offset, variableSize(symbol->node));
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind == FuncDecl && t->scope != NULL)
+		{
+			int unshared = 0;
+			fprintf(out, "function %s: %d words\n", t->name, t->scope->frameSize);
+			printVariables(out, t->child[0], t->scope, &unshared);
+			printBlocks(out, t->child[1], t->scope, &unshared);
+			if (unshared > t->scope->frameSize)
+				fprintf(out, "  (%d words without slot sharing)\n", unshared);
+		}
+}
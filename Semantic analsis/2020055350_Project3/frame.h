@@ -0,0 +1,28 @@
+/****************************************************/
+/* File: frame.h                                    */
+/* Frame layout of C-Minus functions                */
+/****************************************************/
+
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include "symtab.h"
+
+/* Procedure layoutFrames gives every variable a word
+ * offset. Globals are numbered in the data area of
+ * rootScope, the ones imported from interface files
+ * after the unit's own (for the listing only, as such a
+ * unit gets no code); parameters and locals of a
+ * function are numbered in its frame, parameters first. An int[N]
+ * takes N words (an array parameter one, its address).
+ * A compound statement's locals follow those of the
+ * enclosing blocks, so sibling blocks share the same
+ * words. The size of each area is the frameSize of the
+ * function's scope (of rootScope for the globals)
+ */
+void layoutFrames(TreeNode *syntaxTree, ScopeEntryRec *rootScope);
+
+/* Procedure printFrames lists the layout (--frames) */
+void printFrames(FILE *out, TreeNode *syntaxTree, ScopeEntryRec *rootScope);
+
+#endif
@@ -0,0 +1,465 @@
+/****************************************************/
+/* File: fuzz_analyze.c                             */
+/* Worst-case performance fuzzer for the analyzer   */
+/****************************************************/
+
+/* Every input is run through parse, buildSymtab and
+ * typeCheck, and simplifyTree if it has no errors.
+ * Built with clang -fsanitize=fuzzer -DUSE_LIBFUZZER
+ * the file is a libFuzzer target; built with any
+ * compiler it has its own driver:
+ *
+ *   fuzz_analyze [-runs N] [-max-len B] [-keep K]
+ *                [-save DIR] [-seed S] seed.cm ...
+ *     mutates the seeds for N runs looking for inputs
+ *     that cost the most per byte and saves the K
+ *     slowest in DIR as slow_1.cm ... slow_K.cm
+ *
+ *   fuzz_analyze -budget R -baseline base.cm file.cm ...
+ *     fails if any file costs more than R times as
+ *     much per byte as base.cm (the perf test)
+ *
+ * The cost of an input is the number of instructions
+ * it takes where the kernel counts them for us, the CPU
+ * time in nanoseconds otherwise. The fixed cost of the
+ * smallest program is subtracted before dividing by
+ * the size of the input
+ */
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+#include "analyze.h"
+#include "simplify.h"
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+/* analyzeInput compiles one unit held in memory; the
+ * listing goes to the null device
+ */
+static void analyzeInput(const uint8_t *data, size_t size)
+{
+	static FILE *sink = NULL;
+	TreeNode *syntaxTree;
+
+	if (sink == NULL) sink = fopen("/dev/null", "w");
+	listing = sink;
+	source = size > 0 ? fmemopen((void *)data, size, "r") : fmemopen("\n", 1, "r");
+	if (source == NULL) return;
+	lineno = 0;
+	Error = FALSE;
+	resetScanner();
+	syntaxTree = parse();
+	if (!Error)
+	{
+		buildSymtab(syntaxTree);
+		typeCheck(syntaxTree);
+		if (!Error) simplifyTree(syntaxTree);
+	}
+	fclose(source);
+	freeUnit();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	analyzeInput(data, size);
+	return 0;
+}
+
+#ifndef USE_LIBFUZZER
+
+/* an input that crashes the analyzer is written to
+ * crashPath before the driver dies
+ */
+static const uint8_t *currentData;
+static size_t currentSize;
+static char crashPath[4096] = "crash.cm";
+
+static void saveCrash(int signo)
+{
+	int fd = open(crashPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0)
+	{
+		if (write(fd, currentData, currentSize) < 0) fd = -1;
+		close(fd);
+	}
+	if (write(2, "fuzz_analyze: crash input saved\n", 32) < 0) fd = -1;
+	_exit(128 + signo);
+}
+
+static void runInput(const uint8_t *data, size_t size)
+{
+	currentData = data;
+	currentSize = size;
+	analyzeInput(data, size);
+}
+
+/* cost counter: instructions if available, else CPU ns */
+static int instructionCounter = -1;
+
+static void openCounter(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	instructionCounter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static double cpuNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/* measure returns the cheapest of runs analyses of the
+ * input, in instructions or CPU nanoseconds
+ */
+static double measure(const uint8_t *data, size_t size, int runs)
+{
+	double best = -1;
+	while (runs-- > 0)
+	{
+		double cost;
+#ifdef __linux__
+		if (instructionCounter >= 0)
+		{
+			long long count = 0;
+			ioctl(instructionCounter, PERF_EVENT_IOC_RESET, 0);
+			ioctl(instructionCounter, PERF_EVENT_IOC_ENABLE, 0);
+			runInput(data, size);
+			ioctl(instructionCounter, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(instructionCounter, &count, sizeof(count)) != sizeof(count)) count = 0;
+			cost = count;
+		}
+		else
+#endif
+		{
+			double start = cpuNanoseconds();
+			runInput(data, size);
+			cost = cpuNanoseconds() - start;
+		}
+		if (best < 0 || cost < best) best = cost;
+	}
+	return best;
+}
+
+typedef struct Input
+{
+	uint8_t *data;
+	size_t size;
+	double cost;
+	double score;
+} Input;
+
+static Input readInput(const char *path)
+{
+	Input input = {NULL, 0, 0, 0};
+	FILE *in = fopen(path, "rb");
+	long length;
+	if (in == NULL)
+	{
+		fprintf(stderr, "File %s not found\n", path);
+		exit(1);
+	}
+	fseek(in, 0, SEEK_END);
+	length = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	input.data = (uint8_t *)malloc(length > 0 ? length : 1);
+	input.size = fread(input.data, 1, length, in);
+	fclose(in);
+	return input;
+}
+
+/* An input's score is its cost per byte above the fixed
+ * cost of the smallest program; tiny inputs count as
+ * MIN_SCORED_SIZE bytes
+ */
+#define MIN_SCORED_SIZE 64
+#define SMALLEST_PROGRAM "void main(void) { }\n"
+
+/* runBudget is the perf test: no file may score more
+ * than budget times the baseline program does. Measured
+ * on the same machine, the ratio does not depend on its
+ * speed; what it catches is analysis that grows faster
+ * than the input
+ */
+static int runBudget(double budget, const char *baseline, char **files, int count)
+{
+	Input base = readInput(baseline);
+	double fixedCost, baseScore;
+	int i, failed = 0;
+
+	openCounter();
+	fixedCost = measure((const uint8_t *)SMALLEST_PROGRAM, strlen(SMALLEST_PROGRAM), 5);
+	base.cost = measure(base.data, base.size, 10);
+	baseScore = (base.cost - fixedCost) / base.size;
+	printf("baseline %.0f %s per byte  %s (%lu bytes)\n", baseScore, instructionCounter >= 0 ? "instructions" : "ns", baseline, (unsigned long)base.size);
+	for (i = 0; i < count; ++i)
+	{
+		Input input = readInput(files[i]);
+		double ratio;
+		input.cost = measure(input.data, input.size, 3);
+		ratio = (input.cost - fixedCost) / (input.size > MIN_SCORED_SIZE ? input.size : MIN_SCORED_SIZE) / baseScore;
+		printf("%-4s %6.2fx  %s (%lu bytes)\n", ratio > budget ? "SLOW" : "ok", ratio, files[i], (unsigned long)input.size);
+		if (ratio > budget) ++failed;
+		free(input.data);
+	}
+	free(base.data);
+	if (failed > 0) printf("%d of %d inputs over %.1f times the cost of the baseline\n", failed, count, budget);
+	return failed > 0;
+}
+
+/* Mutations work on lines and tokens rather than bytes
+ * so that most inputs still parse and reach the
+ * analyzer. Repeating a run of lines is what grows an
+ * input until super-linear paths show
+ */
+static const char *fragments[] = {
+	"int x;\n", "int a[10];\n", "void f(void) { }\n", "int g(int p, int q[]) { return p; }\n",
+	"{ int x; x = x + 1; }\n", "x = g(x, a);\n", "while (x < 10) { x = x + 1; }\n",
+	"if (x) x = 1; else x = 2;\n", "return x;\n", "a[x] = a[x - 1] * 2;\n", "output(input());\n",
+	"{\n", "}\n", ";\n", "x", "(", ")", "[", "]", ",", "=", "<=", "/* */", NULL};
+
+static size_t fragmentCount(void)
+{
+	size_t count = 0;
+	while (fragments[count] != NULL) ++count;
+	return count;
+}
+
+static size_t randomBelow(size_t bound)
+{
+	return bound == 0 ? 0 : (size_t)rand() % bound;
+}
+
+/* lineStart returns the offset of the start of a random
+ * line of data
+ */
+static size_t lineStart(const uint8_t *data, size_t size)
+{
+	size_t at = randomBelow(size);
+	while (at > 0 && data[at - 1] != '\n') --at;
+	return at;
+}
+
+static size_t lineEnd(const uint8_t *data, size_t size, size_t from, size_t lines)
+{
+	while (from < size && lines > 0)
+		if (data[from++] == '\n') --lines;
+	return from;
+}
+
+/* mutate builds a mutated copy of input (another corpus
+ * entry is used for splicing) of at most maxLength bytes
+ */
+static Input mutate(const Input *input, const Input *other, size_t maxLength)
+{
+	Input result;
+	size_t capacity = 2 * maxLength + 256, size = 0;
+	uint8_t *out = (uint8_t *)malloc(capacity);
+	const uint8_t *data = input->data;
+	size_t length = input->size;
+	size_t from, to;
+
+	switch (rand() % 6)
+	{
+		case 0: /* repeat a run of lines */
+			from = lineStart(data, length);
+			to = lineEnd(data, length, from, 1 + randomBelow(16));
+			memcpy(out, data, to);
+			size = to;
+			while (size + (to - from) <= maxLength && rand() % 4 != 0)
+			{
+				memcpy(out + size, data + from, to - from);
+				size += to - from;
+			}
+			if (size + (length - to) > maxLength) length = to + (maxLength - size);
+			memcpy(out + size, data + to, length - to);
+			size += length - to;
+			break;
+		case 1: /* insert a fragment */
+		{
+			const char *fragment = fragments[randomBelow(fragmentCount())];
+			from = lineStart(data, length);
+			memcpy(out, data, from);
+			size = from;
+			memcpy(out + size, fragment, strlen(fragment));
+			size += strlen(fragment);
+			memcpy(out + size, data + from, length - from);
+			size += length - from;
+			break;
+		}
+		case 2: /* delete a run of lines */
+			from = lineStart(data, length);
+			to = lineEnd(data, length, from, 1 + randomBelow(4));
+			memcpy(out, data, from);
+			memcpy(out + from, data + to, length - to);
+			size = from + (length - to);
+			break;
+		case 3: /* rename an identifier after another one */
+		{
+			size_t a = randomBelow(length), b = randomBelow(length), aEnd, bEnd;
+			while (a < length && !isalpha(data[a])) ++a;
+			while (b < length && !isalpha(data[b])) ++b;
+			while (a > 0 && isalpha(data[a - 1])) --a;
+			while (b > 0 && isalpha(data[b - 1])) --b;
+			for (aEnd = a; aEnd < length && isalpha(data[aEnd]); ++aEnd);
+			for (bEnd = b; bEnd < length && isalpha(data[bEnd]); ++bEnd);
+			memcpy(out, data, a);
+			memcpy(out + a, data + b, bEnd - b);
+			memcpy(out + a + (bEnd - b), data + aEnd, length - aEnd);
+			size = a + (bEnd - b) + (length - aEnd);
+			break;
+		}
+		case 4: /* splice the head of input with the tail of other */
+			from = lineStart(data, length);
+			to = lineStart(other->data, other->size);
+			memcpy(out, data, from);
+			memcpy(out + from, other->data + to, other->size - to);
+			size = from + (other->size - to);
+			break;
+		default: /* change one byte */
+			memcpy(out, data, length);
+			size = length;
+			if (size > 0) out[randomBelow(size)] = " x1;{}()[]=+<\n"[randomBelow(14)];
+			break;
+	}
+	if (size > maxLength) size = maxLength;
+	result.data = out;
+	result.size = size;
+	result.cost = result.score = 0;
+	return result;
+}
+
+static int compareScores(const void *a, const void *b)
+{
+	double x = ((const Input *)a)->score, y = ((const Input *)b)->score;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+#define CORPUS_SIZE 64
+
+int main(int argc, char *argv[])
+{
+	Input corpus[CORPUS_SIZE];
+	int count = 0, argi, i;
+	long runs = 20000, run;
+	size_t maxLength = 65536;
+	int keep = 5;
+	char *saveDir = NULL;
+	double budget = -1, fixedCost;
+	char *baseline = NULL;
+	const char *unit;
+	unsigned seed = 1;
+
+	for (argi = 1; argi < argc && argv[argi][0] == '-'; argi += 2)
+	{
+		if (argi + 1 >= argc) break;
+		if (strcmp(argv[argi], "-runs") == 0) runs = atol(argv[argi + 1]);
+		else if (strcmp(argv[argi], "-max-len") == 0) maxLength = atol(argv[argi + 1]);
+		else if (strcmp(argv[argi], "-keep") == 0) keep = atoi(argv[argi + 1]);
+		else if (strcmp(argv[argi], "-save") == 0) saveDir = argv[argi + 1];
+		else if (strcmp(argv[argi], "-seed") == 0) seed = atoi(argv[argi + 1]);
+		else if (strcmp(argv[argi], "-budget") == 0) budget = atof(argv[argi + 1]);
+		else if (strcmp(argv[argi], "-baseline") == 0) baseline = argv[argi + 1];
+		else
+			break;
+	}
+	if (argi >= argc || (argv[argi][0] == '-' && argv[argi][1] != '\0') || (budget >= 0 && baseline == NULL))
+	{
+		fprintf(stderr, "usage: %s [-runs N] [-max-len B] [-keep K] [-save DIR] [-seed S] seed.cm ...\n"
+		                "       %s -budget R -baseline base.cm file.cm ...\n", argv[0], argv[0]);
+		return 1;
+	}
+	if (saveDir != NULL) snprintf(crashPath, sizeof(crashPath), "%s/crash.cm", saveDir);
+	signal(SIGSEGV, saveCrash);
+	signal(SIGABRT, saveCrash);
+	signal(SIGFPE, saveCrash);
+	if (budget >= 0) return runBudget(budget, baseline, argv + argi, argc - argi);
+
+	srand(seed);
+	openCounter();
+	unit = instructionCounter >= 0 ? "instructions" : "ns";
+	fixedCost = measure((const uint8_t *)SMALLEST_PROGRAM, strlen(SMALLEST_PROGRAM), 5);
+
+	for (; argi < argc && count < CORPUS_SIZE; ++argi)
+	{
+		Input input = readInput(argv[argi]);
+		if (input.size > maxLength) input.size = maxLength;
+		input.cost = measure(input.data, input.size, 3);
+		input.score = (input.cost - fixedCost) / (input.size > MIN_SCORED_SIZE ? input.size : MIN_SCORED_SIZE);
+		corpus[count++] = input;
+	}
+	qsort(corpus, count, sizeof(Input), compareScores);
+
+	/* pick parents from the better half; a mutant that
+	 * beats the worst entry replaces it
+	 */
+	for (run = 0; run < runs; ++run)
+	{
+		const Input *parent = &corpus[randomBelow((count + 1) / 2)];
+		Input mutant = mutate(parent, &corpus[randomBelow(count)], maxLength);
+		mutant.cost = measure(mutant.data, mutant.size, 1);
+		mutant.score = (mutant.cost - fixedCost) / (mutant.size > MIN_SCORED_SIZE ? mutant.size : MIN_SCORED_SIZE);
+		if (count < CORPUS_SIZE || mutant.score > corpus[count - 1].score)
+		{
+			/* confirm a candidate before it enters the corpus */
+			mutant.cost = measure(mutant.data, mutant.size, 3);
+			mutant.score = (mutant.cost - fixedCost) / (mutant.size > MIN_SCORED_SIZE ? mutant.size : MIN_SCORED_SIZE);
+		}
+		if (count < CORPUS_SIZE) corpus[count++] = mutant;
+		else if (mutant.score > corpus[count - 1].score)
+		{
+			free(corpus[count - 1].data);
+			corpus[count - 1] = mutant;
+		}
+		else
+		{
+			free(mutant.data);
+			continue;
+		}
+		qsort(corpus, count, sizeof(Input), compareScores);
+	}
+
+	printf("fixed cost per unit: %.0f %s\n", fixedCost, unit);
+	for (i = 0; i < keep && i < count; ++i)
+	{
+		printf("slow_%d: %8lu bytes  %12.0f %s  %8.1f %s/byte\n", i + 1, (unsigned long)corpus[i].size,
+			corpus[i].cost, unit, corpus[i].score, unit);
+		if (saveDir != NULL)
+		{
+			char path[4096];
+			FILE *out;
+			snprintf(path, sizeof(path), "%s/slow_%d.cm", saveDir, i + 1);
+			out = fopen(path, "wb");
+			if (out == NULL)
+			{
+				fprintf(stderr, "Unable to write %s\n", path);
+				return 1;
+			}
+			fwrite(corpus[i].data, 1, corpus[i].size, out);
+			fclose(out);
+		}
+	}
+	for (i = 0; i < count; ++i) free(corpus[i].data);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Generate the large worst-case inputs of the perf test, in
+# the shape of the slow cases the fuzzer found:
+#
+#   redefinitions N   N redefinitions each of a function g
+#                     and of main, whose bodies call names
+#                     that are not declared. Every
+#                     redefinition lists all the earlier
+#                     definitions, so the output is quadratic
+#   diagnostics N     one function of N statements that use
+#                     undeclared names, so that nearby lines
+#                     report the same diagnostics
+#
+# usage: gen_regress.sh redefinitions|diagnostics [N]
+
+CASE=$1
+N=${2:-}
+
+case "$CASE" in
+redefinitions)
+	awk -v n="${N:-730}" 'BEGIN {
+		print "int x;";
+		print "";
+		for (i = 0; i < n; i++) {
+			print "int g(int p, int q[]) { return p; }";
+			print "void main(void)";
+			print "{";
+			print "  xx(1, 2);";
+			print "   if(x()){}";
+			print "}";
+			print "";
+		}
+	}'
+	;;
+diagnostics)
+	awk -v n="${N:-3000}" 'BEGIN {
+		split("while (x < 10) { x = x + 1; }|\tt + x;|\tt = x;|\tx1x(x+c+w);", body, "|");
+		print "int main (void)";
+		print "{";
+		print "\tvoid w;";
+		for (i = 0; i < n; i++) print body[i % 4 + 1];
+		print "}";
+	}'
+	;;
+*)
+	echo "usage: $0 redefinitions|diagnostics [N]" >&2
+	exit 1
+	;;
+esac
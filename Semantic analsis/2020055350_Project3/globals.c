@@ -0,0 +1,47 @@
+/****************************************************/
+/* File: globals.c                                  */
+/* Global variables and option flags shared by the  */
+/* compiler, the fuzzer and the benchmarks          */
+/****************************************************/
+
+#include "globals.h"
+
+/* allocate global variables */
+int lineno = 0;
+FILE * source;
+FILE * listing;
+FILE * code;
+
+/* allocate and set tracing flags */
+int EchoSource = FALSE;
+int TraceScan = FALSE;
+int TraceParse = FALSE;
+int TraceAnalyze = FALSE;
+int TraceCode = FALSE;
+
+/* allocate and set analysis options */
+int FusedAnalyze = FALSE;
+int CheckJobs = 1;
+int IncrementalAnalyze = FALSE;
+int SymtabFormat = SymtabNone;
+int SymtabStats = FALSE;
+int SymtabHash = Fnv1aHash;
+char *InterfaceOutput = NULL;
+char **ImportFiles = NULL;
+int ImportCount = 0;
+int CallGraphFormat = 0;
+int FrameListing = FALSE;
+int TimeReport = TimeReportNone;
+int MaxErrors = 0;
+
+/* allocate and set code generation options */
+int GenerateCode = TRUE;
+int Simplify = TRUE;
+int Peephole = TRUE;
+int UseIr = TRUE;
+int Sccp = TRUE;
+int Licm = TRUE;
+int Inline = TRUE;
+int DumpIr = FALSE;
+
+int Error = FALSE;
@@ -15,6 +15,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* The compiler allocates from the heap through counting
+ * wrappers (in util.c), so that --time-report can count
+ * every allocation
+ */
+void *countedMalloc(size_t size);
+void *countedCalloc(size_t count, size_t size);
+void *countedRealloc(void *p, size_t size);
+#define malloc(size) countedMalloc(size)
+#define calloc(count, size) countedCalloc(count, size)
+#define realloc(p, size) countedRealloc(p, size)
+
 /* Yacc/Bison generates internally its own values
  * for the tokens. Other files can access these values
  * by including the tab.h file generated using the
@@ -106,6 +117,7 @@ typedef struct treeNode
 
 	struct treeNode *child[MAXCHILDREN];
 	struct treeNode *sibling;
+	struct treeNode *lastSibling;
 	int lineno;
 	NodeKind kind;
 	NodeType type;
@@ -149,6 +161,138 @@ extern int TraceAnalyze;
  */
 extern int TraceCode;
 
+/**************************************************/
+/***********   Analysis options        ************/
+/**************************************************/
+
+/* FusedAnalyze = TRUE builds the symbol table and
+ * checks types in a single traversal of the tree
+ */
+extern int FusedAnalyze;
+
+/* CheckJobs = the number of threads that type-check
+ * function bodies once the symbol table is built
+ * (1 checks serially)
+ */
+extern int CheckJobs;
+
+/* IncrementalAnalyze = TRUE keeps the analysis of each
+ * function so that the next buildSymtab only rebuilds
+ * functions that changed (set by --watch)
+ */
+extern int IncrementalAnalyze;
+
+/* SymtabFormat selects how the symbol table is printed
+ * after it is built (SymtabNone prints it as text only
+ * if TraceAnalyze is set)
+ */
+typedef enum
+{
+	SymtabNone,
+	SymtabText,
+	SymtabJson,
+	SymtabCsv
+} SymtabFormatKind;
+
+extern int SymtabFormat;
+
+/* SymtabStats = TRUE counts symbol table operations and
+ * prints them with the bucket occupancy after analysis
+ */
+extern int SymtabStats;
+
+/* SymtabHash selects the hash function for names */
+typedef enum
+{
+	ShiftHash,
+	Fnv1aHash,
+	WordHash
+} HashKind;
+
+extern int SymtabHash;
+
+/* InterfaceOutput = the file the interface of the unit
+ * is written to (NULL for none); ImportFiles lists the
+ * ImportCount interface files whose declarations are
+ * put in the global scope before analysis. Units are
+ * only checked separately: there is no linker, so a
+ * unit that imports cannot be compiled to code
+ */
+extern char *InterfaceOutput;
+extern char **ImportFiles;
+extern int ImportCount;
+
+/* CallGraphFormat selects how the call graph is printed
+ * after analysis (a CallGraphFormatKind of callgraph.h;
+ * 0 prints nothing)
+ */
+extern int CallGraphFormat;
+
+/* TimeReport selects how the time and memory used by
+ * each phase is reported on stderr (TimeReportNone for
+ * no report)
+ */
+typedef enum
+{
+	TimeReportNone,
+	TimeReportText,
+	TimeReportJson
+} TimeReportKind;
+
+extern int TimeReport;
+
+/* FrameListing = TRUE prints the frame layout of every
+ * function after analysis
+ */
+extern int FrameListing;
+
+/* MaxErrors = the number of distinct diagnostics after
+ * which analysis stops (0 means no limit)
+ */
+extern int MaxErrors;
+
+/**************************************************/
+/***********   Code generation options ************/
+/**************************************************/
+
+/* GenerateCode = FALSE stops after analysis, so that
+ * no code file is written
+ */
+extern int GenerateCode;
+
+/* Simplify = TRUE folds constants and applies algebraic
+ * identities to the syntax tree before code is generated
+ */
+extern int Simplify;
+
+/* Peephole = TRUE rewrites the TM code emitted before
+ * it is written to the code file
+ */
+extern int Peephole;
+
+/* UseIr = TRUE generates TM code from the intermediate
+ * representation rather than straight from the syntax
+ * tree; DumpIr = TRUE lists the representation
+ */
+extern int UseIr;
+extern int DumpIr;
+
+/* Sccp = TRUE propagates constants through the
+ * intermediate representation in SSA form, which
+ * --dump-ir then lists
+ */
+extern int Sccp;
+
+/* Licm = TRUE moves what does not change in a loop out
+ * of it, in the same SSA form
+ */
+extern int Licm;
+
+/* Inline = TRUE replaces calls to small functions that
+ * call nothing with their bodies, before the SSA form
+ */
+extern int Inline;
+
 /* Error = TRUE prevents further passes if an error occurs */
 extern int Error;
 #endif
@@ -0,0 +1,303 @@
+/****************************************************/
+/* File: inline.c                                   */
+/* Inlining of small functions into their callers   */
+/****************************************************/
+
+#include "globals.h"
+#include "ir.h"
+#include "callgraph.h"
+#include "inline.h"
+
+/* besides storing its arguments, a call takes six TM
+ * instructions: push the frame, set the return address,
+ * jump, pop the frame, and in the callee, store the
+ * return address and jump back
+ */
+#define CALL_COST 6
+
+/* a body may take GROWTH instructions more than the call
+ * it replaces, or up to ONCE_LIMIT if the call is the
+ * only one, as the function then goes. Inlining makes no
+ * function longer than FUNCTION_LIMIT
+ */
+#define GROWTH 4
+#define ONCE_LIMIT 60
+#define FUNCTION_LIMIT 400
+
+/* per call graph node, by its index: the function with
+ * that name in the program (or NULL), and the calls to it
+ * left in the program
+ */
+typedef struct
+{
+	IrFunction *function;
+	int sites;
+} Callee;
+
+static CallGraphRec *graph = NULL;
+static Callee *callees = NULL;
+
+/* where the frame words of each function inlined into
+ * the current caller start in its frame: the copies of
+ * one function are never active at once, so they share
+ */
+typedef struct
+{
+	IrFunction *callee;
+	int base;
+} Region;
+
+static Region *regions = NULL;
+static int regionCount = 0, regionCapacity = 0;
+
+static Callee *calleeOf(char *name)
+{
+	CallNodeRec *node = findCallNode(graph, name);
+	return node != NULL ? &callees[node->index] : NULL;
+}
+
+/* size counts the instructions of f other than jumps and
+ * returns, which the call has paid for
+ */
+static int size(IrFunction *f)
+{
+	IrInstr *i;
+	int k, n = 0;
+	for (k = 0; k < f->nblocks; k++)
+		for (i = f->blocks[k]->first; i != NULL; i = i->next)
+			if (i->op != IrJump && i->op != IrRet) n++;
+	return n;
+}
+
+static int isLeaf(IrFunction *f)
+{
+	IrInstr *i;
+	int k;
+	for (k = 0; k < f->nblocks; k++)
+		for (i = f->blocks[k]->first; i != NULL; i = i->next)
+			if (i->op == IrCall) return FALSE;
+	return TRUE;
+}
+
+static int returnCount(IrFunction *f)
+{
+	int k, n = 0;
+	for (k = 0; k < f->nblocks; k++)
+		if (f->blocks[k]->last->op == IrRet) n++;
+	return n;
+}
+
+/* Function worthIt applies the cost model to the call i
+ * of caller f
+ */
+static int worthIt(IrFunction *f, IrInstr *i)
+{
+	Callee *c = calleeOf(i->name);
+	CallNodeRec *node = findCallNode(graph, i->name);
+	int cost;
+	if (c == NULL || c->function == NULL || c->function == f || node->recursive) return FALSE;
+	if (c->function->nparams != i->nargs || !isLeaf(c->function)) return FALSE;
+	cost = size(c->function);
+	if (size(f) + cost > FUNCTION_LIMIT) return FALSE;
+	return cost <= i->nargs + CALL_COST + GROWTH || (c->sites == 1 && cost <= ONCE_LIMIT);
+}
+
+/* regionOf returns the first frame word of caller f for
+ * the words of callee x, and one more for its result
+ */
+static int regionOf(IrFunction *f, IrFunction *x)
+{
+	int n;
+	for (n = 0; n < regionCount; n++)
+		if (regions[n].callee == x) return regions[n].base;
+	if (regionCount == regionCapacity)
+	{
+		regionCapacity = regionCapacity == 0 ? 8 : 2 * regionCapacity;
+		regions = realloc(regions, regionCapacity * sizeof(Region));
+	}
+	regions[regionCount].callee = x;
+	regions[regionCount++].base = f->frameSize;
+	f->frameSize += x->frameSize + 1;
+	return f->frameSize - x->frameSize - 1;
+}
+
+static IrOperand mapOperand(IrOperand o, IrOperand *map)
+{
+	return o.kind == IrReg ? map[o.val] : o;
+}
+
+static int isAssigned(IrFunction *f, int v)
+{
+	IrInstr *i;
+	int k;
+	for (k = 0; k < f->nblocks; k++)
+		for (i = f->blocks[k]->first; i != NULL; i = i->next)
+			if (i->dest == v) return TRUE;
+	return FALSE;
+}
+
+static void addCopy(IrBlock *b, IrInstr *before, int dest, IrOperand a)
+{
+	IrInstr *i = newInstr(IrCopy, dest);
+	i->a = a;
+	insertBefore(b, before, i);
+}
+
+static void addEdges(IrBlock *b)
+{
+	addEdge(b, b->succ[0]);
+	if (b->succ[1] != NULL && b->succ[1] != b->succ[0]) addEdge(b, b->succ[1]);
+}
+
+/* Procedure inlineCall replaces call i of block b of f
+ * with the blocks of the callee, laid out after b, and
+ * moves what follows i to a block after them, which
+ * the returns jump to. The callee's variables become
+ * ones of f, in words of its frame, but for parameters
+ * it never sets, which are their arguments, as nothing
+ * in the callee sets a vreg of f. With more than one
+ * return, the result is a variable too, set by each
+ */
+static void inlineCall(IrFunction *f, IrBlock *b, IrInstr *i)
+{
+	Callee *c = calleeOf(i->name);
+	IrFunction *x = c->function;
+	int base = regionOf(f, x);
+	IrOperand *map = malloc(x->nvregs * sizeof(IrOperand));
+	IrBlock **copies = malloc(x->nblocks * sizeof(IrBlock *));
+	IrBlock *rest = newBlock(f), *after = b;
+	IrInstr *j;
+	int k, n, result = i->dest;
+	for (n = 0; n < x->nvregs; n++)
+		map[n] = irReg(newVreg(f, x->vregs[n].name, x->vregs[n].word >= 0 ? base + x->vregs[n].word : -1, -1));
+	if (i->dest >= 0 && returnCount(x) > 1) result = newVreg(f, x->name, base + x->frameSize, -1);
+	for (n = 0; n < i->nargs; n++)
+		if (isAssigned(x, x->params[n])) addCopy(b, i, map[x->params[n]].val, i->args[n]);
+		else
+			map[x->params[n]] = i->args[n];
+	while ((j = i->next) != NULL)
+	{
+		removeInstr(b, j);
+		insertBefore(rest, NULL, j);
+	}
+	if (result != i->dest) addCopy(rest, rest->first, i->dest, irReg(result));
+	for (n = 0; n < 2; n++)
+	{
+		rest->succ[n] = b->succ[n];
+		b->succ[n] = NULL;
+		if (rest->succ[n] != NULL && (n == 0 || rest->succ[1] != rest->succ[0]))
+			for (k = 0; k < rest->succ[n]->npreds; k++)
+				if (rest->succ[n]->preds[k] == b) rest->succ[n]->preds[k] = rest;
+	}
+	for (k = 0; k < x->nblocks; k++)
+	{
+		copies[k] = newBlock(f);
+		placeBlockAfter(f, after, copies[k]);
+		after = copies[k];
+	}
+	placeBlockAfter(f, after, rest);
+	for (k = 0; k < x->nblocks; k++)
+	{
+		IrBlock *from = x->blocks[k], *to = copies[k];
+		for (j = from->first; j != NULL; j = j->next)
+		{
+			IrInstr *copy;
+			if (j->op == IrRet)
+			{
+				if (result >= 0) addCopy(to, NULL, result, j->a.kind != IrNone ? mapOperand(j->a, map) : irImm(0));
+				insertBefore(to, NULL, newInstr(IrJump, -1));
+				to->succ[0] = rest;
+				break;
+			}
+			copy = newInstr(j->op, j->dest >= 0 ? map[j->dest].val : -1);
+			copy->a = mapOperand(j->a, map);
+			copy->b = mapOperand(j->b, map);
+			copy->c = mapOperand(j->c, map);
+			copy->relop = j->relop;
+			copy->space = j->space;
+			copy->disp = j->disp + (j->space == IrFrame ? base : 0);
+			copy->name = j->name;
+			if (j->nargs > 0)
+			{
+				copy->args = malloc(j->nargs * sizeof(IrOperand));
+				for (n = 0; n < j->nargs; n++) copy->args[n] = mapOperand(j->args[n], map);
+				copy->nargs = j->nargs;
+			}
+			insertBefore(to, NULL, copy);
+		}
+		for (n = 0; n < 2; n++)
+			if (from->succ[n] != NULL) to->succ[n] = copies[from->succ[n]->id];
+		addEdges(to);
+	}
+	removeInstr(b, i);
+	freeInstr(i);
+	insertBefore(b, NULL, newInstr(IrJump, -1));
+	b->succ[0] = copies[0];
+	addEdges(b);
+	c->sites--;
+	free(map);
+	free(copies);
+}
+
+static void inlineInto(IrFunction *f)
+{
+	IrInstr *i;
+	int k;
+	regionCount = 0;
+	for (k = 0; k < f->nblocks; k++)
+		for (i = f->blocks[k]->first; i != NULL; i = i->next)
+			if (i->op == IrCall && worthIt(f, i))
+			{
+				/* the rest of the block is now after the copy */
+				inlineCall(f, f->blocks[k], i);
+				break;
+			}
+	removeUnreachable(f);
+	mergeBlocks(f);
+}
+
+void inlineCalls(IrProgram *program, CallGraphRec *callGraph)
+{
+	IrFunction *f, **order, **p;
+	IrInstr *i;
+	int n = 0, k, m;
+	graph = callGraph;
+	callees = calloc(graph->nodeCount, sizeof(Callee));
+	for (f = program->functions; f != NULL; f = f->next)
+	{
+		calleeOf(f->name)->function = f;
+		n++;
+	}
+	for (f = program->functions; f != NULL; f = f->next)
+		for (k = 0; k < f->nblocks; k++)
+			for (i = f->blocks[k]->first; i != NULL; i = i->next)
+				if (i->op == IrCall && calleeOf(i->name) != NULL) calleeOf(i->name)->sites++;
+	/* components are numbered callees first */
+	order = malloc((n > 0 ? n : 1) * sizeof(IrFunction *));
+	for (f = program->functions, k = 0; f != NULL; f = f->next, k++)
+	{
+		int scc = findCallNode(graph, f->name)->scc;
+		for (m = k; m > 0 && findCallNode(graph, order[m - 1]->name)->scc > scc; m--) order[m] = order[m - 1];
+		order[m] = f;
+	}
+	for (k = 0; k < n; k++) inlineInto(order[k]);
+	/* drop the functions no longer called */
+	for (p = &program->functions; (f = *p) != NULL;)
+	{
+		CallNodeRec *node = findCallNode(graph, f->name);
+		if (strcmp(f->name, "main") != 0 && node->callers > 0 && callees[node->index].sites == 0)
+		{
+			*p = f->next;
+			freeFunction(f);
+		}
+		else
+			p = &f->next;
+	}
+	free(order);
+	free(callees);
+	free(regions);
+	callees = NULL;
+	regions = NULL;
+	regionCount = regionCapacity = 0;
+	graph = NULL;
+}
@@ -0,0 +1,21 @@
+/****************************************************/
+/* File: inline.h                                   */
+/* Inlining of small functions into their callers   */
+/****************************************************/
+
+#ifndef _INLINE_H_
+#define _INLINE_H_
+
+#include "ir.h"
+#include "callgraph.h"
+
+/* Procedure inlineCalls replaces the calls of program,
+ * before SSA form, to functions that are not recursive
+ * in graph and call nothing, with their bodies, when
+ * these cost little more than the call, or the call is
+ * the only one. Callees are done before their callers,
+ * and a function whose every call went is dropped
+ */
+void inlineCalls(IrProgram *program, CallGraphRec *graph);
+
+#endif
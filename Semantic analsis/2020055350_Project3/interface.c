@@ -0,0 +1,267 @@
+/****************************************************/
+/* File: interface.c                                */
+/* Interface files of the C-Minus compiler          */
+/****************************************************/
+
+/* An interface file is
+ *
+ *   "CMIF" version:u8 count:u32
+ *   count declarations, each
+ *     kind:u8 type:u8 name
+ *     variable: size:u32 (array length, 0 if not an array)
+ *     function: params:u16, then params times  type:u8 name
+ *
+ * where a name is length:u16 followed by its characters,
+ * integers are little-endian and types use the codes of
+ * typeCode below. A function declared (void) has no params
+ */
+
+#include "globals.h"
+#include "util.h"
+#include "interface.h"
+
+#define INTERFACE_VERSION 1
+
+enum { VariableDecl, FunctionDecl };
+enum { IntCode, IntArrayCode, VoidCode };
+
+static int typeCode(NodeType type)
+{
+	if (type == IntegerArray) return IntArrayCode;
+	else if (type == Void) return VoidCode;
+	else
+		return IntCode;
+}
+
+static NodeType codeType(int code)
+{
+	if (code == IntArrayCode) return IntegerArray;
+	else if (code == VoidCode) return Void;
+	else
+		return Integer;
+}
+
+static void writeU8(FILE *out, unsigned value)
+{
+	fputc(value & 0xff, out);
+}
+
+static void writeU16(FILE *out, unsigned value)
+{
+	writeU8(out, value);
+	writeU8(out, value >> 8);
+}
+
+static void writeU32(FILE *out, unsigned value)
+{
+	writeU16(out, value);
+	writeU16(out, value >> 16);
+}
+
+static void writeName(FILE *out, char *name)
+{
+	size_t length = strlen(name);
+	writeU16(out, length);
+	fwrite(name, 1, length, out);
+}
+
+/* exported = declared in this unit, not built in or imported;
+ * main is left out, as each unit that imports the interface
+ * may define its own
+ */
+static int exported(SymbolEntryRec *symbol)
+{
+	return symbol->node != NULL && symbol->status != undeclared && symbol->lineUsage->lineno > 0 &&
+		   strcmp(symbol->name, "main") != 0;
+}
+
+int WriteInterface(char *path, ScopeEntryRec *rootScope)
+{
+	SymbolEntryRec *symbol;
+	unsigned count = 0;
+	FILE *out = fopen(path, "wb");
+	if (out == NULL) return FALSE;
+
+	for (symbol = rootScope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+		if (exported(symbol)) ++count;
+
+	fwrite("CMIF", 1, 4, out);
+	writeU8(out, INTERFACE_VERSION);
+	writeU32(out, count);
+	for (symbol = rootScope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+	{
+		TreeNode *node = symbol->node;
+		if (!exported(symbol)) continue;
+		writeU8(out, symbol->kind == FunctionSym ? FunctionDecl : VariableDecl);
+		writeU8(out, typeCode(symbol->type));
+		writeName(out, symbol->name);
+		if (symbol->kind == FunctionSym)
+		{
+			TreeNode *param = node->child[0];
+			unsigned params = 0;
+			if (param != NULL && param->type == Void) param = NULL;
+			for (node = param; node != NULL; node = node->sibling) ++params;
+			writeU16(out, params);
+			for (; param != NULL; param = param->sibling)
+			{
+				writeU8(out, typeCode(param->type));
+				writeName(out, param->name);
+			}
+		}
+		else
+			writeU32(out, node->child[0] != NULL ? (unsigned)node->child[0]->val : 0);
+	}
+
+	if (fclose(out) != 0) return FALSE;
+	return TRUE;
+}
+
+/* The reader walks the file contents held in memory;
+ * a read past the end marks the file as invalid
+ */
+typedef struct InterfaceReader
+{
+	unsigned char *data;
+	long length;
+	long position;
+	int valid;
+} InterfaceReader;
+
+static unsigned readU8(InterfaceReader *r)
+{
+	if (r->position + 1 > r->length)
+	{
+		r->valid = FALSE;
+		return 0;
+	}
+	return r->data[r->position++];
+}
+
+static unsigned readU16(InterfaceReader *r)
+{
+	unsigned low = readU8(r);
+	return low | readU8(r) << 8;
+}
+
+static unsigned readU32(InterfaceReader *r)
+{
+	unsigned low = readU16(r);
+	return low | readU16(r) << 16;
+}
+
+static char *readName(InterfaceReader *r)
+{
+	unsigned length = readU16(r);
+	char *name;
+	if (!r->valid || length == 0 || r->position + length > r->length)
+	{
+		r->valid = FALSE;
+		return NULL;
+	}
+	name = (char *)malloc(length + 1);
+	memcpy(name, r->data + r->position, length);
+	name[length] = '\0';
+	r->position += length;
+	return name;
+}
+
+static TreeNode *importedNode(NodeKind kind, NodeType type, char *name)
+{
+	TreeNode *t = newTreeNode(kind);
+	t->lineno = 0;
+	t->type = type;
+	if (name != NULL)
+	{
+		t->name = CopyName(name);
+		free(name);
+	}
+	return t;
+}
+
+/* readDeclaration builds the declaration node of the next
+ * entry, as the parser would have, and declares it
+ */
+static void readDeclaration(InterfaceReader *r, ScopeEntryRec *rootScope)
+{
+	unsigned kind = readU8(r);
+	unsigned code = readU8(r);
+	NodeType type = codeType(code);
+	char *name = readName(r);
+	TreeNode *t;
+
+	if (!r->valid || kind > FunctionDecl || code > VoidCode)
+	{
+		free(name);
+		r->valid = FALSE;
+		return;
+	}
+
+	if (kind == FunctionDecl)
+	{
+		unsigned params = readU16(r);
+		TreeNode *last = NULL;
+		t = importedNode(FuncDecl, type, name);
+		if (params == 0)
+		{
+			t->child[0] = importedNode(Params, Void, NULL);
+			t->child[0]->conflict = TRUE;
+		}
+		while (params-- > 0 && r->valid)
+		{
+			unsigned paramCode = readU8(r);
+			char *paramName = readName(r);
+			TreeNode *param;
+			if (!r->valid || paramCode > VoidCode)
+			{
+				free(paramName);
+				r->valid = FALSE;
+				return;
+			}
+			param = importedNode(Params, codeType(paramCode), paramName);
+			if (last == NULL) t->child[0] = param;
+			else
+				last->sibling = param;
+			last = param;
+		}
+		if (!r->valid) return;
+		InsertSymbol(rootScope, t->name, t->type, FunctionSym, 0, t);
+	}
+	else
+	{
+		unsigned size = readU32(r);
+		if (!r->valid) return;
+		t = importedNode(VarDecl, type, name);
+		if (type == IntegerArray)
+		{
+			t->child[0] = importedNode(ConstExpr, Integer, NULL);
+			t->child[0]->val = size;
+		}
+		InsertSymbol(rootScope, t->name, t->type, VariableSym, 0, t);
+	}
+}
+
+int ReadInterface(char *path, ScopeEntryRec *rootScope)
+{
+	InterfaceReader r;
+	unsigned count;
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) return FALSE;
+
+	fseek(in, 0, SEEK_END);
+	r.length = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	r.data = (unsigned char *)malloc(r.length > 0 ? r.length : 1);
+	r.position = 0;
+	r.valid = r.length > 0 && fread(r.data, 1, r.length, in) == (size_t)r.length;
+	fclose(in);
+
+	if (r.valid && (r.length < 5 || memcmp(r.data, "CMIF", 4) != 0)) r.valid = FALSE;
+	r.position = 4;
+	if (r.valid && readU8(&r) != INTERFACE_VERSION) r.valid = FALSE;
+	count = r.valid ? readU32(&r) : 0;
+	while (r.valid && count-- > 0) readDeclaration(&r, rootScope);
+	if (r.position != r.length) r.valid = FALSE;
+
+	free(r.data);
+	return r.valid;
+}
@@ -0,0 +1,28 @@
+/****************************************************/
+/* File: interface.h                                */
+/* Interface files of the C-Minus compiler:         */
+/* the global declarations of one unit, written in  */
+/* a compact binary form for other units to import  */
+/****************************************************/
+
+#ifndef _INTERFACE_H_
+#define _INTERFACE_H_
+
+#include "symtab.h"
+
+/* Function WriteInterface writes the global variables
+ * and function signatures declared in rootScope (not
+ * the built-in or imported ones, nor main) to the file
+ * path. It returns FALSE if the file cannot be written
+ */
+int WriteInterface(char *path, ScopeEntryRec *rootScope);
+
+/* Function ReadInterface declares every symbol of the
+ * interface file path in rootScope, for analysis only:
+ * main refuses to generate code for a unit that imports.
+ * It returns FALSE if the file cannot be read or is not
+ * a valid interface
+ */
+int ReadInterface(char *path, ScopeEntryRec *rootScope);
+
+#endif
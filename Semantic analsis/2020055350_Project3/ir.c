@@ -0,0 +1,921 @@
+/****************************************************/
+/* File: ir.c                                       */
+/* Three-address intermediate representation of     */
+/* C-Minus functions                                */
+/****************************************************/
+
+#include "globals.h"
+#include "symtab.h"
+#include "ir.h"
+#include <stdarg.h>
+
+/********************************************/
+/* utilities                                */
+/********************************************/
+
+IrOperand irImm(int val)
+{
+	IrOperand o;
+	o.kind = IrImm;
+	o.val = val;
+	return o;
+}
+
+IrOperand irReg(int vreg)
+{
+	IrOperand o;
+	o.kind = IrReg;
+	o.val = vreg;
+	return o;
+}
+
+static IrOperand irNone(void)
+{
+	IrOperand o;
+	o.kind = IrNone;
+	o.val = 0;
+	return o;
+}
+
+int newVreg(IrFunction *f, char *name, int word, int origin)
+{
+	if (f->nvregs == f->vregCapacity)
+	{
+		f->vregCapacity = f->vregCapacity == 0 ? 32 : 2 * f->vregCapacity;
+		f->vregs = realloc(f->vregs, f->vregCapacity * sizeof(IrVreg));
+	}
+	f->vregs[f->nvregs].name = name;
+	f->vregs[f->nvregs].word = word;
+	f->vregs[f->nvregs].origin = origin < 0 ? f->nvregs : origin;
+	return f->nvregs++;
+}
+
+/* newBlock makes a block of f that is not yet in the
+ * layout; placeBlock adds it at the end
+ */
+IrBlock *newBlock(IrFunction *f)
+{
+	IrBlock *b = calloc(1, sizeof(IrBlock));
+	(void)f;
+	b->id = -1;
+	return b;
+}
+
+static void placeBlock(IrFunction *f, IrBlock *b)
+{
+	if (f->nblocks == f->blockCapacity)
+	{
+		f->blockCapacity = f->blockCapacity == 0 ? 16 : 2 * f->blockCapacity;
+		f->blocks = realloc(f->blocks, f->blockCapacity * sizeof(IrBlock *));
+	}
+	b->id = f->nblocks;
+	f->blocks[f->nblocks++] = b;
+}
+
+/* placeBlockAfter puts b in the layout right after the
+ * block after, renumbering the blocks that follow
+ */
+void placeBlockAfter(IrFunction *f, IrBlock *after, IrBlock *b)
+{
+	int k;
+	placeBlock(f, b);
+	for (k = f->nblocks - 1; k > after->id + 1; k--)
+	{
+		f->blocks[k] = f->blocks[k - 1];
+		f->blocks[k]->id = k;
+	}
+	f->blocks[k] = b;
+	b->id = k;
+}
+
+void addEdge(IrBlock *from, IrBlock *to)
+{
+	if (to->npreds == to->predCapacity)
+	{
+		to->predCapacity = to->predCapacity == 0 ? 2 : 2 * to->predCapacity;
+		to->preds = realloc(to->preds, to->predCapacity * sizeof(IrBlock *));
+	}
+	to->preds[to->npreds++] = from;
+}
+
+/* removeEdge forgets from as a predecessor of to, with
+ * its argument in each phi of to
+ */
+void removeEdge(IrBlock *from, IrBlock *to)
+{
+	IrInstr *i;
+	int k, n;
+	for (k = 0; k < to->npreds && to->preds[k] != from; k++)
+		;
+	if (k == to->npreds) return;
+	for (n = k; n + 1 < to->npreds; n++) to->preds[n] = to->preds[n + 1];
+	to->npreds--;
+	for (i = to->first; i != NULL && i->op == IrPhi; i = i->next)
+	{
+		for (n = k; n + 1 < i->nargs; n++) i->args[n] = i->args[n + 1];
+		i->nargs--;
+	}
+}
+
+IrInstr *newInstr(IrOp op, int dest)
+{
+	IrInstr *i = calloc(1, sizeof(IrInstr));
+	i->op = op;
+	i->dest = dest;
+	return i;
+}
+
+void freeInstr(IrInstr *i)
+{
+	free(i->args);
+	free(i);
+}
+
+/* insertBefore puts i in b before instruction before,
+ * or at the end if before is NULL
+ */
+void insertBefore(IrBlock *b, IrInstr *before, IrInstr *i)
+{
+	i->next = before;
+	i->prev = before != NULL ? before->prev : b->last;
+	if (i->prev != NULL) i->prev->next = i;
+	else
+		b->first = i;
+	if (before != NULL) before->prev = i;
+	else
+		b->last = i;
+}
+
+void removeInstr(IrBlock *b, IrInstr *i)
+{
+	if (i->prev != NULL) i->prev->next = i->next;
+	else
+		b->first = i->next;
+	if (i->next != NULL) i->next->prev = i->prev;
+	else
+		b->last = i->prev;
+	i->prev = i->next = NULL;
+}
+
+static void freeBlock(IrBlock *b)
+{
+	IrInstr *i = b->first;
+	while (i != NULL)
+	{
+		IrInstr *next = i->next;
+		freeInstr(i);
+		i = next;
+	}
+	free(b->preds);
+	free(b);
+}
+
+static void markReachable(IrBlock *b)
+{
+	int k;
+	if (b == NULL || b->mark) return;
+	b->mark = TRUE;
+	for (k = 0; k < 2; k++) markReachable(b->succ[k]);
+}
+
+/* splitEdge puts a block that jumps to to on the edge
+ * from from, at the end of the layout; it takes the
+ * place of from among the predecessors of to, so the
+ * phis of to are unchanged
+ */
+IrBlock *splitEdge(IrFunction *f, IrBlock *from, IrBlock *to)
+{
+	IrBlock *b = newBlock(f);
+	IrInstr *jump = newInstr(IrJump, -1);
+	int k;
+	insertBefore(b, NULL, jump);
+	b->succ[0] = to;
+	for (k = 0; k < 2; k++)
+		if (from->succ[k] == to) from->succ[k] = b;
+	for (k = 0; k < to->npreds; k++)
+		if (to->preds[k] == from) to->preds[k] = b;
+	addEdge(from, b);
+	placeBlock(f, b);
+	return b;
+}
+
+void removeUnreachable(IrFunction *f)
+{
+	int k, n = 0;
+	for (k = 0; k < f->nblocks; k++) f->blocks[k]->mark = FALSE;
+	markReachable(f->blocks[0]);
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		if (!b->mark)
+		{
+			int s;
+			for (s = 0; s < 2; s++)
+				if (b->succ[s] != NULL && (s == 0 || b->succ[1] != b->succ[0])) removeEdge(b, b->succ[s]);
+		}
+	}
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		if (b->mark)
+		{
+			b->id = n;
+			f->blocks[n++] = b;
+		}
+		else
+			freeBlock(b);
+	}
+	f->nblocks = n;
+}
+
+/* mergeBlocks joins each block that ends in a jump to
+ * a block with no other predecessor to that block,
+ * whose phis become copies
+ */
+void mergeBlocks(IrFunction *f)
+{
+	int k, n, s;
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		if (b->id < 0) continue;
+		while (b->last->op == IrJump && b->succ[0] != b && b->succ[0]->npreds == 1 && b->succ[0] != f->blocks[0])
+		{
+			IrBlock *next = b->succ[0];
+			IrInstr *i = b->last;
+			removeInstr(b, i);
+			freeInstr(i);
+			while ((i = next->first) != NULL)
+			{
+				removeInstr(next, i);
+				if (i->op == IrPhi)
+				{
+					i->op = IrCopy;
+					i->a = i->args[0];
+					free(i->args);
+					i->args = NULL;
+					i->nargs = 0;
+				}
+				insertBefore(b, NULL, i);
+			}
+			b->succ[0] = next->succ[0];
+			b->succ[1] = next->succ[1];
+			for (s = 0; s < 2; s++)
+				if (b->succ[s] != NULL && (s == 0 || b->succ[1] != b->succ[0]))
+					for (n = 0; n < b->succ[s]->npreds; n++)
+						if (b->succ[s]->preds[n] == next) b->succ[s]->preds[n] = b;
+			next->id = -1;
+		}
+	}
+	for (k = 0, n = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		if (b->id < 0) freeBlock(b);
+		else
+		{
+			b->id = n;
+			f->blocks[n++] = b;
+		}
+	}
+	f->nblocks = n;
+}
+
+/********************************************/
+/* translation of the syntax tree           */
+/********************************************/
+
+static IrFunction *function = NULL;
+static IrBlock *current = NULL;
+
+/* scope is the innermost scope of the statement being
+ * translated, used to find the variables it names
+ */
+static ScopeEntryRec *scope = NULL;
+
+/* vars maps the symbol of each scalar local and
+ * parameter of function to its vreg
+ */
+typedef struct
+{
+	SymbolEntryRec *symbol;
+	int vreg;
+} VarEntry;
+
+static VarEntry *vars = NULL;
+static int varCount = 0, varCapacity = 0;
+
+static int isArray(SymbolEntryRec *symbol)
+{
+	return symbol->type == IntegerArray || symbol->type == VoidArray;
+}
+
+static int isArrayParam(SymbolEntryRec *symbol)
+{
+	return symbol->node != NULL && symbol->node->kind == Params && isArray(symbol);
+}
+
+static int isGlobal(SymbolEntryRec *symbol)
+{
+	return symbol->scope->parentScope == NULL;
+}
+
+static SymbolEntryRec *lookupVariable(TreeNode *t)
+{
+	return SearchSymbolByKind(scope, t->name, VariableSym);
+}
+
+/* vregOf returns the vreg of a scalar local, a
+ * parameter or an array parameter
+ */
+static int vregOf(SymbolEntryRec *symbol)
+{
+	int k;
+	for (k = varCount - 1; k >= 0; k--)
+		if (vars[k].symbol == symbol) return vars[k].vreg;
+	if (varCount == varCapacity)
+	{
+		varCapacity = varCapacity == 0 ? 16 : 2 * varCapacity;
+		vars = realloc(vars, varCapacity * sizeof(VarEntry));
+	}
+	vars[varCount].symbol = symbol;
+	vars[varCount].vreg = newVreg(function, symbol->name, symbol->offset, -1);
+	return vars[varCount++].vreg;
+}
+
+/* emit adds i at the end of the current block; code
+ * after a jump or return goes to a new block that
+ * nothing reaches
+ */
+static IrInstr *emit(IrInstr *i)
+{
+	if (current == NULL)
+	{
+		current = newBlock(function);
+		placeBlock(function, current);
+	}
+	insertBefore(current, NULL, i);
+	return i;
+}
+
+static int newTemp(void)
+{
+	return newVreg(function, NULL, -1, -1);
+}
+
+static IrOperand emitOp(IrOp op, IrOperand a, IrOperand b)
+{
+	IrInstr *i = newInstr(op, newTemp());
+	i->a = a;
+	i->b = b;
+	emit(i);
+	return irReg(i->dest);
+}
+
+/* startBlock makes b the current block, falling into it
+ * from the block before
+ */
+static void jumpTo(IrBlock *b);
+
+static void startBlock(IrBlock *b)
+{
+	jumpTo(b);
+	placeBlock(function, b);
+	current = b;
+}
+
+static void jumpTo(IrBlock *b)
+{
+	IrInstr *i;
+	if (current == NULL) return;
+	i = newInstr(IrJump, -1);
+	emit(i);
+	current->succ[0] = b;
+	addEdge(current, b);
+	current = NULL;
+}
+
+static void branchTo(TokenType relop, IrOperand a, IrOperand b, IrBlock *ifTrue, IrBlock *ifFalse)
+{
+	IrInstr *i = newInstr(IrBranch, -1);
+	i->relop = relop;
+	i->a = a;
+	i->b = b;
+	emit(i);
+	current->succ[0] = ifTrue;
+	current->succ[1] = ifFalse;
+	addEdge(current, ifTrue);
+	if (ifFalse != ifTrue) addEdge(current, ifFalse);
+	current = NULL;
+}
+
+static int hasAssign(TreeNode *t)
+{
+	int k;
+	for (; t != NULL; t = t->sibling)
+	{
+		if (t->kind == AssignExpr) return TRUE;
+		for (k = 0; k < MAXCHILDREN; k++)
+			if (hasAssign(t->child[k])) return TRUE;
+	}
+	return FALSE;
+}
+
+/* stable keeps the value of operand o, a variable that
+ * later may assign, in a temp
+ */
+static IrOperand stable(IrOperand o, TreeNode *later)
+{
+	IrInstr *i;
+	if (o.kind != IrReg || function->vregs[o.val].name == NULL || !hasAssign(later)) return o;
+	i = newInstr(IrCopy, newTemp());
+	i->a = o;
+	emit(i);
+	return irReg(i->dest);
+}
+
+static int isRelop(TokenType op)
+{
+	return op == LT || op == LE || op == GT || op == GE || op == EQ || op == NE;
+}
+
+static IrOperand lowerExp(TreeNode *t);
+
+/* element sets the space, disp, index and pointer of
+ * memory instruction i for symbol; a scalar or a whole
+ * array has no index
+ */
+static void element(IrInstr *i, SymbolEntryRec *symbol, IrOperand index)
+{
+	i->name = symbol->name;
+	i->a = index;
+	if (isArrayParam(symbol))
+	{
+		i->space = IrPointer;
+		i->disp = 0;
+		i->b = irReg(vregOf(symbol));
+	}
+	else
+	{
+		i->space = isGlobal(symbol) ? IrGlobal : IrFrame;
+		i->disp = symbol->offset;
+	}
+}
+
+static IrOperand lowerVar(TreeNode *t)
+{
+	SymbolEntryRec *symbol = lookupVariable(t);
+	IrInstr *i;
+	if (t->child[0] != NULL)
+	{
+		IrOperand index = lowerExp(t->child[0]);
+		i = newInstr(IrLoad, newTemp());
+		element(i, symbol, index);
+		emit(i);
+		return irReg(i->dest);
+	}
+	if (isArrayParam(symbol) || (!isGlobal(symbol) && !isArray(symbol))) return irReg(vregOf(symbol));
+	/* a global scalar, or the address of an array */
+	i = newInstr(isArray(symbol) ? IrAddr : IrLoad, newTemp());
+	element(i, symbol, irNone());
+	emit(i);
+	return irReg(i->dest);
+}
+
+static IrOperand lowerAssign(TreeNode *t)
+{
+	TreeNode *target = t->child[0];
+	SymbolEntryRec *symbol = lookupVariable(target);
+	IrOperand index, value;
+	IrInstr *i;
+	if (target->child[0] == NULL && !isGlobal(symbol))
+	{
+		int v = vregOf(symbol);
+		value = lowerExp(t->child[1]);
+		/* the instruction that computed a fresh temp can
+		 * set the variable itself
+		 */
+		if (value.kind == IrReg && current != NULL && current->last != NULL && current->last->dest == value.val
+			&& function->vregs[value.val].name == NULL && current->last->op != IrPhi)
+			current->last->dest = v;
+		else
+		{
+			i = newInstr(IrCopy, v);
+			i->a = value;
+			emit(i);
+		}
+		return irReg(v);
+	}
+	index = target->child[0] != NULL ? stable(lowerExp(target->child[0]), t->child[1]) : irNone();
+	value = lowerExp(t->child[1]);
+	i = newInstr(IrStore, -1);
+	element(i, symbol, index);
+	i->c = value;
+	emit(i);
+	return value;
+}
+
+static IrOperand lowerCall(TreeNode *t)
+{
+	TreeNode *arg;
+	IrInstr *i;
+	int k, n = 0;
+	if (strcmp(t->name, "input") == 0)
+	{
+		i = newInstr(IrIn, newTemp());
+		emit(i);
+		return irReg(i->dest);
+	}
+	if (strcmp(t->name, "output") == 0)
+	{
+		i = newInstr(IrOut, -1);
+		i->a = lowerExp(t->child[0]);
+		emit(i);
+		return irNone();
+	}
+	for (arg = t->child[0]; arg != NULL; arg = arg->sibling) n++;
+	i = newInstr(IrCall, t->type == Void ? -1 : newTemp());
+	i->name = t->name;
+	i->nargs = n;
+	i->args = n > 0 ? malloc(n * sizeof(IrOperand)) : NULL;
+	for (arg = t->child[0], k = 0; arg != NULL; arg = arg->sibling, k++)
+		i->args[k] = stable(lowerExp(arg), arg->sibling);
+	emit(i);
+	return i->dest >= 0 ? irReg(i->dest) : irNone();
+}
+
+static IrOperand lowerExp(TreeNode *t)
+{
+	IrOperand a, b;
+	IrInstr *i;
+	switch (t->kind)
+	{
+		case ConstExpr:
+			return irImm(t->val);
+		case VarAccessExpr:
+			return lowerVar(t);
+		case AssignExpr:
+			return lowerAssign(t);
+		case CallExpr:
+			return lowerCall(t);
+		case OpExpr:
+			a = stable(lowerExp(t->child[0]), t->child[1]);
+			b = lowerExp(t->child[1]);
+			switch (t->token)
+			{
+				case PLUS: return emitOp(IrAdd, a, b);
+				case MINUS: return emitOp(IrSub, a, b);
+				case TIMES: return emitOp(IrMul, a, b);
+				case OVER: return emitOp(IrDiv, a, b);
+				default:
+					i = newInstr(IrCmp, newTemp());
+					i->relop = t->token;
+					i->a = a;
+					i->b = b;
+					emit(i);
+					return irReg(i->dest);
+			}
+		default:
+			return irNone();
+	}
+}
+
+/* lowerCond goes to ifTrue if condition t holds and to
+ * ifFalse if not
+ */
+static void lowerCond(TreeNode *t, IrBlock *ifTrue, IrBlock *ifFalse)
+{
+	IrOperand a, b;
+	if (t->kind == ConstExpr)
+	{
+		jumpTo(t->val != 0 ? ifTrue : ifFalse);
+		return;
+	}
+	if (t->kind == OpExpr && isRelop(t->token))
+	{
+		a = stable(lowerExp(t->child[0]), t->child[1]);
+		b = lowerExp(t->child[1]);
+		branchTo(t->token, a, b, ifTrue, ifFalse);
+		return;
+	}
+	branchTo(NE, lowerExp(t), irImm(0), ifTrue, ifFalse);
+}
+
+static void lowerStmt(TreeNode *t)
+{
+	ScopeEntryRec *enclosing;
+	IrBlock *b1, *b2, *b3;
+	IrInstr *i;
+	for (; t != NULL; t = t->sibling)
+		switch (t->kind)
+		{
+			case CompStmt:
+				enclosing = scope;
+				if (t->scope != NULL) scope = t->scope;
+				lowerStmt(t->child[1]);
+				scope = enclosing;
+				break;
+			case IfStmt:
+				b1 = newBlock(function);
+				b2 = t->child[2] != NULL ? newBlock(function) : NULL;
+				b3 = newBlock(function);
+				lowerCond(t->child[0], b1, b2 != NULL ? b2 : b3);
+				startBlock(b1);
+				lowerStmt(t->child[1]);
+				if (b2 != NULL)
+				{
+					jumpTo(b3);
+					startBlock(b2);
+					lowerStmt(t->child[2]);
+				}
+				startBlock(b3);
+				break;
+			case WhileStmt:
+				/* the test follows the body, as in cgen.c */
+				b1 = newBlock(function);
+				b2 = newBlock(function);
+				b3 = newBlock(function);
+				jumpTo(b2);
+				startBlock(b1);
+				lowerStmt(t->child[1]);
+				startBlock(b2);
+				lowerCond(t->child[0], b1, b3);
+				startBlock(b3);
+				break;
+			case ReturnStmt:
+				i = newInstr(IrRet, -1);
+				i->a = t->child[0] != NULL ? lowerExp(t->child[0]) : irNone();
+				emit(i);
+				current = NULL;
+				break;
+			case VarDecl:
+				break;
+			default:
+				lowerExp(t);
+				break;
+		}
+}
+
+static IrFunction *lowerFunction(TreeNode *t)
+{
+	TreeNode *p;
+	IrInstr *i;
+	int n = 0;
+	function = calloc(1, sizeof(IrFunction));
+	function->name = t->name;
+	function->frameSize = t->scope->frameSize;
+	scope = t->scope;
+	varCount = 0;
+	current = NULL;
+	for (p = t->child[0]; p != NULL; p = p->sibling)
+		if (p->name != NULL && !(p->kind == Params && p->type == Void)) n++;
+	function->params = n > 0 ? malloc(n * sizeof(int)) : NULL;
+	for (p = t->child[0]; p != NULL; p = p->sibling)
+		if (p->name != NULL && !(p->kind == Params && p->type == Void))
+		{
+			SymbolEntryRec *symbol = SearchSymbolInScope(scope, p->name);
+			if (symbol != NULL) function->params[function->nparams++] = vregOf(symbol);
+		}
+	current = newBlock(function);
+	placeBlock(function, current);
+	lowerStmt(t->child[1]);
+	if (current != NULL)
+	{
+		i = newInstr(IrRet, -1);
+		emit(i);
+	}
+	current = NULL;
+	removeUnreachable(function);
+	mergeBlocks(function);
+	return function;
+}
+
+IrProgram *buildIr(TreeNode *syntaxTree)
+{
+	IrProgram *program = calloc(1, sizeof(IrProgram));
+	IrFunction *last = NULL;
+	TreeNode *t;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind == FuncDecl && t->scope != NULL)
+		{
+			program->globals = t->scope->parentScope->frameSize;
+			if (t->child[1] == NULL) continue;
+			if (last == NULL) program->functions = lowerFunction(t);
+			else
+				last->next = lowerFunction(t);
+			last = function;
+		}
+	free(vars);
+	vars = NULL;
+	varCount = varCapacity = 0;
+	function = NULL;
+	scope = NULL;
+	return program;
+}
+
+/********************************************/
+/* the --dump-ir format                     */
+/********************************************/
+
+static char *relopName(TokenType op)
+{
+	return op == LT ? "<" : op == LE ? "<=" : op == GT ? ">" : op == GE ? ">=" : op == EQ ? "==" : "!=";
+}
+
+static char *opName(IrOp op)
+{
+	return op == IrAdd ? "+" : op == IrSub ? "-" : op == IrMul ? "*" : "/";
+}
+
+/* Text accumulates a line of the dump in a buffer of
+ * fixed size, cutting it short if it does not fit
+ */
+typedef struct
+{
+	char *p;
+	int left;
+} Text;
+
+static void put(Text *t, const char *format, ...)
+{
+	va_list ap;
+	int n;
+	if (t->left <= 1) return;
+	va_start(ap, format);
+	n = vsnprintf(t->p, t->left, format, ap);
+	va_end(ap);
+	if (n < 0) return;
+	if (n >= t->left) n = t->left - 1;
+	t->p += n;
+	t->left -= n;
+}
+
+static void putVreg(Text *t, IrFunction *f, int v)
+{
+	IrVreg *r = &f->vregs[v];
+	if (r->name == NULL) put(t, "t%d", v);
+	else if (r->origin != v)
+		put(t, "%s.%d", r->name, v);
+	else
+		put(t, "%s", r->name);
+}
+
+static void putOperand(Text *t, IrFunction *f, IrOperand o)
+{
+	if (o.kind == IrImm) put(t, "%d", o.val);
+	else if (o.kind == IrReg)
+		putVreg(t, f, o.val);
+	else
+		put(t, "_");
+}
+
+static void putAddress(Text *t, IrFunction *f, IrInstr *i)
+{
+	if (i->space == IrPointer) putOperand(t, f, i->b);
+	else
+		put(t, "%s", i->name);
+	if (i->a.kind != IrNone)
+	{
+		put(t, "[");
+		putOperand(t, f, i->a);
+		put(t, "]");
+	}
+}
+
+void formatInstr(char *buf, int size, IrFunction *f, IrBlock *b, IrInstr *i)
+{
+	Text t;
+	int k;
+	t.p = buf;
+	t.left = size;
+	buf[0] = '\0';
+	if (i->dest >= 0)
+	{
+		putVreg(&t, f, i->dest);
+		put(&t, " = ");
+	}
+	switch (i->op)
+	{
+		case IrCopy:
+			putOperand(&t, f, i->a);
+			break;
+		case IrAdd:
+		case IrSub:
+		case IrMul:
+		case IrDiv:
+		case IrCmp:
+			putOperand(&t, f, i->a);
+			put(&t, " %s ", i->op == IrCmp ? relopName(i->relop) : opName(i->op));
+			putOperand(&t, f, i->b);
+			break;
+		case IrLoad:
+			put(&t, "load ");
+			putAddress(&t, f, i);
+			break;
+		case IrStore:
+			put(&t, "store ");
+			putAddress(&t, f, i);
+			put(&t, ", ");
+			putOperand(&t, f, i->c);
+			break;
+		case IrAddr:
+			put(&t, "addr ");
+			putAddress(&t, f, i);
+			break;
+		case IrIn:
+			put(&t, "input");
+			break;
+		case IrOut:
+			put(&t, "output ");
+			putOperand(&t, f, i->a);
+			break;
+		case IrCall:
+		case IrPhi:
+			put(&t, "%s(", i->op == IrCall ? i->name : "phi");
+			for (k = 0; k < i->nargs; k++)
+			{
+				if (k > 0) put(&t, ", ");
+				putOperand(&t, f, i->args[k]);
+			}
+			put(&t, ")");
+			break;
+		case IrJump:
+			put(&t, "jump B%d", b->succ[0]->id);
+			break;
+		case IrBranch:
+			put(&t, "branch ");
+			putOperand(&t, f, i->a);
+			put(&t, " %s ", relopName(i->relop));
+			putOperand(&t, f, i->b);
+			put(&t, " ? B%d : B%d", b->succ[0]->id, b->succ[1]->id);
+			break;
+		case IrRet:
+			put(&t, "ret");
+			if (i->a.kind != IrNone)
+			{
+				put(&t, " ");
+				putOperand(&t, f, i->a);
+			}
+			break;
+	}
+}
+
+void printIr(FILE *out, IrProgram *program)
+{
+	IrFunction *f;
+	char line[256];
+	int k, n;
+	fprintf(out, "\n\n< Intermediate Representation >\n");
+	fprintf(out, "global data: %d words\n", program->globals);
+	for (f = program->functions; f != NULL; f = f->next)
+	{
+		fprintf(out, "\nfunction %s(", f->name);
+		for (k = 0; k < f->nparams; k++)
+		{
+			Text t;
+			t.p = line;
+			t.left = sizeof(line);
+			putVreg(&t, f, f->params[k]);
+			fprintf(out, "%s%s", k > 0 ? ", " : "", line);
+		}
+		fprintf(out, ")  frame %d words\n", f->frameSize);
+		for (k = 0; k < f->nblocks; k++)
+		{
+			IrBlock *b = f->blocks[k];
+			IrInstr *i;
+			fprintf(out, "B%d:", b->id);
+			if (b->npreds > 0)
+			{
+				fprintf(out, "  preds");
+				for (n = 0; n < b->npreds; n++) fprintf(out, " B%d", b->preds[n]->id);
+			}
+			fprintf(out, "\n");
+			for (i = b->first; i != NULL; i = i->next)
+			{
+				formatInstr(line, sizeof(line), f, b, i);
+				fprintf(out, "    %s\n", line);
+			}
+		}
+	}
+}
+
+void freeFunction(IrFunction *f)
+{
+	int k;
+	for (k = 0; k < f->nblocks; k++) freeBlock(f->blocks[k]);
+	free(f->blocks);
+	free(f->vregs);
+	free(f->params);
+	free(f);
+}
+
+void freeIr(IrProgram *program)
+{
+	IrFunction *f = program->functions;
+	while (f != NULL)
+	{
+		IrFunction *next = f->next;
+		freeFunction(f);
+		f = next;
+	}
+	free(program);
+}
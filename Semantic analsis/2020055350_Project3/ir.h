@@ -0,0 +1,167 @@
+/****************************************************/
+/* File: ir.h                                       */
+/* Three-address intermediate representation of     */
+/* C-Minus functions                                */
+/****************************************************/
+
+#ifndef _IR_H_
+#define _IR_H_
+
+#include "globals.h"
+
+/* A function is a list of basic blocks, and a block a
+ * list of three-address instructions ending in a jump,
+ * a branch or a return. Values live in virtual
+ * registers (vregs): every scalar local and parameter
+ * of a function is one, and so is every intermediate
+ * result. Globals and array elements stay in memory and
+ * are reached with load and store
+ */
+
+typedef enum
+{
+	IrCopy,   /* dest = a */
+	IrAdd,    /* dest = a + b */
+	IrSub,    /* dest = a - b */
+	IrMul,    /* dest = a * b */
+	IrDiv,    /* dest = a / b */
+	IrCmp,    /* dest = a relop b, 1 or 0 */
+	IrLoad,   /* dest = the word at the address */
+	IrStore,  /* the word at the address = c */
+	IrAddr,   /* dest = address of an array */
+	IrIn,     /* dest = input() */
+	IrOut,    /* output(a) */
+	IrCall,   /* dest = name(args) */
+	IrPhi,    /* dest = args[i] when entered from preds[i] */
+	IrJump,   /* go to succ[0] */
+	IrBranch, /* go to succ[0] if a relop b, else succ[1] */
+	IrRet     /* return a, if any */
+} IrOp;
+
+typedef enum
+{
+	IrNone,
+	IrImm, /* the constant val */
+	IrReg  /* vreg val */
+} IrOperandKind;
+
+typedef struct
+{
+	IrOperandKind kind;
+	int val;
+} IrOperand;
+
+/* where a load, store or addr finds its variable: the
+ * address is disp (a word offset from frame.c) plus
+ * the index a (none for a scalar or a whole array),
+ * from the start of the global data, of the frame, or
+ * from the pointer b (an array parameter)
+ */
+typedef enum
+{
+	IrGlobal,
+	IrFrame,
+	IrPointer
+} IrSpace;
+
+typedef struct IrInstr
+{
+	IrOp op;
+	int dest; /* vreg set, or -1 */
+	IrOperand a, b, c;
+	TokenType relop; /* of IrCmp and IrBranch */
+	IrSpace space;   /* of IrLoad, IrStore and IrAddr */
+	int disp;
+	char *name; /* callee, or variable reached in memory */
+	IrOperand *args; /* of a call or phi */
+	int nargs;
+	struct IrInstr *prev, *next;
+} IrInstr;
+
+typedef struct IrBlock
+{
+	int id;
+	IrInstr *first, *last;
+	struct IrBlock *succ[2];
+	struct IrBlock **preds;
+	int npreds, predCapacity;
+	int mark; /* free for passes */
+} IrBlock;
+
+typedef struct
+{
+	char *name; /* of a variable, NULL for a temp */
+	int word;   /* its frame word, or -1 */
+	int origin; /* the vreg it is a version of */
+} IrVreg;
+
+typedef struct IrFunction
+{
+	char *name;
+	int frameSize; /* words of parameters and locals */
+	int *params;   /* vreg of each parameter */
+	int nparams;
+	IrBlock **blocks; /* in layout order, entry first */
+	int nblocks, blockCapacity;
+	IrVreg *vregs;
+	int nvregs, vregCapacity;
+	struct IrFunction *next;
+} IrFunction;
+
+typedef struct
+{
+	IrFunction *functions;
+	int globals; /* words of global data */
+} IrProgram;
+
+/* Function buildIr translates an analyzed, error-free
+ * syntax tree with its frames laid out. Unreachable
+ * blocks are left out
+ */
+IrProgram *buildIr(TreeNode *syntaxTree);
+
+/* Procedure printIr writes program in the --dump-ir
+ * format; formatInstr writes instruction i of block b
+ * to buf
+ */
+void printIr(FILE *out, IrProgram *program);
+void formatInstr(char *buf, int size, IrFunction *f, IrBlock *b, IrInstr *i);
+
+void freeIr(IrProgram *program);
+void freeFunction(IrFunction *f);
+
+/* utilities for passes over the IR */
+IrOperand irImm(int val);
+IrOperand irReg(int vreg);
+int newVreg(IrFunction *f, char *name, int word, int origin);
+IrBlock *newBlock(IrFunction *f);
+void addEdge(IrBlock *from, IrBlock *to);
+void removeEdge(IrBlock *from, IrBlock *to);
+IrInstr *newInstr(IrOp op, int dest);
+void insertBefore(IrBlock *b, IrInstr *before, IrInstr *i);
+void removeInstr(IrBlock *b, IrInstr *i);
+void freeInstr(IrInstr *i);
+
+/* placeBlockAfter puts block b, not yet in the layout,
+ * right after block after
+ */
+void placeBlockAfter(IrFunction *f, IrBlock *after, IrBlock *b);
+
+/* splitEdge puts a new block, at the end of the layout,
+ * on the edge from from to to and returns it
+ */
+IrBlock *splitEdge(IrFunction *f, IrBlock *from, IrBlock *to);
+
+/* Procedure mergeBlocks joins each block that ends in a
+ * jump to a block with no other predecessor to that
+ * block, and renumbers the blocks
+ */
+void mergeBlocks(IrFunction *f);
+
+/* Procedure removeUnreachable drops the blocks that
+ * cannot be reached from the entry and renumbers the
+ * rest in layout order
+ */
+void removeUnreachable(IrFunction *f);
+
+#endif
@@ -0,0 +1,282 @@
+/****************************************************/
+/* File: licm.c                                     */
+/* Loop-invariant code motion over the SSA form     */
+/****************************************************/
+
+#include "globals.h"
+#include "ir.h"
+#include "ssa.h"
+#include "licm.h"
+
+/* a natural loop: its header, whether each block (by id)
+ * is in it, and how many are
+ */
+typedef struct
+{
+	IrBlock *header;
+	char *body;
+	int size;
+} Loop;
+
+static IrFunction *function = NULL;
+static int globalWords = 0;
+
+/* defBlock gives the id of the block each vreg is set
+ * in, or -1 if it is set nowhere
+ */
+static int *defBlock = NULL;
+
+/* whether the loop being looked at calls a function,
+ * or stores through an array parameter
+ */
+static int hasCall = FALSE;
+static int hasPointerStore = FALSE;
+
+static void findBody(Loop *l, IrBlock *b)
+{
+	int n;
+	if (l->body[b->id]) return;
+	l->body[b->id] = TRUE;
+	l->size++;
+	for (n = 0; n < b->npreds; n++) findBody(l, b->preds[n]);
+}
+
+/* preheader returns the block the loop is entered from,
+ * if there is one only and it goes nowhere else
+ */
+static IrBlock *preheader(Loop *l)
+{
+	IrBlock *p = NULL;
+	int n;
+	for (n = 0; n < l->header->npreds; n++)
+	{
+		IrBlock *b = l->header->preds[n];
+		if (l->body[b->id]) continue;
+		if (p != NULL && p != b) return NULL;
+		p = b;
+	}
+	return p != NULL && p->last->op == IrJump ? p : NULL;
+}
+
+static int storesTo(Loop *l, char *name)
+{
+	IrInstr *i;
+	int k;
+	for (k = 0; k < function->nblocks; k++)
+		if (l->body[k])
+			for (i = function->blocks[k]->first; i != NULL; i = i->next)
+				if (i->op == IrStore && i->space == IrGlobal && strcmp(i->name, name) == 0) return TRUE;
+	return FALSE;
+}
+
+static int invariant(Loop *l, IrOperand o)
+{
+	return o.kind != IrReg || defBlock[o.val] < 0 || !l->body[defBlock[o.val]];
+}
+
+/* canHoist tells whether i may be done before the loop,
+ * whether or not the loop runs: so it must not stop the
+ * machine, and a load must read what every turn would.
+ * Array indexes are taken to stay in their arrays
+ */
+static int canHoist(Loop *l, IrInstr *i)
+{
+	switch (i->op)
+	{
+		case IrCopy:
+			/* worth it only for what is computed from it */
+			return i->a.kind == IrReg && function->vregs[i->dest].name == NULL;
+		case IrAdd:
+		case IrSub:
+		case IrMul:
+		case IrCmp:
+			return TRUE;
+		case IrDiv:
+			return i->b.kind == IrImm && i->b.val != 0 && i->b.val != -1;
+		case IrLoad:
+			if (i->space != IrGlobal || hasCall || storesTo(l, i->name)) return FALSE;
+			if (i->a.kind == IrNone) return TRUE;
+			return i->a.kind == IrImm && !hasPointerStore && i->disp + i->a.val >= 0 &&
+				   i->disp + i->a.val < globalWords;
+		default:
+			return FALSE;
+	}
+}
+
+static int newTemp(void)
+{
+	int t = newVreg(function, NULL, -1, -1);
+	defBlock = realloc(defBlock, function->nvregs * sizeof(int));
+	return t;
+}
+
+static int sameOperand(IrOperand x, IrOperand y)
+{
+	return x.kind == y.kind && (x.kind == IrNone || x.val == y.val);
+}
+
+/* earlier returns an instruction of preheader p that
+ * gives what i would at its end, or NULL
+ */
+static IrInstr *earlier(IrBlock *p, IrInstr *i)
+{
+	IrInstr *e, *j;
+	for (e = p->first; e != p->last; e = e->next)
+	{
+		if (e->op != i->op || e->dest < 0 || !sameOperand(e->a, i->a) || !sameOperand(e->b, i->b)) continue;
+		if (i->op == IrCmp && e->relop != i->relop) continue;
+		if (i->op != IrLoad) return e;
+		if (e->space != i->space || e->disp != i->disp || strcmp(e->name, i->name) != 0) continue;
+		for (j = e->next; j != p->last && j->op != IrStore && j->op != IrCall; j = j->next)
+			;
+		if (j == p->last) return e;
+	}
+	return NULL;
+}
+
+static void replaceUses(int from, int to)
+{
+	IrOperand *o[3];
+	IrInstr *i;
+	int k, n;
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			o[0] = &i->a;
+			o[1] = &i->b;
+			o[2] = &i->c;
+			for (n = 0; n < 3 + i->nargs; n++)
+			{
+				IrOperand *u = n < 3 ? o[n] : &i->args[n - 3];
+				if (u->kind == IrReg && u->val == from) u->val = to;
+			}
+		}
+}
+
+/* Procedure hoistLoop moves what is invariant in l to the
+ * end of its preheader, until nothing more is, or drops
+ * it if the preheader already computes it. A version
+ * of a variable stays set in the loop, from a temp set
+ * before it, as versions must not overlap
+ */
+static void hoistLoop(Loop *l)
+{
+	IrBlock *p = preheader(l);
+	IrInstr *i, *e, *next;
+	int k, changed;
+	if (p == NULL) return;
+	hasCall = hasPointerStore = FALSE;
+	for (k = 0; k < function->nblocks; k++)
+		if (l->body[k])
+			for (i = function->blocks[k]->first; i != NULL; i = i->next)
+			{
+				if (i->op == IrCall) hasCall = TRUE;
+				if (i->op == IrStore && i->space == IrPointer) hasPointerStore = TRUE;
+			}
+	do
+	{
+		changed = FALSE;
+		for (k = 0; k < function->nblocks; k++)
+		{
+			IrBlock *b = function->blocks[k];
+			if (!l->body[k]) continue;
+			for (i = b->first; i != NULL; i = next)
+			{
+				next = i->next;
+				if (i->dest < 0 || !canHoist(l, i) || !invariant(l, i->a) || !invariant(l, i->b)) continue;
+				e = earlier(p, i);
+				if (e != NULL && function->vregs[i->dest].name == NULL)
+				{
+					/* the preheader has it already */
+					replaceUses(i->dest, e->dest);
+					removeInstr(b, i);
+					freeInstr(i);
+				}
+				else if (e != NULL)
+				{
+					i->op = IrCopy;
+					i->a = irReg(e->dest);
+					i->b.kind = IrNone;
+				}
+				else if (function->vregs[i->dest].name == NULL)
+				{
+					removeInstr(b, i);
+					insertBefore(p, p->last, i);
+					defBlock[i->dest] = p->id;
+				}
+				else
+				{
+					IrInstr *h = newInstr(i->op, newTemp());
+					h->a = i->a;
+					h->b = i->b;
+					h->relop = i->relop;
+					h->space = i->space;
+					h->disp = i->disp;
+					h->name = i->name;
+					insertBefore(p, p->last, h);
+					defBlock[h->dest] = p->id;
+					i->op = IrCopy;
+					i->a = irReg(h->dest);
+					i->b.kind = IrNone;
+				}
+				changed = TRUE;
+			}
+		}
+	} while (changed);
+}
+
+static void hoistFunction(IrFunction *f)
+{
+	int *idom = findDominators(f);
+	Loop *loops = malloc(f->nblocks * sizeof(Loop));
+	IrInstr *i;
+	int nloops = 0, k, n;
+	function = f;
+	defBlock = malloc(f->nvregs * sizeof(int));
+	for (k = 0; k < f->nvregs; k++) defBlock[k] = -1;
+	for (k = 0; k < f->nblocks; k++)
+		for (i = f->blocks[k]->first; i != NULL; i = i->next)
+			if (i->dest >= 0) defBlock[i->dest] = k;
+	/* a loop for each block that a block it dominates goes
+	 * back to
+	 */
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *h = f->blocks[k];
+		Loop l;
+		l.header = h;
+		l.body = NULL;
+		l.size = 1;
+		for (n = 0; n < h->npreds; n++)
+			if (dominates(idom, k, h->preds[n]->id))
+			{
+				if (l.body == NULL)
+				{
+					l.body = calloc(f->nblocks, 1);
+					l.body[k] = TRUE;
+				}
+				findBody(&l, h->preds[n]);
+			}
+		if (l.body == NULL) continue;
+		/* keep them smallest first, so inner loops go first */
+		for (n = nloops++; n > 0 && loops[n - 1].size > l.size; n--) loops[n] = loops[n - 1];
+		loops[n] = l;
+	}
+	for (k = 0; k < nloops; k++)
+	{
+		hoistLoop(&loops[k]);
+		free(loops[k].body);
+	}
+	free(loops);
+	free(idom);
+	free(defBlock);
+	defBlock = NULL;
+	function = NULL;
+}
+
+void hoistInvariants(IrProgram *program)
+{
+	IrFunction *f;
+	globalWords = program->globals;
+	for (f = program->functions; f != NULL; f = f->next) hoistFunction(f);
+}
@@ -0,0 +1,19 @@
+/****************************************************/
+/* File: licm.h                                     */
+/* Loop-invariant code motion over the SSA form     */
+/****************************************************/
+
+#ifndef _LICM_H_
+#define _LICM_H_
+
+#include "ir.h"
+
+/* Procedure hoistInvariants moves the computations of
+ * each loop of program, in SSA form, whose operands are
+ * set outside it, and the loads of globals it does not
+ * store to, into the block that enters it, innermost
+ * loops first
+ */
+void hoistInvariants(IrProgram *program);
+
+#endif
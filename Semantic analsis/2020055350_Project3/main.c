@@ -15,88 +15,263 @@
 /* set NO_CODE to TRUE to get a compiler that does not
  * generate code
  */
-#define NO_CODE TRUE
+#define NO_CODE FALSE
 
 #include "util.h"
-#if NO_PARSE
 #include "scan.h"
-#else
+#include <sys/stat.h>
+#include <unistd.h>
+#if !NO_PARSE
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
+#include "symtab.h"
+#include "callgraph.h"
+#include "timing.h"
 #if !NO_CODE
+#include "simplify.h"
+#include "code.h"
+#include "peephole.h"
 #include "cgen.h"
+#include "ir.h"
+#include "ssa.h"
+#include "sccp.h"
+#include "licm.h"
+#include "inline.h"
+#include "tmgen.h"
 #endif
 #endif
 #endif
 
-/* allocate global variables */
-int lineno = 0;
-FILE * source;
-FILE * listing;
-FILE * code;
-
-/* allocate and set tracing flags */
-int EchoSource = FALSE;
-int TraceScan = FALSE;
-int TraceParse = FALSE;
-int TraceAnalyze = FALSE;
-int TraceCode = FALSE;
-
-int Error = FALSE;
+static void usage(char * prog)
+{ fprintf(stderr,"usage: %s [--fused] [--jobs=N] [--watch]\n"
+                 "       [--symtab=text|json|csv] [--symtab-stats]\n"
+                 "       [--hash=shift|fnv1a|word] [--max-errors=N]\n"
+                 "       [--emit-interface=FILE] [--import=FILE]...\n"
+                 "       [--callgraph=dot|json] [--frames]\n"
+                 "       [--time-report[=json]] [--no-code]\n"
+                 "       [--no-simplify] [--no-peephole] [--no-ir]\n"
+                 "       [--no-sccp] [--no-licm] [--no-inline] [--dump-ir]\n"
+                 "       [--repeat=N] <filename>\n",prog);
+  exit(1);
+}
 
-int main( int argc, char * argv[] )
+/* Procedure compile runs every phase on file pgm */
+static void compile(char * pgm)
 { TreeNode * syntaxTree;
-  char pgm[120]; /* source code file name */
-  if (argc != 2)
-    { fprintf(stderr,"usage: %s <filename>\n",argv[0]);
-      exit(1);
-    }
-  strcpy(pgm,argv[1]) ;
-  if (strchr (pgm, '.') == NULL)
-     strcat(pgm,".tny");
+  int phase;
   source = fopen(pgm,"r");
   if (source==NULL)
   { fprintf(stderr,"File %s not found\n",pgm);
     exit(1);
   }
-  listing = stdout; /* send listing to screen */
+  lineno = 0;
+  Error = FALSE;
+  resetScanner();
   fprintf(listing,"\nC-MINUS COMPILATION: %s\n",pgm);
 #if NO_PARSE
   while (getToken()!=ENDFILE);
 #else
+  phase = enterPhase(ParsePhase);
   syntaxTree = parse();
+  leavePhase(phase);
   if (TraceParse) {
+    phase = enterPhase(ListingPhase);
     fprintf(listing,"\nSyntax tree:\n");
     printTree(syntaxTree);
+    leavePhase(phase);
   }
 #if !NO_ANALYZE
   if (! Error)
   { if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
+    phase = enterPhase(SymtabPhase);
     buildSymtab(syntaxTree);
+    leavePhase(phase);
     if (TraceAnalyze) fprintf(listing,"\nChecking Types...\n");
+    phase = enterPhase(TypeCheckPhase);
     typeCheck(syntaxTree);
+    leavePhase(phase);
     if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
+    phase = enterPhase(ListingPhase);
+    if (SymtabStats) DisplaySymtabStats(listing);
+    if (FrameListing && ! Error) listFrames(syntaxTree);
+    if (InterfaceOutput != NULL && ! Error) emitInterface(InterfaceOutput);
+    if (CallGraphFormat != CallGraphNone)
+      exportCallGraph(listing,buildCallGraph(syntaxTree),CallGraphFormat);
+    leavePhase(phase);
   }
 #if !NO_CODE
-  if (! Error)
+  /* there is no linker to join units, so the code of a
+   * unit would have neither the bodies of the functions
+   * it imports nor shared storage for the variables
+   */
+  if (! Error && GenerateCode && ImportCount > 0)
+  { fprintf(listing,"Code generation error: a unit that imports interfaces "
+                    "cannot be compiled to TM code; check it with --no-code\n");
+    Error = TRUE;
+  }
+  if (! Error && GenerateCode)
   { char * codefile;
-    int fnlen = strcspn(pgm,".");
+    char * ext = strrchr(pgm,'.');
+    int fnlen = ext != NULL && strchr(ext,'/') == NULL ? ext - pgm : (int) strlen(pgm);
     codefile = (char *) calloc(fnlen+4, sizeof(char));
     strncpy(codefile,pgm,fnlen);
     strcat(codefile,".tm");
-    code = fopen(codefile,"w");
-    if (code == NULL)
-    { printf("Unable to open %s\n",codefile);
-      exit(1);
+    if (Simplify)
+    { phase = enterPhase(OptimizePhase);
+      simplifyTree(syntaxTree);
+      leavePhase(phase);
+    }
+    if (UseIr || DumpIr)
+    { IrProgram * program;
+      phase = enterPhase(CodeGenPhase);
+      program = buildIr(syntaxTree);
+      leavePhase(phase);
+      if (Inline)
+      { phase = enterPhase(OptimizePhase);
+        inlineCalls(program,buildCallGraph(syntaxTree));
+        leavePhase(phase);
+      }
+      if (Sccp || Licm)
+      { phase = enterPhase(OptimizePhase);
+        buildSsa(program);
+        if (Sccp) propagateConstants(program);
+        if (Licm) hoistInvariants(program);
+        leavePhase(phase);
+      }
+      phase = enterPhase(CodeGenPhase);
+      if (DumpIr) printIr(listing,program);
+      if (Sccp || Licm) leaveSsa(program);
+      if (UseIr) tmGen(program,codefile);
+      freeIr(program);
+      leavePhase(phase);
+    }
+    if (! UseIr)
+    { phase = enterPhase(CodeGenPhase);
+      codeGen(syntaxTree,codefile);
+      leavePhase(phase);
+    }
+    if (Peephole)
+    { phase = enterPhase(OptimizePhase);
+      peephole();
+      leavePhase(phase);
     }
-    codeGen(syntaxTree,codefile);
-    fclose(code);
+    /* no code file for a unit with errors */
+    phase = enterPhase(CodeGenPhase);
+    if (! Error)
+    { code = fopen(codefile,"w");
+      if (code == NULL)
+      { printf("Unable to open %s\n",codefile);
+        exit(1);
+      }
+      writeCode();
+      fclose(code);
+    }
+    else discardCode();
+    leavePhase(phase);
+    free(codefile);
   }
 #endif
 #endif
 #endif
   fclose(source);
-  return 0;
+  phase = enterPhase(ListingPhase);
+  fflush(listing);
+  leavePhase(phase);
 }
 
+int main( int argc, char * argv[] )
+{ char pgm[120]; /* source code file name */
+  int watch = FALSE;
+  int repeat = 1;
+  int failed = FALSE;
+  int argi;
+  for (argi = 1; argi < argc - 1; argi++)
+  { if (strcmp(argv[argi],"--fused") == 0) FusedAnalyze = TRUE;
+    else if (strncmp(argv[argi],"--jobs=",7) == 0)
+    { CheckJobs = atoi(argv[argi]+7);
+      if (CheckJobs < 1) usage(argv[0]);
+    }
+    else if (strcmp(argv[argi],"--watch") == 0)
+      watch = IncrementalAnalyze = TRUE;
+    else if (strcmp(argv[argi],"--symtab=text") == 0) SymtabFormat = SymtabText;
+    else if (strcmp(argv[argi],"--symtab=json") == 0) SymtabFormat = SymtabJson;
+    else if (strcmp(argv[argi],"--symtab=csv") == 0) SymtabFormat = SymtabCsv;
+    else if (strcmp(argv[argi],"--symtab-stats") == 0) SymtabStats = TRUE;
+    else if (strcmp(argv[argi],"--hash=shift") == 0) SymtabHash = ShiftHash;
+    else if (strcmp(argv[argi],"--hash=fnv1a") == 0) SymtabHash = Fnv1aHash;
+    else if (strcmp(argv[argi],"--hash=word") == 0) SymtabHash = WordHash;
+    else if (strncmp(argv[argi],"--emit-interface=",17) == 0)
+      InterfaceOutput = argv[argi]+17;
+    else if (strncmp(argv[argi],"--import=",9) == 0)
+    { ImportFiles = (char **) realloc(ImportFiles,(ImportCount+1)*sizeof(char *));
+      ImportFiles[ImportCount++] = argv[argi]+9;
+    }
+    else if (strcmp(argv[argi],"--callgraph=dot") == 0) CallGraphFormat = CallGraphDot;
+    else if (strcmp(argv[argi],"--callgraph=json") == 0) CallGraphFormat = CallGraphJson;
+    else if (strcmp(argv[argi],"--frames") == 0) FrameListing = TRUE;
+    else if (strcmp(argv[argi],"--time-report") == 0) TimeReport = TimeReportText;
+    else if (strcmp(argv[argi],"--time-report=json") == 0) TimeReport = TimeReportJson;
+    else if (strcmp(argv[argi],"--no-code") == 0) GenerateCode = FALSE;
+    else if (strcmp(argv[argi],"--no-simplify") == 0) Simplify = FALSE;
+    else if (strcmp(argv[argi],"--no-peephole") == 0) Peephole = FALSE;
+    else if (strcmp(argv[argi],"--no-ir") == 0) UseIr = FALSE;
+    else if (strcmp(argv[argi],"--no-sccp") == 0) Sccp = FALSE;
+    else if (strcmp(argv[argi],"--no-licm") == 0) Licm = FALSE;
+    else if (strcmp(argv[argi],"--no-inline") == 0) Inline = FALSE;
+    else if (strcmp(argv[argi],"--dump-ir") == 0) DumpIr = TRUE;
+    else if (strncmp(argv[argi],"--max-errors=",13) == 0)
+    { MaxErrors = atoi(argv[argi]+13);
+      if (MaxErrors < 1) usage(argv[0]);
+    }
+    else if (strncmp(argv[argi],"--repeat=",9) == 0)
+    { repeat = atoi(argv[argi]+9);
+      if (repeat < 1) usage(argv[0]);
+    }
+    else usage(argv[0]);
+  }
+  if (argi != argc - 1) usage(argv[0]);
+  strcpy(pgm,argv[argi]) ;
+  if (strchr (pgm, '.') == NULL)
+     strcat(pgm,".tny");
+  listing = stdout; /* send listing to screen */
+  /* --repeat compiles the file several times in one
+   * process; each unit's memory is released before
+   * the next one starts
+   */
+  while (repeat-- > 0)
+  { compile(pgm);
+    if (Error) failed = TRUE;
+    freeUnit();
+  }
+  if (TimeReport != TimeReportNone) printTimeReport(stderr,TimeReport);
+  /* with --watch, recompile whenever the file changes
+   * (its modification time, to the nanosecond, or its
+   * size); unchanged functions are not analyzed again,
+   * and keep their memory in arenas of their own
+   */
+  if (watch)
+  { struct stat info;
+    struct timespec lastChange = { 0, 0 };
+    off_t lastSize = -1;
+    if (stat(pgm,&info) == 0)
+    { lastChange = info.st_mtim;
+      lastSize = info.st_size;
+    }
+    for (;;)
+    { usleep(200000);
+      if (stat(pgm,&info) != 0) continue;
+      if (info.st_mtim.tv_sec == lastChange.tv_sec &&
+          info.st_mtim.tv_nsec == lastChange.tv_nsec &&
+          info.st_size == lastSize) continue;
+      lastChange = info.st_mtim;
+      lastSize = info.st_size;
+      resetTimeReport();
+      compile(pgm);
+      freeUnit();
+      if (TimeReport != TimeReportNone) printTimeReport(stderr,TimeReport);
+    }
+  }
+  /* a unit with errors exits with status 1 */
+  return failed ? 1 : 0;
+}
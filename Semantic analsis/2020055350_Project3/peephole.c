@@ -0,0 +1,215 @@
+/****************************************************/
+/* File: peephole.c                                 */
+/* Peephole optimization of the TM code in the      */
+/* code buffer                                      */
+/****************************************************/
+
+#include "globals.h"
+#include "code.h"
+#include "peephole.h"
+
+/* isLabel[i] tells whether some instruction refers to
+ * location i, so that control can reach it other than
+ * from i-1; it is worked out again for every round
+ */
+static char *isLabel = NULL;
+
+static int isOp(Instruction *in, char *op)
+{
+	return in->op != NULL && strcmp(in->op, op) == 0;
+}
+
+static int isCondJump(Instruction *in)
+{
+	return in->op != NULL && in->op[0] == 'J';
+}
+
+/* isJump tells whether in is an unconditional jump to
+ * the location in its target
+ */
+static int isJump(Instruction *in)
+{
+	return isOp(in, "LDA") && in->r == pc && in->target >= 0;
+}
+
+/* endsBlock tells whether control never goes on from in
+ * to the next instruction
+ */
+static int endsBlock(Instruction *in)
+{
+	return isOp(in, "HALT") || (in->isRM && in->r == pc && !isCondJump(in));
+}
+
+/* writes tells whether in sets register reg */
+static int writes(Instruction *in, int reg)
+{
+	if (reg == pc && (endsBlock(in) || isCondJump(in))) return TRUE;
+	if (isOp(in, "ST") || isOp(in, "OUT") || isOp(in, "HALT") || isCondJump(in)) return FALSE;
+	return in->r == reg;
+}
+
+/* reads tells whether in uses the value of register reg */
+static int reads(Instruction *in, int reg)
+{
+	if (isOp(in, "HALT") || isOp(in, "IN")) return FALSE;
+	if (isOp(in, "OUT")) return in->r == reg;
+	if (!in->isRM) return in->s == reg || in->t == reg;
+	if (isOp(in, "LDC")) return FALSE;
+	if (isOp(in, "ST") || isCondJump(in)) return in->r == reg || in->s == reg;
+	return in->s == reg;
+}
+
+static void findLabels(void)
+{
+	int i;
+	isLabel = realloc(isLabel, codeSize + 1);
+	memset(isLabel, 0, codeSize + 1);
+	isLabel[0] = TRUE;
+	for (i = 0; i < codeSize; i++)
+		if (codeBuffer[i].op != NULL && codeBuffer[i].target >= 0 && codeBuffer[i].target <= codeSize)
+			isLabel[codeBuffer[i].target] = TRUE;
+}
+
+/* threadJump makes a jump at i that lands on a jump go
+ * to where that one leads, and an unconditional jump
+ * that lands on a return or HALT do the same itself
+ */
+static int threadJump(int i)
+{
+	Instruction *in = &codeBuffer[i];
+	int target = in->target, steps = 0;
+	Instruction *to;
+
+	if (!isJump(in) && !isCondJump(in)) return FALSE;
+	while (target >= 0 && target < codeSize && isJump(&codeBuffer[target]))
+	{
+		/* a loop of jumps is left as it is */
+		if (target == i || ++steps > codeSize) return FALSE;
+		target = codeBuffer[target].target;
+	}
+	if (target != in->target)
+	{
+		in->target = target;
+		return TRUE;
+	}
+	if (isJump(in) && target < codeSize)
+	{
+		to = &codeBuffer[target];
+		if (isOp(to, "HALT") || (isOp(to, "LD") && to->r == pc && to->s != pc))
+		{
+			char *comment = in->comment;
+			*in = *to;
+			in->comment = comment;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* jumpToNext removes a jump at i to i+1 */
+static int jumpToNext(int i)
+{
+	Instruction *in = &codeBuffer[i];
+	if ((isJump(in) || isCondJump(in)) && in->target == i + 1)
+	{
+		in->op = NULL;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* unreachable removes the code after an instruction at
+ * i that does not go on, up to the next label
+ */
+static int unreachable(int i)
+{
+	int j, changed = FALSE;
+	if (!endsBlock(&codeBuffer[i])) return FALSE;
+	for (j = i + 1; j < codeSize && !isLabel[j]; j++)
+		if (codeBuffer[j].op != NULL)
+		{
+			codeBuffer[j].op = NULL;
+			changed = TRUE;
+		}
+	return changed;
+}
+
+/* reload replaces a load from the slot stored or loaded
+ * at i by a copy of the register that holds it (or by
+ * nothing), if nothing in between is reached from
+ * elsewhere or changes either register. A store off the
+ * same base register to another offset cannot change
+ * the slot; any other store may
+ */
+static int reload(int i)
+{
+	Instruction *from = &codeBuffer[i];
+	int j;
+	if (!(isOp(from, "ST") || isOp(from, "LD")) || from->s == pc || from->r == pc
+		|| (isOp(from, "LD") && from->r == from->s))
+		return FALSE;
+	for (j = i + 1; j < codeSize && !isLabel[j]; j++)
+	{
+		Instruction *in = &codeBuffer[j];
+		if (in->op == NULL) continue;
+		if (isOp(in, "LD") && in->d == from->d && in->s == from->s)
+		{
+			if (in->r == from->r) in->op = NULL;
+			else
+			{
+				in->op = "LDA";
+				in->d = 0;
+				in->s = from->r;
+			}
+			return TRUE;
+		}
+		if (isOp(in, "ST") && (in->s != from->s || in->d == from->d)) return FALSE;
+		if (endsBlock(in) || writes(in, from->r) || writes(in, from->s)) return FALSE;
+	}
+	return FALSE;
+}
+
+/* deadLoad removes a load of a constant or an address at
+ * i whose register is set again before it is read
+ */
+static int deadLoad(int i)
+{
+	Instruction *ld = &codeBuffer[i];
+	int j;
+	if (!(isOp(ld, "LDC") || isOp(ld, "LDA")) || ld->r == pc) return FALSE;
+	for (j = i + 1; j < codeSize; j++)
+	{
+		Instruction *in = &codeBuffer[j];
+		if (in->op == NULL) continue;
+		if (isOp(in, "HALT")) break;
+		if (reads(in, ld->r) || isCondJump(in) || endsBlock(in)) return FALSE;
+		if (writes(in, ld->r)) break;
+	}
+	if (j == codeSize) return FALSE;
+	ld->op = NULL;
+	return TRUE;
+}
+
+int peephole(void)
+{
+	int before = codeSize, changed, i;
+	do
+	{
+		changed = FALSE;
+		findLabels();
+		for (i = 0; i < codeSize; i++)
+		{
+			if (codeBuffer[i].op == NULL) continue;
+			changed |= threadJump(i);
+			changed |= jumpToNext(i);
+			if (codeBuffer[i].op == NULL) continue;
+			changed |= unreachable(i);
+			changed |= reload(i);
+			changed |= deadLoad(i);
+		}
+		removeInstructions();
+	} while (changed);
+	free(isLabel);
+	isLabel = NULL;
+	return before - codeSize;
+}
@@ -0,0 +1,22 @@
+/****************************************************/
+/* File: peephole.h                                 */
+/* Peephole optimization of the TM code in the      */
+/* code buffer                                      */
+/****************************************************/
+
+#ifndef _PEEPHOLE_H_
+#define _PEEPHOLE_H_
+
+/* Function peephole rewrites the code emitted so far,
+ * before writeCode puts it in the code file, and returns
+ * the number of instructions it removed. Jumps to jumps
+ * are threaded, jumps to the next instruction and code
+ * no jump reaches are removed, a load from a slot just
+ * stored or loaded is replaced by the register holding
+ * it, and constant loads whose register is set again
+ * before it is read are dropped. The rules are applied
+ * until none applies
+ */
+int peephole(void);
+
+#endif
@@ -21,4 +21,9 @@ extern char* tokenString;
  */
 TokenType getToken(void);
 
+/* procedure resetScanner makes the next getToken
+ * start over at the beginning of source
+ */
+void resetScanner(void);
+
 #endif
@@ -0,0 +1,361 @@
+/****************************************************/
+/* File: sccp.c                                     */
+/* Sparse conditional constant propagation over     */
+/* the SSA form                                     */
+/****************************************************/
+
+#include "globals.h"
+#include "ir.h"
+#include "sccp.h"
+#include <limits.h>
+
+/* what is known of the value of a vreg: nothing yet, as
+ * no assignment to it can be reached (Undefined), one
+ * constant, or that it varies
+ */
+typedef enum
+{
+	Undefined,
+	Constant,
+	Varying
+} Level;
+
+typedef struct
+{
+	Level level;
+	int val;
+} Value;
+
+typedef struct
+{
+	IrInstr *instr;
+	IrBlock *block;
+} Use;
+
+static IrFunction *function = NULL;
+static Value *values = NULL;
+
+/* the uses of vreg v are uses[firstUse[v]] up to
+ * uses[firstUse[v+1]]
+ */
+static Use *uses = NULL;
+static int *firstUse = NULL;
+
+/* edgeTaken tells, for predecessor n of block b, whether
+ * the edge from it can be taken: edgeTaken[firstPred[b->id]+n].
+ * A block that can be reached has its mark set
+ */
+static char *edgeTaken = NULL;
+static int *firstPred = NULL;
+
+/* edges and vregs still to be looked at */
+static IrBlock **edgeWork = NULL;
+static int edgeCount = 0, edgeCapacity = 0;
+static int *vregWork = NULL;
+static int vregCount = 0, vregCapacity = 0;
+
+static Value constant(int val)
+{
+	Value v;
+	v.level = Constant;
+	v.val = val;
+	return v;
+}
+
+static Value level(Level l)
+{
+	Value v;
+	v.level = l;
+	v.val = 0;
+	return v;
+}
+
+static Value meet(Value a, Value b)
+{
+	if (a.level == Undefined) return b;
+	if (b.level == Undefined) return a;
+	if (a.level == Varying || b.level == Varying || a.val != b.val) return level(Varying);
+	return a;
+}
+
+static Value operand(IrOperand o)
+{
+	if (o.kind == IrImm) return constant(o.val);
+	if (o.kind == IrReg) return values[o.val];
+	return level(Varying);
+}
+
+/* holds tells whether a relop b, as the compare of
+ * the generated code finds it
+ */
+static int holds(TokenType relop, int a, int b)
+{
+	switch (relop)
+	{
+		case LT: return a < b;
+		case LE: return a <= b;
+		case GT: return a > b;
+		case GE: return a >= b;
+		case EQ: return a == b;
+		default: return a != b;
+	}
+}
+
+/* evaluate gives the value instruction i assigns from
+ * what is known of its operands
+ */
+static Value evaluate(IrInstr *i)
+{
+	Value a = operand(i->a), b = operand(i->b);
+	switch (i->op)
+	{
+		case IrCopy:
+			return a;
+		case IrAdd:
+		case IrSub:
+		case IrMul:
+		case IrDiv:
+		case IrCmp:
+			if (i->op == IrMul && ((a.level == Constant && a.val == 0) || (b.level == Constant && b.val == 0)))
+				return constant(0);
+			if (a.level == Varying || b.level == Varying) return level(Varying);
+			if (a.level == Undefined || b.level == Undefined) return level(Undefined);
+			switch (i->op)
+			{
+				case IrAdd: return constant((int)((unsigned)a.val + (unsigned)b.val));
+				case IrSub: return constant((int)((unsigned)a.val - (unsigned)b.val));
+				case IrMul: return constant((int)((unsigned)a.val * (unsigned)b.val));
+				case IrDiv:
+					/* TM stops on these */
+					if (b.val == 0 || (a.val == INT_MIN && b.val == -1)) return level(Varying);
+					return constant(a.val / b.val);
+				default: return constant(holds(i->relop, a.val, b.val));
+			}
+		default:
+			return level(Varying);
+	}
+}
+
+static void pushEdge(IrBlock *from, IrBlock *to)
+{
+	if (edgeCount == edgeCapacity)
+	{
+		edgeCapacity = edgeCapacity == 0 ? 64 : 2 * edgeCapacity;
+		edgeWork = realloc(edgeWork, 2 * edgeCapacity * sizeof(IrBlock *));
+	}
+	edgeWork[2 * edgeCount] = from;
+	edgeWork[2 * edgeCount + 1] = to;
+	edgeCount++;
+}
+
+static void lower(int v, Value value)
+{
+	value = meet(values[v], value);
+	if (value.level == values[v].level && value.val == values[v].val) return;
+	values[v] = value;
+	if (vregCount == vregCapacity)
+	{
+		vregCapacity = vregCapacity == 0 ? 64 : 2 * vregCapacity;
+		vregWork = realloc(vregWork, vregCapacity * sizeof(int));
+	}
+	vregWork[vregCount++] = v;
+}
+
+/* Procedure visit looks at instruction i of block b,
+ * which can be reached
+ */
+static void visit(IrInstr *i, IrBlock *b)
+{
+	Value x, y;
+	int n;
+	switch (i->op)
+	{
+		case IrJump:
+			pushEdge(b, b->succ[0]);
+			break;
+		case IrBranch:
+			x = operand(i->a);
+			y = operand(i->b);
+			if (x.level == Undefined || y.level == Undefined) break;
+			if (x.level == Constant && y.level == Constant)
+				pushEdge(b, b->succ[holds(i->relop, x.val, y.val) ? 0 : 1]);
+			else
+			{
+				pushEdge(b, b->succ[0]);
+				pushEdge(b, b->succ[1]);
+			}
+			break;
+		case IrPhi:
+			x = level(Undefined);
+			for (n = 0; n < i->nargs; n++)
+				if (edgeTaken[firstPred[b->id] + n]) x = meet(x, operand(i->args[n]));
+			lower(i->dest, x);
+			break;
+		default:
+			if (i->dest >= 0) lower(i->dest, evaluate(i));
+			break;
+	}
+}
+
+/* findUses fills uses, and sets the vregs assigned
+ * nowhere varying: they are parameters, or variables
+ * read before they are set
+ */
+static void findUses(void)
+{
+	int nv = function->nvregs, k, n, v;
+	int *assigned = calloc(nv, sizeof(int));
+	IrInstr *i;
+	firstUse = calloc(nv + 1, sizeof(int));
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			IrOperand o[3];
+			o[0] = i->a;
+			o[1] = i->b;
+			o[2] = i->c;
+			for (n = 0; n < 3 + i->nargs; n++)
+			{
+				IrOperand u = n < 3 ? o[n] : i->args[n - 3];
+				if (u.kind == IrReg) firstUse[u.val + 1]++;
+			}
+			if (i->dest >= 0) assigned[i->dest] = TRUE;
+		}
+	for (v = 0; v < nv; v++) firstUse[v + 1] += firstUse[v];
+	uses = malloc((firstUse[nv] > 0 ? firstUse[nv] : 1) * sizeof(Use));
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			IrOperand o[3];
+			o[0] = i->a;
+			o[1] = i->b;
+			o[2] = i->c;
+			for (n = 0; n < 3 + i->nargs; n++)
+			{
+				IrOperand u = n < 3 ? o[n] : i->args[n - 3];
+				if (u.kind != IrReg) continue;
+				uses[firstUse[u.val]].instr = i;
+				uses[firstUse[u.val]++].block = function->blocks[k];
+			}
+		}
+	for (v = nv; v > 0; v--) firstUse[v] = firstUse[v - 1];
+	firstUse[0] = 0;
+	values = malloc(nv * sizeof(Value));
+	for (v = 0; v < nv; v++) values[v] = level(assigned[v] ? Undefined : Varying);
+	free(assigned);
+}
+
+/* Procedure propagate runs the worklists dry */
+static void propagate(void)
+{
+	IrInstr *i;
+	int n;
+	function->blocks[0]->mark = TRUE;
+	for (i = function->blocks[0]->first; i != NULL; i = i->next) visit(i, function->blocks[0]);
+	while (edgeCount > 0 || vregCount > 0)
+	{
+		if (edgeCount > 0)
+		{
+			IrBlock *from, *to;
+			edgeCount--;
+			from = edgeWork[2 * edgeCount];
+			to = edgeWork[2 * edgeCount + 1];
+			for (n = 0; to->preds[n] != from; n++)
+				;
+			if (edgeTaken[firstPred[to->id] + n]) continue;
+			edgeTaken[firstPred[to->id] + n] = TRUE;
+			if (!to->mark)
+			{
+				to->mark = TRUE;
+				for (i = to->first; i != NULL; i = i->next) visit(i, to);
+			}
+			else
+				for (i = to->first; i != NULL && i->op == IrPhi; i = i->next) visit(i, to);
+		}
+		else
+		{
+			int v = vregWork[--vregCount];
+			for (n = firstUse[v]; n < firstUse[v + 1]; n++)
+				if (uses[n].block->mark) visit(uses[n].instr, uses[n].block);
+		}
+	}
+}
+
+static void substitute(IrOperand *o)
+{
+	if (o->kind == IrReg && values[o->val].level == Constant) *o = irImm(values[o->val].val);
+}
+
+/* Procedure rewrite puts in what was found */
+static void rewrite(void)
+{
+	int k, n;
+	for (k = 0; k < function->nblocks; k++)
+	{
+		IrBlock *b = function->blocks[k];
+		IrInstr *i = b->first;
+		if (!b->mark) continue;
+		while (i != NULL)
+		{
+			IrInstr *next = i->next;
+			if (i->dest >= 0 && values[i->dest].level == Constant)
+			{
+				removeInstr(b, i);
+				freeInstr(i);
+				i = next;
+				continue;
+			}
+			substitute(&i->a);
+			substitute(&i->b);
+			substitute(&i->c);
+			for (n = 0; n < i->nargs; n++) substitute(&i->args[n]);
+			if (i->op == IrBranch && i->a.kind == IrImm && i->b.kind == IrImm)
+			{
+				int taken = holds(i->relop, i->a.val, i->b.val) ? 0 : 1;
+				if (b->succ[1 - taken] != b->succ[taken]) removeEdge(b, b->succ[1 - taken]);
+				b->succ[0] = b->succ[taken];
+				b->succ[1] = NULL;
+				i->op = IrJump;
+				i->a.kind = i->b.kind = IrNone;
+			}
+			i = next;
+		}
+	}
+	removeUnreachable(function);
+	mergeBlocks(function);
+}
+
+static void propagateFunction(IrFunction *f)
+{
+	int k, n = 0;
+	function = f;
+	firstPred = malloc((f->nblocks + 1) * sizeof(int));
+	for (k = 0; k < f->nblocks; k++)
+	{
+		f->blocks[k]->mark = FALSE;
+		firstPred[k] = n;
+		n += f->blocks[k]->npreds;
+	}
+	firstPred[f->nblocks] = n;
+	edgeTaken = calloc(n > 0 ? n : 1, 1);
+	findUses();
+	propagate();
+	rewrite();
+	free(firstPred);
+	free(edgeTaken);
+	free(firstUse);
+	free(uses);
+	free(values);
+	function = NULL;
+}
+
+void propagateConstants(IrProgram *program)
+{
+	IrFunction *f;
+	for (f = program->functions; f != NULL; f = f->next) propagateFunction(f);
+	free(edgeWork);
+	free(vregWork);
+	edgeWork = NULL;
+	vregWork = NULL;
+	edgeCount = edgeCapacity = vregCount = vregCapacity = 0;
+}
@@ -0,0 +1,22 @@
+/****************************************************/
+/* File: sccp.h                                     */
+/* Sparse conditional constant propagation over     */
+/* the SSA form                                     */
+/****************************************************/
+
+#ifndef _SCCP_H_
+#define _SCCP_H_
+
+#include "ir.h"
+
+/* Procedure propagateConstants finds the vregs of each
+ * function of program, in SSA form, that hold one
+ * constant on every path that can be taken, assuming
+ * branches go only where their operands allow. Their
+ * uses become the constant, their assignments go, and
+ * so do the branches never taken and the blocks only
+ * they reach
+ */
+void propagateConstants(IrProgram *program);
+
+#endif
@@ -0,0 +1,182 @@
+/****************************************************/
+/* File: simplify.c                                 */
+/* Constant folding and algebraic simplification    */
+/* of the syntax tree                               */
+/****************************************************/
+
+#include "globals.h"
+#include "simplify.h"
+#include <limits.h>
+
+/* canDrop tells whether evaluating t has no effect, so
+ * that it may be left out: it assigns nothing, calls
+ * nothing and divides only by nonzero constants
+ */
+static int canDrop(TreeNode *t)
+{
+	int i;
+	if (t == NULL) return TRUE;
+	if (t->kind == AssignExpr || t->kind == CallExpr) return FALSE;
+	if (t->kind == OpExpr && t->token == OVER
+		&& (t->child[1]->kind != ConstExpr || t->child[1]->val == 0 || t->child[1]->val == -1))
+		return FALSE;
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (!canDrop(t->child[i])) return FALSE;
+	return TRUE;
+}
+
+/* sameValue tells whether the expressions a and b, which
+ * can be dropped, always have the same value: names in
+ * one expression are in one scope
+ */
+static int sameValue(TreeNode *a, TreeNode *b)
+{
+	if (a == NULL || b == NULL) return a == b;
+	if (a->kind != b->kind) return FALSE;
+	switch (a->kind)
+	{
+		case ConstExpr:
+			return a->val == b->val;
+		case VarAccessExpr:
+			return strcmp(a->name, b->name) == 0 && sameValue(a->child[0], b->child[0]);
+		case OpExpr:
+			return a->token == b->token && sameValue(a->child[0], b->child[0]) && sameValue(a->child[1], b->child[1]);
+		default:
+			return FALSE;
+	}
+}
+
+/* foldOp computes a op b as the generated code would
+ * into result: arithmetic wraps, and comparisons are
+ * exact, as the compare of cgen and tmgen is. It fails
+ * where TM would stop with an error
+ */
+static int foldOp(TokenType op, int a, int b, int *result)
+{
+	switch (op)
+	{
+		case PLUS: *result = (int)((unsigned)a + (unsigned)b); return TRUE;
+		case MINUS: *result = (int)((unsigned)a - (unsigned)b); return TRUE;
+		case TIMES: *result = (int)((unsigned)a * (unsigned)b); return TRUE;
+		case OVER:
+			if (b == 0 || (a == INT_MIN && b == -1)) return FALSE;
+			*result = a / b;
+			return TRUE;
+		case LT: *result = a < b; return TRUE;
+		case LE: *result = a <= b; return TRUE;
+		case GT: *result = a > b; return TRUE;
+		case GE: *result = a >= b; return TRUE;
+		case EQ: *result = a == b; return TRUE;
+		case NE: *result = a != b; return TRUE;
+		default: return FALSE;
+	}
+}
+
+static void makeConst(TreeNode *t, int val)
+{
+	int i;
+	t->kind = ConstExpr;
+	t->val = val;
+	t->token = 0;
+	t->name = NULL;
+	for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
+}
+
+/* replaceBy puts operand e in the place of t, which
+ * keeps its position in a list of arguments
+ */
+static void replaceBy(TreeNode *t, TreeNode *e)
+{
+	TreeNode *sibling = t->sibling;
+	TreeNode *lastSibling = t->lastSibling;
+	*t = *e;
+	t->sibling = sibling;
+	t->lastSibling = lastSibling;
+}
+
+static int isConst(TreeNode *t, int val)
+{
+	return t->kind == ConstExpr && t->val == val;
+}
+
+/* simplifyOp simplifies operation t, whose operands are
+ * already simplified
+ */
+static void simplifyOp(TreeNode *t)
+{
+	TreeNode *left = t->child[0];
+	TreeNode *right = t->child[1];
+	int result;
+
+	if (left->kind == ConstExpr && right->kind == ConstExpr)
+	{
+		if (foldOp(t->token, left->val, right->val, &result)) makeConst(t, result);
+		return;
+	}
+	/* a constant goes to the right of + and * */
+	if ((t->token == PLUS || t->token == TIMES) && left->kind == ConstExpr)
+	{
+		t->child[0] = right;
+		t->child[1] = left;
+		left = t->child[0];
+		right = t->child[1];
+	}
+	if (right->kind == ConstExpr)
+	{
+		/* (x + c1) + c2 is x + (c1 + c2), and likewise
+		 * for - and for *; TM arithmetic wraps around,
+		 * so the grouping does not change the value
+		 */
+		if ((t->token == PLUS || t->token == MINUS) && left->kind == OpExpr
+			&& (left->token == PLUS || left->token == MINUS) && left->child[1]->kind == ConstExpr)
+		{
+			int inner = left->token == PLUS ? left->child[1]->val : (int)(0u - (unsigned)left->child[1]->val);
+			int outer = t->token == PLUS ? right->val : (int)(0u - (unsigned)right->val);
+			t->token = PLUS;
+			right->val = (int)((unsigned)inner + (unsigned)outer);
+			t->child[0] = left = left->child[0];
+		}
+		else if (t->token == TIMES && left->kind == OpExpr && left->token == TIMES && left->child[1]->kind == ConstExpr)
+		{
+			right->val = (int)((unsigned)left->child[1]->val * (unsigned)right->val);
+			t->child[0] = left = left->child[0];
+		}
+		if (((t->token == PLUS || t->token == MINUS) && right->val == 0)
+			|| ((t->token == TIMES || t->token == OVER) && right->val == 1))
+		{
+			replaceBy(t, left);
+			return;
+		}
+		if (t->token == TIMES && right->val == 0 && canDrop(left))
+		{
+			makeConst(t, 0);
+			return;
+		}
+	}
+	if (t->token == TIMES && isConst(left, 0) && canDrop(right))
+	{
+		makeConst(t, 0);
+		return;
+	}
+	if (t->token != PLUS && t->token != TIMES && t->token != OVER && canDrop(left) && sameValue(left, right))
+	{
+		/* x - x, and x compared with itself */
+		makeConst(t, t->token == LE || t->token == GE || t->token == EQ);
+		return;
+	}
+}
+
+static void simplifyNode(TreeNode *t)
+{
+	int i;
+	for (; t != NULL; t = t->sibling)
+	{
+		for (i = 0; i < MAXCHILDREN; i++) simplifyNode(t->child[i]);
+		if (t->kind == OpExpr) simplifyOp(t);
+	}
+}
+
+void simplifyTree(TreeNode *syntaxTree)
+{
+	simplifyNode(syntaxTree);
+}
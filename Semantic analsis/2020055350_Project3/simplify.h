@@ -0,0 +1,23 @@
+/****************************************************/
+/* File: simplify.h                                 */
+/* Constant folding and algebraic simplification    */
+/* of the syntax tree                               */
+/****************************************************/
+
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include "globals.h"
+
+/* Procedure simplifyTree rewrites the expressions of an
+ * analyzed, error-free syntax tree in place. Operations
+ * on constants are folded with the wrap-around integer
+ * arithmetic of TM, except a division by zero (or of the
+ * smallest int by -1), which is left to fail at run time.
+ * Identities such as x+0, x*1 and x-x are applied, and
+ * constants in chains like x+1+2 are gathered. Nothing
+ * whose evaluation could have an effect is removed
+ */
+void simplifyTree(TreeNode *syntaxTree);
+
+#endif
@@ -0,0 +1,468 @@
+/****************************************************/
+/* File: ssa.c                                      */
+/* Static single assignment form of the             */
+/* intermediate representation                      */
+/****************************************************/
+
+#include "globals.h"
+#include "ir.h"
+#include "ssa.h"
+
+/********************************************/
+/* dominators                               */
+/********************************************/
+
+/* postorder numbers the blocks reached from b after
+ * their successors, and lists them in order
+ */
+static void postorder(IrBlock *b, int *number, IrBlock **order, int *count)
+{
+	int k;
+	b->mark = TRUE;
+	for (k = 0; k < 2; k++)
+		if (b->succ[k] != NULL && !b->succ[k]->mark) postorder(b->succ[k], number, order, count);
+	number[b->id] = *count;
+	order[(*count)++] = b;
+}
+
+static int intersect(int *idom, int *number, int a, int b)
+{
+	while (a != b)
+	{
+		while (number[a] < number[b]) a = idom[a];
+		while (number[b] < number[a]) b = idom[b];
+	}
+	return a;
+}
+
+/* the iterative algorithm of Cooper, Harvey and
+ * Kennedy, over the blocks in reverse postorder
+ */
+int *findDominators(IrFunction *f)
+{
+	int *idom = malloc(f->nblocks * sizeof(int));
+	int *number = malloc(f->nblocks * sizeof(int));
+	IrBlock **order = malloc(f->nblocks * sizeof(IrBlock *));
+	int k, n, count = 0, changed = TRUE;
+	for (k = 0; k < f->nblocks; k++)
+	{
+		f->blocks[k]->mark = FALSE;
+		idom[k] = -1;
+		number[k] = -1;
+	}
+	postorder(f->blocks[0], number, order, &count);
+	idom[0] = 0;
+	while (changed)
+	{
+		changed = FALSE;
+		for (k = count - 2; k >= 0; k--)
+		{
+			IrBlock *b = order[k];
+			int d = -1;
+			for (n = 0; n < b->npreds; n++)
+			{
+				int p = b->preds[n]->id;
+				if (idom[p] < 0) continue;
+				d = d < 0 ? p : intersect(idom, number, p, d);
+			}
+			if (idom[b->id] != d)
+			{
+				idom[b->id] = d;
+				changed = TRUE;
+			}
+		}
+	}
+	free(number);
+	free(order);
+	return idom;
+}
+
+int dominates(int *idom, int a, int b)
+{
+	while (b != a && idom[b] != b) b = idom[b];
+	return a == b;
+}
+
+/********************************************/
+/* construction                             */
+/********************************************/
+
+static IrFunction *function = NULL;
+static int variableCount = 0; /* vregs before versions were made */
+static int *isVariable = NULL;
+static int *idom = NULL;
+
+/* current gives the version of each variable reaching
+ * the point renamed; undo records the versions it
+ * replaced, to go back at the end of a block
+ */
+static int *current = NULL;
+static int *undo = NULL;
+static int undoCount = 0, undoCapacity = 0;
+
+/* children lists the blocks each block immediately
+ * dominates, from firstChild[id] to firstChild[id+1]
+ */
+static int *children = NULL;
+static int *firstChild = NULL;
+
+static int variableOf(IrOperand o)
+{
+	return o.kind == IrReg && o.val < variableCount && isVariable[o.val] ? o.val : -1;
+}
+
+/* findChildren fills children from idom */
+static void findChildren(void)
+{
+	int n = function->nblocks, k;
+	firstChild = calloc(n + 1, sizeof(int));
+	children = malloc(n * sizeof(int));
+	for (k = 1; k < n; k++) firstChild[idom[k] + 1]++;
+	for (k = 0; k < n; k++) firstChild[k + 1] += firstChild[k];
+	for (k = 1; k < n; k++) children[firstChild[idom[k]]++] = k;
+	for (k = n; k > 0; k--) firstChild[k] = firstChild[k - 1];
+	firstChild[0] = 0;
+}
+
+/* Procedure insertPhis places a phi for variable v at
+ * the iterated dominance frontier of the blocks that
+ * assign it. frontier lists the dominance frontier of
+ * each block from frontierStart[id] to
+ * frontierStart[id+1]; work, placed and queued are
+ * scratch arrays by block
+ */
+static void insertPhis(int v, int *frontier, int *frontierStart, int *work, int *placed, int *queued)
+{
+	int count = 0, k, n;
+	IrInstr *i;
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+			if (i->dest == v && queued[k] != v + 1)
+			{
+				queued[k] = v + 1;
+				work[count++] = k;
+			}
+	while (count > 0)
+	{
+		int b = work[--count];
+		for (n = frontierStart[b]; n < frontierStart[b + 1]; n++)
+		{
+			int d = frontier[n];
+			IrBlock *join = function->blocks[d];
+			IrInstr *phi;
+			if (placed[d] == v + 1) continue;
+			placed[d] = v + 1;
+			phi = newInstr(IrPhi, v);
+			phi->nargs = join->npreds;
+			phi->args = malloc(join->npreds * sizeof(IrOperand));
+			for (k = 0; k < join->npreds; k++) phi->args[k] = irReg(v);
+			insertBefore(join, join->first, phi);
+			if (queued[d] != v + 1)
+			{
+				queued[d] = v + 1;
+				work[count++] = d;
+			}
+		}
+	}
+}
+
+/* findFrontiers returns the dominance frontier of every
+ * block, as insertPhis takes it
+ */
+static int *findFrontiers(int **start)
+{
+	int n = function->nblocks, k, p, total = 0, capacity = 16;
+	int *frontier;
+	int *last = malloc(n * sizeof(int));
+	int *count = calloc(n + 1, sizeof(int));
+	int *pairs = malloc(2 * capacity * sizeof(int));
+	/* collect (block, join) pairs, then sort by block */
+	for (k = 0; k < n; k++) last[k] = -1;
+	for (k = 0; k < n; k++)
+	{
+		IrBlock *b = function->blocks[k];
+		if (b->npreds < 2) continue;
+		for (p = 0; p < b->npreds; p++)
+		{
+			int runner = b->preds[p]->id;
+			while (runner != idom[k])
+			{
+				if (last[runner] != k)
+				{
+					last[runner] = k;
+					if (total == capacity)
+					{
+						capacity *= 2;
+						pairs = realloc(pairs, 2 * capacity * sizeof(int));
+					}
+					pairs[2 * total] = runner;
+					pairs[2 * total + 1] = k;
+					total++;
+					count[runner + 1]++;
+				}
+				runner = idom[runner];
+			}
+		}
+	}
+	for (k = 0; k < n; k++) count[k + 1] += count[k];
+	frontier = malloc((total > 0 ? total : 1) * sizeof(int));
+	for (k = 0; k < n; k++) last[k] = count[k];
+	for (k = 0; k < total; k++) frontier[last[pairs[2 * k]]++] = pairs[2 * k + 1];
+	free(last);
+	free(pairs);
+	*start = count;
+	return frontier;
+}
+
+static void replace(IrOperand *o)
+{
+	int v = variableOf(*o);
+	if (v >= 0) o->val = current[v];
+}
+
+static void define(IrInstr *i)
+{
+	int v = i->dest;
+	if (v < 0 || v >= variableCount || !isVariable[v]) return;
+	if (undoCount == undoCapacity)
+	{
+		undoCapacity = undoCapacity == 0 ? 64 : 2 * undoCapacity;
+		undo = realloc(undo, 2 * undoCapacity * sizeof(int));
+	}
+	undo[2 * undoCount] = v;
+	undo[2 * undoCount + 1] = current[v];
+	undoCount++;
+	current[v] = newVreg(function, function->vregs[v].name, function->vregs[v].word, v);
+	i->dest = current[v];
+}
+
+/* Procedure renameBlock gives the uses and assignments
+ * in block b and the blocks it dominates their versions
+ */
+static void renameBlock(IrBlock *b)
+{
+	int mark = undoCount, k, n;
+	IrInstr *i;
+	for (i = b->first; i != NULL; i = i->next)
+	{
+		if (i->op != IrPhi)
+		{
+			replace(&i->a);
+			replace(&i->b);
+			replace(&i->c);
+			for (k = 0; k < i->nargs; k++) replace(&i->args[k]);
+		}
+		define(i);
+	}
+	for (k = 0; k < 2; k++)
+	{
+		IrBlock *s = b->succ[k];
+		if (s == NULL || (k == 1 && s == b->succ[0])) continue;
+		for (n = 0; n < s->npreds && s->preds[n] != b; n++)
+			;
+		for (i = s->first; i != NULL && i->op == IrPhi; i = i->next)
+			i->args[n] = irReg(current[function->vregs[i->dest].origin]);
+	}
+	for (k = firstChild[b->id]; k < firstChild[b->id + 1]; k++) renameBlock(function->blocks[children[k]]);
+	while (undoCount > mark)
+	{
+		undoCount--;
+		current[undo[2 * undoCount]] = undo[2 * undoCount + 1];
+	}
+}
+
+/* findGlobalNames marks the variables used in a block
+ * before they are assigned there: no other variable
+ * needs a phi
+ */
+static void findGlobalNames(int *global)
+{
+	int *assigned = malloc(variableCount * sizeof(int));
+	int k, a, v;
+	IrInstr *i;
+	for (v = 0; v < variableCount; v++)
+	{
+		global[v] = FALSE;
+		assigned[v] = -1;
+	}
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			IrOperand uses[3];
+			uses[0] = i->a;
+			uses[1] = i->b;
+			uses[2] = i->c;
+			for (a = 0; a < 3 + i->nargs; a++)
+			{
+				v = variableOf(a < 3 ? uses[a] : i->args[a - 3]);
+				if (v >= 0 && assigned[v] != k) global[v] = TRUE;
+			}
+			if (i->dest >= 0 && isVariable[i->dest]) assigned[i->dest] = k;
+		}
+	free(assigned);
+}
+
+static void markLive(IrOperand o, char *live, int *work, int *count)
+{
+	if (o.kind != IrReg || live[o.val]) return;
+	live[o.val] = TRUE;
+	work[(*count)++] = o.val;
+}
+
+/* Procedure removeDeadPhis drops the phis whose value
+ * only dead phis use: semi-pruned placement puts them
+ * where a variable is set again before it is read
+ */
+static void removeDeadPhis(void)
+{
+	int nv = function->nvregs, count = 0, k, a;
+	char *live = calloc(nv, 1);
+	int *work = malloc(nv * sizeof(int));
+	IrInstr **phiOf = calloc(nv, sizeof(IrInstr *));
+	IrInstr *i, *next;
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			if (i->op == IrPhi)
+			{
+				phiOf[i->dest] = i;
+				continue;
+			}
+			markLive(i->a, live, work, &count);
+			markLive(i->b, live, work, &count);
+			markLive(i->c, live, work, &count);
+			for (a = 0; a < i->nargs; a++) markLive(i->args[a], live, work, &count);
+		}
+	while (count > 0)
+	{
+		i = phiOf[work[--count]];
+		if (i != NULL)
+			for (a = 0; a < i->nargs; a++) markLive(i->args[a], live, work, &count);
+	}
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL && i->op == IrPhi; i = next)
+		{
+			next = i->next;
+			if (live[i->dest]) continue;
+			removeInstr(function->blocks[k], i);
+			freeInstr(i);
+		}
+	free(live);
+	free(work);
+	free(phiOf);
+}
+
+static void buildFunction(IrFunction *f)
+{
+	int n = f->nblocks, v;
+	int *frontier, *frontierStart, *work, *placed, *queued, *global;
+	function = f;
+	variableCount = f->nvregs;
+	isVariable = malloc(variableCount * sizeof(int));
+	current = malloc(variableCount * sizeof(int));
+	for (v = 0; v < variableCount; v++)
+	{
+		isVariable[v] = f->vregs[v].word >= 0 && f->vregs[v].origin == v;
+		current[v] = v;
+	}
+	idom = findDominators(f);
+	findChildren();
+	frontier = findFrontiers(&frontierStart);
+	work = malloc(n * sizeof(int));
+	placed = calloc(n, sizeof(int));
+	queued = calloc(n, sizeof(int));
+	global = malloc(variableCount * sizeof(int));
+	findGlobalNames(global);
+	for (v = 0; v < variableCount; v++)
+		if (isVariable[v] && global[v]) insertPhis(v, frontier, frontierStart, work, placed, queued);
+	renameBlock(f->blocks[0]);
+	removeDeadPhis();
+	free(frontier);
+	free(frontierStart);
+	free(work);
+	free(placed);
+	free(queued);
+	free(global);
+	free(children);
+	free(firstChild);
+	free(idom);
+	free(current);
+	free(isVariable);
+	free(undo);
+	undo = NULL;
+	undoCount = undoCapacity = 0;
+	function = NULL;
+}
+
+void buildSsa(IrProgram *program)
+{
+	IrFunction *f;
+	for (f = program->functions; f != NULL; f = f->next) buildFunction(f);
+}
+
+/********************************************/
+/* destruction                              */
+/********************************************/
+
+static void original(IrFunction *f, IrOperand *o)
+{
+	if (o->kind == IrReg) o->val = f->vregs[o->val].origin;
+}
+
+/* Procedure copyIn puts v = o at the end of block b, an
+ * immediate predecessor of join, splitting the edge
+ * between them if b has another successor
+ */
+static void copyIn(IrFunction *f, IrBlock *b, IrBlock *join, int v, IrOperand o)
+{
+	IrInstr *copy = newInstr(IrCopy, v);
+	copy->a = o;
+	if (b->succ[1] != NULL && b->succ[1] != b->succ[0]) b = splitEdge(f, b, join);
+	insertBefore(b, b->last, copy);
+}
+
+static void leaveFunction(IrFunction *f)
+{
+	int k, n;
+	IrInstr *i;
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		while (b->first != NULL && b->first->op == IrPhi)
+		{
+			IrInstr *phi = b->first;
+			int v = f->vregs[phi->dest].origin;
+			for (n = 0; n < phi->nargs; n++)
+				if (phi->args[n].kind == IrImm || f->vregs[phi->args[n].val].origin != v)
+					copyIn(f, b->preds[n], b, phi->dest, phi->args[n]);
+			removeInstr(b, phi);
+			freeInstr(phi);
+		}
+	}
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		IrInstr *next;
+		for (i = b->first; i != NULL; i = next)
+		{
+			next = i->next;
+			if (i->dest >= 0) i->dest = f->vregs[i->dest].origin;
+			original(f, &i->a);
+			original(f, &i->b);
+			original(f, &i->c);
+			for (n = 0; n < i->nargs; n++) original(f, &i->args[n]);
+			/* left by phis with one argument */
+			if (i->op == IrCopy && i->a.kind == IrReg && i->a.val == i->dest)
+			{
+				removeInstr(b, i);
+				freeInstr(i);
+			}
+		}
+	}
+}
+
+void leaveSsa(IrProgram *program)
+{
+	IrFunction *f;
+	for (f = program->functions; f != NULL; f = f->next) leaveFunction(f);
+}
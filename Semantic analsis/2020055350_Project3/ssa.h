@@ -0,0 +1,36 @@
+/****************************************************/
+/* File: ssa.h                                      */
+/* Static single assignment form of the             */
+/* intermediate representation                      */
+/****************************************************/
+
+#ifndef _SSA_H_
+#define _SSA_H_
+
+#include "ir.h"
+
+/* Function findDominators returns, for each block of f
+ * by id, the id of its immediate dominator; the entry
+ * is its own. The array is the caller's to free
+ */
+int *findDominators(IrFunction *f);
+
+/* dominates tells whether block a dominates block b */
+int dominates(int *idom, int a, int b);
+
+/* Procedure buildSsa puts each function of program in
+ * SSA form: every assignment to a variable makes a new
+ * version of it, and phis join the versions at the
+ * blocks where they meet. The value of a variable on
+ * entry is the variable's own vreg
+ */
+void buildSsa(IrProgram *program);
+
+/* Procedure leaveSsa maps each version back to its
+ * variable, with copies for the phi arguments that are
+ * not versions of it. The versions of a variable must
+ * not be live at once, as none of the passes copy them
+ */
+void leaveSsa(IrProgram *program);
+
+#endif
@@ -9,9 +9,11 @@
 /****************************************************/
 
 #include "symtab.h"
+#include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 
 static char* NodeTypeToString(NodeType type) {
@@ -29,77 +31,314 @@ static char* SymbolKindToString(SymbolKind kind)
 	 else return "Unknown";
 }
 
+/* The hash family used for names (selected by SymtabHash).
+ * shiftHash is the original TINY hash; it stays in use for
+ * the order of the symbol table listing, which walks the
+ * symbols as they fall in its 211 buckets
+ */
 #define HASH_SHIFT 4
-static int hash(char *key)
+#define LISTING_BUCKETS 211
+
+static unsigned shiftHash(const char *key, int length)
 {
 	int temp = 0;
-	int i = 0;
-	while (key[i] != '\0')
+	int i;
+	for (i = 0; i < length; ++i) temp = ((temp << HASH_SHIFT) + key[i]) % LISTING_BUCKETS;
+	return temp;
+}
+
+static unsigned fnv1aHash(const char *key, int length)
+{
+	unsigned h = 2166136261u;
+	int i;
+	for (i = 0; i < length; ++i) h = (h ^ (unsigned char)key[i]) * 16777619u;
+	return h;
+}
+
+/* wordHash mixes the name eight bytes at a time */
+static unsigned wordHash(const char *key, int length)
+{
+	unsigned long long h = 0x9e3779b97f4a7c15ull ^ (unsigned long long)length;
+	unsigned long long word;
+	for (; length >= 8; key += 8, length -= 8)
 	{
-		temp = ((temp << HASH_SHIFT) + key[i]) % HASH_TABLE_SIZE;
-		++i;
+		memcpy(&word, key, 8);
+		h = (h ^ word) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
 	}
-	return temp;
+	if (length > 0)
+	{
+		word = 0;
+		memcpy(&word, key, length);
+		h = (h ^ word) * 0xff51afd7ed558ccdull;
+	}
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return (unsigned)h;
+}
+
+unsigned HashName(const char *key, int length, int kind)
+{
+	if (kind == ShiftHash) return shiftHash(key, length);
+	else if (kind == WordHash) return wordHash(key, length);
+	else
+		return fnv1aHash(key, length);
+}
+
+/* A name made by CopyName carries its hash in the
+ * bytes just before its text
+ */
+char *CopyName(char *s)
+{
+	int length;
+	char *block;
+	unsigned h;
+	if (s == NULL) return NULL;
+	length = strlen(s);
+	block = (char *)unitAlloc(sizeof(unsigned) + length + 1);
+	h = HashName(s, length, SymtabHash);
+	memcpy(block, &h, sizeof(unsigned));
+	memcpy(block + sizeof(unsigned), s, length + 1);
+	return block + sizeof(unsigned);
+}
+
+unsigned NameHash(char *name)
+{
+	unsigned h;
+	memcpy(&h, name - sizeof(unsigned), sizeof(unsigned));
+	return h;
 }
 
+/* The two bloom filter bits of a name are taken from a
+ * remix of its hash, since the bucket already uses the
+ * low bits (and the shift hash has no high bits)
+ */
+static void bloomAdd(ScopeEntryRec *scope, unsigned h)
+{
+	unsigned mixed = h * 0x9e3779b1u;
+	unsigned first = mixed >> 24;
+	unsigned second = (mixed >> 16) & 0xff;
+	scope->bloom[first / 64] |= 1ull << (first % 64);
+	scope->bloom[second / 64] |= 1ull << (second % 64);
+}
+
+static int bloomMayContain(ScopeEntryRec *scope, unsigned h)
+{
+	unsigned mixed = h * 0x9e3779b1u;
+	unsigned first = mixed >> 24;
+	unsigned second = (mixed >> 16) & 0xff;
+	return (scope->bloom[first / 64] >> (first % 64)) & (scope->bloom[second / 64] >> (second % 64)) & 1;
+}
+
+/* Counters for --symtab-stats. The type-checking threads
+ * search the table concurrently, so they are atomic; they
+ * are only touched when SymtabStats is set
+ */
+typedef struct SymtabCounters
+{
+	atomic_long inserts;
+	atomic_long lookups;
+	atomic_long misses;
+	atomic_long scopesWalked;
+	atomic_long maxScopesWalked;
+	atomic_long probes;
+	atomic_long maxProbes;
+	atomic_long bloomSkips;
+} SymtabCounters;
+
+static SymtabCounters counters;
+
+static void countMax(atomic_long *max, long value)
+{
+	long seen = atomic_load_explicit(max, memory_order_relaxed);
+	while (value > seen && !atomic_compare_exchange_weak_explicit(max, &seen, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+/* countLookup records one search that looked at walked
+ * scopes (skipped of them passed over by the bloom filter)
+ * and compared probes chain entries, the longest single
+ * chain walk being maxProbes
+ */
+static void countLookup(int walked, int skipped, int probes, int maxProbes, int found)
+{
+	atomic_fetch_add_explicit(&counters.bloomSkips, skipped, memory_order_relaxed);
+	atomic_fetch_add_explicit(&counters.lookups, 1, memory_order_relaxed);
+	if (!found) atomic_fetch_add_explicit(&counters.misses, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&counters.scopesWalked, walked, memory_order_relaxed);
+	atomic_fetch_add_explicit(&counters.probes, probes, memory_order_relaxed);
+	countMax(&counters.maxScopesWalked, walked);
+	countMax(&counters.maxProbes, maxProbes);
+}
 
 static ScopeEntryList allScopes = NULL;
+static ScopeEntryRec *lastScope = NULL;
+
+/* Scope names are kept in their own hash table (chained
+ * by nextWithName) so that a new scope finds an earlier
+ * one with its name without walking allScopes. Scope
+ * names are made by CopyName, so they are bucketed by
+ * their stored hash. The table doubles when it holds more
+ * scopes than buckets
+ */
+static ScopeEntryRec **scopeBuckets = NULL;
+static int scopeBucketCount = 0;
+static int scopeCount = 0;
+
+static void chainScopeName(ScopeEntryRec *scope)
+{
+	ScopeEntryRec **bucket = &scopeBuckets[NameHash(scope->name) & (scopeBucketCount - 1)];
+	scope->nextWithName = *bucket;
+	*bucket = scope;
+}
+
+static void indexScopeName(ScopeEntryRec *scope)
+{
+	if (++scopeCount > scopeBucketCount)
+	{
+		ScopeEntryRec *tmpScope;
+		scopeBucketCount = scopeBucketCount == 0 ? 64 : 2 * scopeBucketCount;
+		free(scopeBuckets);
+		scopeBuckets = (ScopeEntryRec **)calloc(scopeBucketCount, sizeof(ScopeEntryRec *));
+		for (tmpScope = allScopes; tmpScope != NULL && tmpScope != scope; tmpScope = tmpScope->next)
+			chainScopeName(tmpScope);
+	}
+	chainScopeName(scope);
+}
+
+static int scopeNameUsed(char *name)
+{
+	ScopeEntryRec *scope;
+	if (scopeBucketCount == 0) return FALSE;
+	for (scope = scopeBuckets[NameHash(name) & (scopeBucketCount - 1)]; scope != NULL; scope = scope->nextWithName)
+		if (strcmp(name, scope->name) == 0) return TRUE;
+	return FALSE;
+}
+
+/* A frozen scope is a read-only copy of a scope's symbols
+ * in one block. Symbols with the same name are stored
+ * next to each other (linked by next, in insertion order)
+ * and the first of each name is found through a perfect
+ * hash: the name hash picks a bucket, whose seed remixes
+ * the hash to a slot no other name of the scope uses
+ */
+typedef struct FrozenScopeRec
+{
+	int bucketCount;
+	int slotCount;
+	unsigned *seeds;
+	int *slots;
+	SymbolEntryRec *records;
+} FrozenScopeRec;
+
+#define MAX_SEED_TRIES 100000
+
+static unsigned mixHash(unsigned h, unsigned seed)
+{
+	h ^= seed * 0x9e3779b9u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/* firstCandidate returns the first entry that may hold a
+ * name of hash h: its bucket chain or, in a frozen scope,
+ * the group of the only name that can sit in its slot
+ */
+static SymbolEntryRec *firstCandidate(ScopeEntryRec *scope, unsigned h)
+{
+	FrozenScopeRec *frozen = scope->frozen;
+	int index;
+	if (frozen == NULL) return scope->symbols[h & HASH_MASK];
+	index = frozen->slots[mixHash(h, frozen->seeds[mixHash(h, 0) & (frozen->bucketCount - 1)]) & (frozen->slotCount - 1)];
+	return index < 0 ? NULL : &frozen->records[index];
+}
 
 ScopeEntryRec *InsertScope(char *name, ScopeEntryRec *parentScope, TreeNode *functionNode)
 {
-	char *scopeName = NULL;
+	char *scopeName;
 	if (name == NULL)
 	{
-    size_t length = strlen(parentScope->name);
-    scopeName = (char *)malloc(length + 6); 
-    if (scopeName != NULL) {
-        strcpy(scopeName, parentScope->name);        
-        strcat(scopeName, ".");                
-        char numStr[5];                       
-        sprintf(numStr, "%d", parentScope->nestedScopeCount++);
-        strcat(scopeName, numStr);             
-    }
+		char *numbered = (char *)malloc(strlen(parentScope->name) + 12);
+		sprintf(numbered, "%s.%d", parentScope->name, parentScope->nestedScopeCount++);
+		scopeName = CopyName(numbered);
+		free(numbered);
 	}
 	else
-	{
-    	size_t length = strlen(name);
-    	scopeName = (char *)malloc(length + 1);
-   	 if (scopeName != NULL) {
-        strcpy(scopeName, name);              
-    	}
-	}
+		scopeName = CopyName(name);
 
 	int redefined = (parentScope != NULL && parentScope->status == defined) ? TRUE : FALSE;
-	ScopeEntryRec *tmpScope = allScopes;
-	while (tmpScope != NULL)
-	{
-		if (strcmp(scopeName, tmpScope->name) == 0)
-		{
-			redefined = TRUE;
-		}
-		if (tmpScope->next == NULL) break;
-		tmpScope = tmpScope->next;
-	}
+	if (scopeNameUsed(scopeName)) redefined = TRUE;
 
-	ScopeEntryRec *scope = (ScopeEntryRec *)malloc(sizeof(ScopeEntryRec));
+	ScopeEntryRec *scope = (ScopeEntryRec *)unitAlloc(sizeof(ScopeEntryRec));
 	scope->name = scopeName;
 	scope->status = redefined == TRUE ? defined : nonerror;
 	scope->functionNode = functionNode;
 	for (int i = 0; i < HASH_TABLE_SIZE; ++i) scope->symbols[i] = NULL;
+	memset(scope->bloom, 0, sizeof(scope->bloom));
+	scope->frozen = NULL;
 	scope->symbolCount = 0;
+	scope->frameSize = 0;
 	scope->nestedScopeCount = 0;
+	scope->depth = parentScope == NULL ? 0 : parentScope->depth + 1;
+	scope->firstSymbol = NULL;
+	scope->lastSymbol = NULL;
 	scope->parentScope = parentScope;
-	if (tmpScope == NULL) allScopes = scope;
+	if (lastScope == NULL) allScopes = scope;
 	else
-		tmpScope->next = scope;
+		lastScope->next = scope;
 	scope->next = NULL;
+	lastScope = scope;
+	indexScopeName(scope);
 	return scope;
 }
 
+ScopeEntryRec *LastScope(void)
+{
+	return lastScope;
+}
+
+void ResetScopes(void)
+{
+	allScopes = NULL;
+	lastScope = NULL;
+	if (scopeBucketCount > 0) memset(scopeBuckets, 0, scopeBucketCount * sizeof(ScopeEntryRec *));
+	scopeCount = 0;
+	memset(&counters, 0, sizeof(counters));
+}
+
+void AppendScopes(ScopeEntryRec *first, ScopeEntryRec *last)
+{
+	ScopeEntryRec *scope;
+	if (lastScope == NULL) allScopes = first;
+	else
+		lastScope->next = first;
+	last->next = NULL;
+	lastScope = last;
+	for (scope = first; scope != NULL; scope = scope->next) indexScopeName(scope);
+}
+
+/* appendLineUsage adds lineno to the usages of symbol.
+ * lastUsage is only a hint: a frozen copy shares the
+ * list and may have appended past it
+ */
+static void appendLineUsage(SymbolEntryRec *symbol, int lineno)
+{
+	LineUsageRec *line = symbol->lastUsage;
+	while (line->next != NULL) line = line->next;
+	line->next = (LineUsageRec *)unitAlloc(sizeof(LineUsageRec));
+	line->next->lineno = lineno;
+	line->next->next = NULL;
+	symbol->lastUsage = line->next;
+}
 
 SymbolEntryRec *InsertSymbol(ScopeEntryRec *activeScope, char *name, NodeType type, SymbolKind kind, int lineno, TreeNode *node)
 {
-	int hashIdx = hash(name);
+	unsigned h = NameHash(name);
+	int hashIdx = h & HASH_MASK;
 	SymbolEntryRec *tmpSymbol = activeScope->symbols[hashIdx];
 	ErrorState status = nonerror;
 	while (tmpSymbol != NULL)
@@ -107,10 +346,13 @@ SymbolEntryRec *InsertSymbol(ScopeEntryRec *activeScope, char *name, NodeType ty
 		if( strcmp(name, tmpSymbol->name) == 0 )
 		{
 			if (tmpSymbol->status == defined) status = defined;
-			else if( tmpSymbol->status == undeclared)
+			else if( tmpSymbol->status == undeclared && tmpSymbol->kind == kind)
 			{
+				activeScope->frozen = NULL;
 				tmpSymbol->type = type;
+				tmpSymbol->node = node;
 				tmpSymbol->status = node == NULL ? undeclared : nonerror;
+				if (node != NULL) appendLineUsage(tmpSymbol, lineno);
 				return tmpSymbol;
 			}
 		}
@@ -118,213 +360,706 @@ SymbolEntryRec *InsertSymbol(ScopeEntryRec *activeScope, char *name, NodeType ty
 		tmpSymbol = tmpSymbol->next;
 	}
 
-	SymbolEntryRec *symbol = (SymbolEntryRec *)malloc(sizeof(SymbolEntryRec));
+	if (SymtabStats) atomic_fetch_add_explicit(&counters.inserts, 1, memory_order_relaxed);
+	SymbolEntryRec *symbol = (SymbolEntryRec *)unitAlloc(sizeof(SymbolEntryRec));
 	symbol->name = name;
 	symbol->status = status;
 	symbol->type = type;
 	symbol->kind = kind;
-	symbol->lineUsage = (LineUsage)malloc(sizeof(LineUsageRec));
+	symbol->lineUsage = (LineUsage)unitAlloc(sizeof(LineUsageRec));
 	symbol->lineUsage->lineno = lineno;
 	symbol->lineUsage->next = NULL;
+	symbol->lastUsage = symbol->lineUsage;
 	symbol->memoryLocation = activeScope->symbolCount++;
+	symbol->offset = 0;
+	bloomAdd(activeScope, h);
+	activeScope->frozen = NULL;
 	if (tmpSymbol == NULL) activeScope->symbols[hashIdx] = symbol;
 	else
 		tmpSymbol->next = symbol;
 	symbol->next = NULL;
 	symbol->node = node;
+	symbol->scope = activeScope;
+	symbol->nextInScope = NULL;
+	if (activeScope->lastSymbol == NULL) activeScope->firstSymbol = symbol;
+	else
+		activeScope->lastSymbol->nextInScope = symbol;
+	activeScope->lastSymbol = symbol;
 	if( node == NULL ) symbol->status = undeclared;
 
 	return symbol;
 }
 
+SymbolEntryRec *ThawSymbol(SymbolEntryRec *symbol)
+{
+	ScopeEntryRec *scope = symbol->scope;
+	SymbolEntryRec *chained;
+	if (scope->frozen == NULL) return symbol;
+	scope->frozen = NULL;
+	/* a frozen copy shares its line usages with the original */
+	for (chained = scope->symbols[NameHash(symbol->name) & HASH_MASK]; chained->lineUsage != symbol->lineUsage; chained = chained->next)
+		;
+	return chained;
+}
+
 SymbolEntryRec *InsertSymbolIntoScope(ScopeEntryRec *activeScope, char *name, int lineno)
 {
-	int hashIdx = hash(name);
+	unsigned h = NameHash(name);
 	ScopeEntryRec *scope = activeScope;
 	SymbolEntryRec *symbol = NULL;
+	int walked = 0, skipped = 0, probes = 0, maxProbes = 0;
 	while (scope != NULL)
 	{
-		symbol = scope->symbols[hashIdx];
-		while ((symbol != NULL) && (strcmp(name, symbol->name) != 0)) symbol = symbol->next;
+		int chain = 0;
+		int maybe = bloomMayContain(scope, h);
+		++walked;
+		skipped += !maybe;
+		for (symbol = maybe ? firstCandidate(scope, h) : NULL; symbol != NULL; symbol = symbol->next)
+		{
+			++chain;
+			if (strcmp(name, symbol->name) == 0) break;
+		}
+		probes += chain;
+		if (chain > maxProbes) maxProbes = chain;
 		
 		if (symbol == NULL) scope = scope->parentScope;
 		else
 			break;
 	}
+	if (SymtabStats) countLookup(walked, skipped, probes, maxProbes, symbol != NULL);
 
-	LineUsageRec *line = symbol->lineUsage;
-	while (line->next != NULL) line = line->next;
-	line->next = (LineUsageRec *)malloc(sizeof(LineUsageRec));
-	line->next->lineno = lineno;
-	line->next->next = NULL;
-
+	appendLineUsage(symbol, lineno);
 	return symbol;
 }
 
 SymbolEntryRec *SearchSymbol(ScopeEntryRec *activeScope, char *name)
 {
-	int hashIdx = hash(name);
+	unsigned h = NameHash(name);
 	ScopeEntryRec *scope = activeScope;
 	SymbolEntryRec *symbol = NULL;
+	int walked = 0, skipped = 0, probes = 0, maxProbes = 0;
 
 	while (scope != NULL)
 	{
-		symbol = scope->symbols[hashIdx];
-		while ((symbol != NULL) && (strcmp(name, symbol->name) != 0)) symbol = symbol->next;
+		int chain = 0;
+		int maybe = bloomMayContain(scope, h);
+		++walked;
+		skipped += !maybe;
+		for (symbol = maybe ? firstCandidate(scope, h) : NULL; symbol != NULL; symbol = symbol->next)
+		{
+			++chain;
+			if (strcmp(name, symbol->name) == 0) break;
+		}
+		probes += chain;
+		if (chain > maxProbes) maxProbes = chain;
 		
 		if (symbol == NULL) scope = scope->parentScope;
 		else
-			return symbol;
+			break;
 	}
 
-	return NULL;
+	if (SymtabStats) countLookup(walked, skipped, probes, maxProbes, symbol != NULL);
+	return symbol;
 }
 
 SymbolEntryRec *SearchSymbolInScope(ScopeEntryRec *activeScope, char *name)
 {
-	int hashIdx = hash(name);
+	unsigned h = NameHash(name);
 	ScopeEntryRec *scope = activeScope;
-	SymbolEntryRec *symbol = scope->symbols[hashIdx];
-	while ((symbol != NULL) && (strcmp(name, symbol->name) != 0)) symbol = symbol->next;
+	SymbolEntryRec *symbol;
+	int maybe = bloomMayContain(scope, h);
+	int chain = 0;
+	for (symbol = maybe ? firstCandidate(scope, h) : NULL; symbol != NULL; symbol = symbol->next)
+	{
+		++chain;
+		if (strcmp(name, symbol->name) == 0) break;
+	}
 
+	if (SymtabStats) countLookup(1, !maybe, chain, chain, symbol != NULL);
 	return symbol;
 }
 
 SymbolEntryRec *SearchSymbolByKind(ScopeEntryRec *activeScope, char *name, SymbolKind kind)
 {
-	int hashIdx = hash(name);
+	unsigned h = NameHash(name);
 	ScopeEntryRec *scope = activeScope;
 	SymbolEntryRec *symbol = NULL;
+	int walked = 0, skipped = 0, probes = 0, maxProbes = 0;
 
 	while (scope != NULL)
 	{
-		symbol = scope->symbols[hashIdx];
-		while ((symbol != NULL) && ((strcmp(name, symbol->name) != 0) || (symbol->kind != kind))) symbol = symbol->next;
+		int chain = 0;
+		int maybe = bloomMayContain(scope, h);
+		++walked;
+		skipped += !maybe;
+		for (symbol = maybe ? firstCandidate(scope, h) : NULL; symbol != NULL; symbol = symbol->next)
+		{
+			++chain;
+			if (strcmp(name, symbol->name) == 0 && symbol->kind == kind) break;
+		}
+		probes += chain;
+		if (chain > maxProbes) maxProbes = chain;
 
 		if (symbol == NULL) scope = scope->parentScope;
 		else
-			return symbol;
+			break;
 	}
 
-	return NULL;
+	if (SymtabStats) countLookup(walked, skipped, probes, maxProbes, symbol != NULL);
+	return symbol;
 }
 
-void DisplaySymbolTable(FILE *listing, ScopeEntryRec *rootScope)
+static int powerOfTwoAtLeast(int n)
 {
-	fprintf(listing, "\n\n< Symbol Table >\n");
-	fprintf(listing, " Symbol Name   Symbol Kind   Symbol Type    Scope Name   Location  Line Numbers\n");
-	fprintf(listing, "-------------  -----------  -------------  ------------  --------  ------------\n");
-	ScopeEntryRec *scope = allScopes;
-	while (scope != NULL)
+	int size = 1;
+	while (size < n) size *= 2;
+	return size;
+}
+
+static int compareHashes(const void *a, const void *b)
+{
+	unsigned x = NameHash((*(SymbolEntryRec * const *)a)->name);
+	unsigned y = NameHash((*(SymbolEntryRec * const *)b)->name);
+	return x < y ? -1 : x > y;
+}
+
+static int *qsortBuckets;
+
+static int compareBucketSizes(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	int sizeX = qsortBuckets[x + 1] - qsortBuckets[x];
+	int sizeY = qsortBuckets[y + 1] - qsortBuckets[y];
+	if (sizeX != sizeY) return sizeY - sizeX;
+	return x - y;
+}
+
+/* freezeScope builds the frozen copy of scope. It gives up,
+ * leaving the scope chained, if two different names of the
+ * scope have the same hash (no seed can separate them)
+ */
+static void freezeScope(ScopeEntryRec *scope)
+{
+	SymbolEntryRec **heads;
+	SymbolEntryRec *symbol;
+	FrozenScopeRec *frozen;
+	int *bucketOf, *bucketStart, *members, *order, *tried;
+	int symbols = 0, names = 0, placed = 0;
+	int i, j, b;
+	char *block;
+
+	for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope) ++symbols;
+	if (symbols == 0) return;
+
+	/* the first entry of each name in its chain heads a group */
+	heads = (SymbolEntryRec **)malloc(symbols * sizeof(SymbolEntryRec *));
+	for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+	{
+		SymbolEntryRec *first = scope->symbols[NameHash(symbol->name) & HASH_MASK];
+		while (strcmp(first->name, symbol->name) != 0) first = first->next;
+		if (first == symbol) heads[names++] = symbol;
+	}
+	qsort(heads, names, sizeof(SymbolEntryRec *), compareHashes);
+	for (i = 1; i < names; ++i)
+		if (NameHash(heads[i]->name) == NameHash(heads[i - 1]->name))
+		{
+			free(heads);
+			return;
+		}
+
+	block = (char *)unitAlloc(sizeof(FrozenScopeRec) + symbols * sizeof(SymbolEntryRec)
+		+ (powerOfTwoAtLeast((names + 3) / 4) + 2 * powerOfTwoAtLeast(names)) * sizeof(int));
+	frozen = (FrozenScopeRec *)block;
+	frozen->records = (SymbolEntryRec *)(block + sizeof(FrozenScopeRec));
+	frozen->bucketCount = powerOfTwoAtLeast((names + 3) / 4);
+	frozen->slotCount = 2 * powerOfTwoAtLeast(names);
+	frozen->seeds = (unsigned *)(frozen->records + symbols);
+	frozen->slots = (int *)(frozen->seeds + frozen->bucketCount);
+	for (i = 0; i < frozen->slotCount; ++i) frozen->slots[i] = -1;
+
+	/* copy each group, keeping the order of its chain */
+	bucketOf = (int *)malloc(names * sizeof(int));
+	for (i = 0; i < names; ++i)
+	{
+		SymbolEntryRec *last = NULL;
+		for (symbol = heads[i]; symbol != NULL; symbol = symbol->next)
+		{
+			if (strcmp(symbol->name, heads[i]->name) != 0) continue;
+			frozen->records[placed] = *symbol;
+			frozen->records[placed].next = NULL;
+			if (last != NULL) last->next = &frozen->records[placed];
+			else
+				heads[i] = &frozen->records[placed];
+			last = &frozen->records[placed++];
+		}
+		bucketOf[i] = mixHash(NameHash(heads[i]->name), 0) & (frozen->bucketCount - 1);
+	}
+
+	/* sort the names by bucket, then place the buckets,
+	 * largest first
+	 */
+	bucketStart = (int *)calloc(frozen->bucketCount + 1, sizeof(int));
+	members = (int *)malloc(names * sizeof(int));
+	order = (int *)malloc(frozen->bucketCount * sizeof(int));
+	tried = (int *)malloc(names * sizeof(int));
+	for (i = 0; i < names; ++i) ++bucketStart[bucketOf[i] + 1];
+	for (b = 0; b < frozen->bucketCount; ++b) bucketStart[b + 1] += bucketStart[b];
+	for (i = 0; i < names; ++i) members[bucketStart[bucketOf[i]]++] = i;
+	for (b = frozen->bucketCount; b > 0; --b) bucketStart[b] = bucketStart[b - 1];
+	bucketStart[0] = 0;
+	for (b = 0; b < frozen->bucketCount; ++b) order[b] = b;
+	qsortBuckets = bucketStart;
+	qsort(order, frozen->bucketCount, sizeof(int), compareBucketSizes);
+
+	for (b = 0; b < frozen->bucketCount; ++b)
 	{
-		for (int i = 0; i < HASH_TABLE_SIZE; ++i)
+		unsigned seed;
+		int bucket = order[b];
+		frozen->seeds[bucket] = 0;
+		if (bucketStart[bucket] == bucketStart[bucket + 1]) continue;
+		for (seed = 1; seed <= MAX_SEED_TRIES; ++seed)
 		{
-			SymbolEntryRec *symbol = scope->symbols[i];
-			while (symbol != NULL)
+			int count = 0;
+			for (j = bucketStart[bucket]; j < bucketStart[bucket + 1]; ++j)
 			{
-				fprintf(listing,
-						"%-13s  %-11s  %-13s  %-12s  %-8d ",
-						symbol->name,
-						SymbolKindToString(symbol->kind),
-						NodeTypeToString(symbol->type),
-						scope->name,
-						symbol->memoryLocation);
-				LineUsageRec *line = symbol->lineUsage;
-				while (line != NULL)
-				{
-					fprintf(listing, "%4d ", line->lineno);
-					line = line->next;
-				}
-				fprintf(listing, "\n");
-				symbol = symbol->next;
+				SymbolEntryRec *head = heads[members[j]];
+				int slot = mixHash(NameHash(head->name), seed) & (frozen->slotCount - 1);
+				if (frozen->slots[slot] != -1) break;
+				frozen->slots[slot] = head - frozen->records;
+				tried[count++] = slot;
 			}
+			if (j == bucketStart[bucket + 1]) break;
+			while (count > 0) frozen->slots[tried[--count]] = -1;
 		}
-		scope = scope->next;
+		if (seed > MAX_SEED_TRIES) break;
+		frozen->seeds[bucket] = seed;
 	}
-	
-	fprintf(listing, "\n\n< Functions >\n");
-	fprintf(listing, "Function Name   Return Type   Parameter Name  Parameter Type\n");
-	fprintf(listing, "-------------  -------------  --------------  --------------\n");
-	scope = allScopes;
-	while (scope != NULL)
+
+	if (b == frozen->bucketCount) scope->frozen = frozen;
+	free(tried);
+	free(order);
+	free(members);
+	free(bucketStart);
+	free(bucketOf);
+	free(heads);
+}
+
+void FreezeScopes(void)
+{
+	ScopeEntryRec *scope;
+	for (scope = allScopes; scope != NULL; scope = scope->next)
+		if (scope->frozen == NULL) freezeScope(scope);
+}
+
+/* The symbol table report is written through a
+ * ReportWriter, which collects output in a large
+ * buffer and hands it to the FILE in big chunks
+ */
+#define REPORT_BUFFER_SIZE 65536
+
+typedef struct ReportWriter
+{
+	FILE *out;
+	int length;
+	char buffer[REPORT_BUFFER_SIZE];
+} ReportWriter;
+
+static void flushReport(ReportWriter *w)
+{
+	if (w->length > 0) fwrite(w->buffer, 1, w->length, w->out);
+	w->length = 0;
+}
+
+static void writeChars(ReportWriter *w, const char *s, int n)
+{
+	while (n > 0)
+	{
+		int room = REPORT_BUFFER_SIZE - w->length;
+		int chunk = n < room ? n : room;
+		memcpy(w->buffer + w->length, s, chunk);
+		w->length += chunk;
+		s += chunk;
+		n -= chunk;
+		if (w->length == REPORT_BUFFER_SIZE) flushReport(w);
+	}
+}
+
+static void writeSpaces(ReportWriter *w, int n)
+{
+	static const char spaces[] = "                ";
+	while (n > 0)
+	{
+		int chunk = n < 16 ? n : 16;
+		writeChars(w, spaces, chunk);
+		n -= chunk;
+	}
+}
+
+static void writeText(ReportWriter *w, const char *s)
+{
+	if (s == NULL) s = "(null)";
+	writeChars(w, s, strlen(s));
+}
+
+/* writeLeft is printf's "%-<width>s" */
+static void writeLeft(ReportWriter *w, const char *s, int width)
+{
+	if (s == NULL) s = "(null)";
+	int n = strlen(s);
+	writeChars(w, s, n);
+	writeSpaces(w, width - n);
+}
+
+/* writeInt is "%-<width>d" for width > 0 and "%<-width>d" otherwise */
+static void writeInt(ReportWriter *w, int value, int width)
+{
+	char digits[16];
+	int n = 0;
+	unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+	do
+	{
+		digits[15 - n++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (value < 0) digits[15 - n++] = '-';
+	if (width < 0) writeSpaces(w, -width - n);
+	writeChars(w, digits + 16 - n, n);
+	if (width > 0) writeSpaces(w, width - n);
+}
+
+/* Each scope's symbols are listed in shiftHash bucket
+ * order, then in insertion order within a bucket, which
+ * is the order of the original bucket-by-bucket walk
+ */
+static int compareBucketOrder(const void *a, const void *b)
+{
+	const SymbolEntryRec *x = *(SymbolEntryRec * const *)a;
+	const SymbolEntryRec *y = *(SymbolEntryRec * const *)b;
+	if (x->listingBucket != y->listingBucket) return x->listingBucket - y->listingBucket;
+	return x->memoryLocation - y->memoryLocation;
+}
+
+static SymbolEntryRec **sortedSymbols(ScopeEntryRec *scope, int *count)
+{
+	SymbolEntryRec **symbols;
+	SymbolEntryRec *symbol;
+	int n = 0;
+	for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope) ++n;
+	symbols = (SymbolEntryRec **)malloc((n + 1) * sizeof(SymbolEntryRec *));
+	n = 0;
+	for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+	{
+		symbol->listingBucket = shiftHash(symbol->name, strlen(symbol->name));
+		symbols[n++] = symbol;
+	}
+	qsort(symbols, n, sizeof(SymbolEntryRec *), compareBucketOrder);
+	*count = n;
+	return symbols;
+}
+
+static void writeLineUsage(ReportWriter *w, SymbolEntryRec *symbol, const char *separator)
+{
+	LineUsageRec *line;
+	for (line = symbol->lineUsage; line != NULL; line = line->next)
+	{
+		writeInt(w, line->lineno, 0);
+		if (line->next != NULL) writeText(w, separator);
+	}
+}
+
+static void writeTextReport(ReportWriter *w, ScopeEntryRec *rootScope)
+{
+	ScopeEntryRec *scope;
+	SymbolEntryRec **rootSymbols;
+	int rootCount;
+	int i;
+
+	writeText(w, "\n\n< Symbol Table >\n");
+	writeText(w, " Symbol Name   Symbol Kind   Symbol Type    Scope Name   Location  Line Numbers\n");
+	writeText(w, "-------------  -----------  -------------  ------------  --------  ------------\n");
+	for (scope = allScopes; scope != NULL; scope = scope->next)
 	{
-		for (int i = 0; i < HASH_TABLE_SIZE; ++i)
+		int count;
+		SymbolEntryRec **symbols = sortedSymbols(scope, &count);
+		for (i = 0; i < count; ++i)
 		{
-			SymbolEntryRec *symbol = scope->symbols[i];
-			while (symbol != NULL)
+			SymbolEntryRec *symbol = symbols[i];
+			LineUsageRec *line;
+			writeLeft(w, symbol->name, 13);
+			writeText(w, "  ");
+			writeLeft(w, SymbolKindToString(symbol->kind), 11);
+			writeText(w, "  ");
+			writeLeft(w, NodeTypeToString(symbol->type), 13);
+			writeText(w, "  ");
+			writeLeft(w, scope->name, 12);
+			writeText(w, "  ");
+			writeInt(w, symbol->memoryLocation, 8);
+			writeText(w, " ");
+			for (line = symbol->lineUsage; line != NULL; line = line->next)
 			{
-				if (symbol->kind == FunctionSym)
+				writeInt(w, line->lineno, -4);
+				writeText(w, " ");
+			}
+			writeText(w, "\n");
+		}
+		free(symbols);
+	}
+
+	/* functions only ever live in the global scope */
+	rootSymbols = sortedSymbols(rootScope, &rootCount);
+	writeText(w, "\n\n< Functions >\n");
+	writeText(w, "Function Name   Return Type   Parameter Name  Parameter Type\n");
+	writeText(w, "-------------  -------------  --------------  --------------\n");
+	for (i = 0; i < rootCount; ++i)
+	{
+		SymbolEntryRec *symbol = rootSymbols[i];
+		if (symbol->kind != FunctionSym) continue;
+		writeLeft(w, symbol->name, 13);
+		writeText(w, "  ");
+		writeLeft(w, NodeTypeToString(symbol->type), 13);
+		writeText(w, " ");
+		if (symbol->type == Undetermined)
+		{
+			writeText(w, " ");
+			writeLeft(w, "", 14);
+			writeText(w, "  ");
+			writeLeft(w, NodeTypeToString(Undetermined), 12);
+			writeText(w, "\n");
+		}
+		else
+		{
+			TreeNode *param = symbol->node->child[0];
+			if (param->type == Void)
+			{
+				writeText(w, " ");
+				writeLeft(w, "", 14);
+				writeText(w, "  ");
+				writeLeft(w, NodeTypeToString(Void), 12);
+				writeText(w, "\n");
+			}
+			else
+			{
+				writeText(w, "\n");
+				while (param != NULL)
 				{
-					fprintf(listing, "%-13s  %-13s ", symbol->name, NodeTypeToString(symbol->type));
-					if (symbol->type == Undetermined) fprintf(listing, " %-14s  %-12s\n", "", NodeTypeToString(Undetermined));
-					else
-					{
-						TreeNode *param = symbol->node->child[0];
-						if (param->type == Void) fprintf(listing, " %-14s  %-12s\n", "", NodeTypeToString(Void));
-						else
-						{
-							fprintf(listing, "\n");
-							while (param != NULL)
-							{
-								fprintf(listing, "%-13s  %-13s  %-14s  %-12s\n", "-", "-", param->name, NodeTypeToString(param->type));
-								param = param->sibling;
-							}
-						}
-					}
+					writeLeft(w, "-", 13);
+					writeText(w, "  ");
+					writeLeft(w, "-", 13);
+					writeText(w, "  ");
+					writeLeft(w, param->name, 14);
+					writeText(w, "  ");
+					writeLeft(w, NodeTypeToString(param->type), 12);
+					writeText(w, "\n");
+					param = param->sibling;
 				}
-				symbol = symbol->next;
 			}
 		}
-		scope = scope->next;
 	}
-	fprintf(listing, "\n\n< Global Symbols >\n");
-	fprintf(listing, " Symbol Name   Symbol Kind   Symbol Type\n");
-	fprintf(listing, "-------------  -----------  -------------\n");
-	for (int i = 0; i < HASH_TABLE_SIZE; ++i)
+
+	writeText(w, "\n\n< Global Symbols >\n");
+	writeText(w, " Symbol Name   Symbol Kind   Symbol Type\n");
+	writeText(w, "-------------  -----------  -------------\n");
+	for (i = 0; i < rootCount; ++i)
+	{
+		SymbolEntryRec *symbol = rootSymbols[i];
+		writeLeft(w, symbol->name, 13);
+		writeText(w, "  ");
+		writeLeft(w, SymbolKindToString(symbol->kind), 11);
+		writeText(w, "  ");
+		writeLeft(w, NodeTypeToString(symbol->type), 13);
+		writeText(w, "\n");
+	}
+	free(rootSymbols);
+
+	writeText(w, "\n\n< Scopes >\n");
+	writeText(w, " Scope Name   Nested Level   Symbol Name   Symbol Type\n");
+	writeText(w, "------------  ------------  -------------  -----------\n");
+	for (scope = allScopes; scope != NULL; scope = scope->next)
 	{
-		SymbolEntryRec *symbol = rootScope->symbols[i];
-		while (symbol != NULL)
+		int count;
+		SymbolEntryRec **symbols;
+		if (scope == rootScope) continue;
+
+		symbols = sortedSymbols(scope, &count);
+		for (i = 0; i < count; ++i)
 		{
-			fprintf(listing, "%-13s  %-11s  %-13s\n", symbol->name, SymbolKindToString(symbol->kind), NodeTypeToString(symbol->type));
-			symbol = symbol->next;
+			writeLeft(w, scope->name, 12);
+			writeText(w, "  ");
+			writeInt(w, scope->depth - rootScope->depth, 12);
+			writeText(w, "  ");
+			writeLeft(w, symbols[i]->name, 13);
+			writeText(w, "  ");
+			writeLeft(w, NodeTypeToString(symbols[i]->type), 11);
+			writeText(w, "\n");
 		}
+		if (count > 0) writeText(w, "\n");
+		free(symbols);
 	}
-		fprintf(listing, "\n\n< Scopes >\n");
-		fprintf(listing, " Scope Name   Nested Level   Symbol Name   Symbol Type\n");
-	fprintf(listing, "------------  ------------  -------------  -----------\n");
-	scope = allScopes;
-	while (scope != NULL)
+}
+
+/* JSON and CSV list scopes in creation order and the
+ * symbols of a scope in declaration order
+ */
+static void writeJsonReport(ReportWriter *w, ScopeEntryRec *rootScope)
+{
+	ScopeEntryRec *scope;
+	SymbolEntryRec *symbol;
+
+	writeText(w, "{\"scopes\":[");
+	for (scope = allScopes; scope != NULL; scope = scope->next)
 	{
-		if (scope == rootScope)
+		writeText(w, "\n{\"name\":\"");
+		writeText(w, scope->name);
+		writeText(w, "\",\"level\":");
+		writeInt(w, scope->depth - rootScope->depth, 0);
+		writeText(w, ",\"parent\":");
+		if (scope->parentScope == NULL) writeText(w, "null");
+		else
 		{
-			scope = scope->next;
-			continue;
+			writeText(w, "\"");
+			writeText(w, scope->parentScope->name);
+			writeText(w, "\"");
 		}
-
-		int PrintSymbol = FALSE;
-		for (int i = 0; i < HASH_TABLE_SIZE; ++i)
+		writeText(w, ",\"symbols\":[");
+		for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
 		{
-			SymbolEntryRec *symbol = scope->symbols[i];
-			while (symbol != NULL)
+			writeText(w, "\n  {\"name\":\"");
+			writeText(w, symbol->name);
+			writeText(w, "\",\"kind\":\"");
+			writeText(w, SymbolKindToString(symbol->kind));
+			writeText(w, "\",\"type\":\"");
+			writeText(w, NodeTypeToString(symbol->type));
+			writeText(w, "\",\"location\":");
+			writeInt(w, symbol->memoryLocation, 0);
+			writeText(w, ",\"lines\":[");
+			writeLineUsage(w, symbol, ",");
+			writeText(w, "]");
+			if (symbol->kind == FunctionSym && symbol->type != Undetermined && symbol->node != NULL)
 			{
-				int nested_level = 0;
-				ScopeEntryRec *activeScope = scope;
-				while (scope != rootScope)
+				TreeNode *param = symbol->node->child[0];
+				writeText(w, ",\"params\":[");
+				if (param != NULL && param->type == Void) param = NULL;
+				while (param != NULL)
 				{
-					scope = scope->parentScope;
-					nested_level++;
+					writeText(w, "{\"name\":\"");
+					writeText(w, param->name);
+					writeText(w, "\",\"type\":\"");
+					writeText(w, NodeTypeToString(param->type));
+					writeText(w, "\"}");
+					param = param->sibling;
+					if (param != NULL) writeText(w, ",");
 				}
-				scope = activeScope;
-				fprintf(listing, "%-12s  %-12d  %-13s  %-11s\n", scope->name, nested_level, symbol->name, NodeTypeToString(symbol->type));
-				PrintSymbol = TRUE;
-				symbol = symbol->next;
+				writeText(w, "]");
 			}
+			writeText(w, "}");
+			if (symbol->nextInScope != NULL) writeText(w, ",");
 		}
-		if (PrintSymbol) fprintf(listing, "\n");
-		scope = scope->next;
+		writeText(w, "]}");
+		if (scope->next != NULL) writeText(w, ",");
 	}
+	writeText(w, "\n]}\n");
+}
+
+static void writeCsvReport(ReportWriter *w, ScopeEntryRec *rootScope)
+{
+	ScopeEntryRec *scope;
+	SymbolEntryRec *symbol;
 
+	writeText(w, "scope,level,name,kind,type,location,lines\n");
+	for (scope = allScopes; scope != NULL; scope = scope->next)
+		for (symbol = scope->firstSymbol; symbol != NULL; symbol = symbol->nextInScope)
+		{
+			writeText(w, scope->name);
+			writeText(w, ",");
+			writeInt(w, scope->depth - rootScope->depth, 0);
+			writeText(w, ",");
+			writeText(w, symbol->name);
+			writeText(w, ",");
+			writeText(w, SymbolKindToString(symbol->kind));
+			writeText(w, ",");
+			writeText(w, NodeTypeToString(symbol->type));
+			writeText(w, ",");
+			writeInt(w, symbol->memoryLocation, 0);
+			writeText(w, ",");
+			writeLineUsage(w, symbol, " ");
+			writeText(w, "\n");
+		}
 }
 
+void ExportSymbolTable(FILE *out, ScopeEntryRec *rootScope, int format)
+{
+	ReportWriter *w = (ReportWriter *)malloc(sizeof(ReportWriter));
+	w->out = out;
+	w->length = 0;
+	if (format == SymtabJson) writeJsonReport(w, rootScope);
+	else if (format == SymtabCsv) writeCsvReport(w, rootScope);
+	else
+		writeTextReport(w, rootScope);
+	flushReport(w);
+	free(w);
+}
 
+void DisplaySymbolTable(FILE *listing, ScopeEntryRec *rootScope)
+{
+	ExportSymbolTable(listing, rootScope, SymtabText);
+}
+
+/* DisplaySymtabStats prints the counters gathered since
+ * the last ResetScopes together with the occupancy of
+ * the buckets of every scope. "uniform" is the average
+ * number of entries a successful search would compare
+ * if the hash spread the names evenly over the buckets
+ */
+#define OCCUPANCY_CLASSES 8
+
+void DisplaySymtabStats(FILE *out)
+{
+	long occupancy[OCCUPANCY_CLASSES + 1] = {0};
+	long scopes = 0, filledScopes = 0, frozenScopes = 0, symbols = 0, used = 0, longest = 0;
+	double actualProbes = 0, uniformProbes = 0;
+	long lookups = atomic_load(&counters.lookups);
+	long scopesWalked = atomic_load(&counters.scopesWalked);
+	ScopeEntryRec *scope;
+	int i;
 
+	for (scope = allScopes; scope != NULL; scope = scope->next)
+	{
+		long inScope = 0;
+		++scopes;
+		if (scope->frozen != NULL) ++frozenScopes;
+		for (i = 0; i < HASH_TABLE_SIZE; ++i)
+		{
+			SymbolEntryRec *symbol;
+			long length = 0;
+			for (symbol = scope->symbols[i]; symbol != NULL; symbol = symbol->next) ++length;
+			++occupancy[length < OCCUPANCY_CLASSES ? length : OCCUPANCY_CLASSES];
+			if (length > 0) ++used;
+			if (length > longest) longest = length;
+			/* finding each entry of a chain costs 1 + 2 + ... + length */
+			actualProbes += length * (length + 1) / 2.0;
+			inScope += length;
+		}
+		symbols += inScope;
+		if (inScope > 0) ++filledScopes;
+		if (inScope > 0) uniformProbes += inScope * (1.0 + (inScope - 1) / (2.0 * HASH_TABLE_SIZE));
+	}
+
+	fprintf(out, "\nSymbol table statistics:\n");
+	fprintf(out, "  scopes           : %ld\n", scopes);
+	fprintf(out, "  symbols          : %ld (%ld inserted)\n", symbols, atomic_load(&counters.inserts));
+	fprintf(out, "  lookups          : %ld (%ld not found)\n", lookups, atomic_load(&counters.misses));
+	fprintf(out, "  scope walk depth : avg %.2f, max %ld\n",
+		lookups > 0 ? (double)scopesWalked / lookups : 0.0, atomic_load(&counters.maxScopesWalked));
+	fprintf(out, "  chain probes     : avg %.2f per scope searched, max %ld\n",
+		scopesWalked > 0 ? (double)atomic_load(&counters.probes) / scopesWalked : 0.0, atomic_load(&counters.maxProbes));
+	fprintf(out, "  frozen scopes    : %ld of %ld with symbols\n", frozenScopes, filledScopes);
+	fprintf(out, "  bloom skips      : %ld of %ld scopes searched\n", atomic_load(&counters.bloomSkips), scopesWalked);
+	fprintf(out, "  buckets          : %ld (%ld used), load %.3f, longest chain %ld\n",
+		scopes * HASH_TABLE_SIZE, used, scopes > 0 ? (double)symbols / (scopes * HASH_TABLE_SIZE) : 0.0, longest);
+	fprintf(out, "  probes per hit   : %.2f (uniform %.2f)\n",
+		symbols > 0 ? actualProbes / symbols : 0.0, symbols > 0 ? uniformProbes / symbols : 0.0);
+	fprintf(out, "  bucket occupancy :\n");
+	for (i = 0; i <= OCCUPANCY_CLASSES; ++i)
+		if (occupancy[i] > 0) fprintf(out, "    %d%s : %ld\n", i, i == OCCUPANCY_CLASSES ? "+" : " ", occupancy[i]);
+}
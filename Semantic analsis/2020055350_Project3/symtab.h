@@ -11,7 +11,19 @@
 
 #include "globals.h"
 
-#define HASH_TABLE_SIZE 211
+/* each scope hashes its symbols into HASH_TABLE_SIZE
+ * chains; the size is a power of two so that a bucket
+ * is picked with HASH_MASK
+ */
+#define HASH_TABLE_SIZE 256
+#define HASH_MASK (HASH_TABLE_SIZE - 1)
+
+/* each scope also keeps a BLOOM_BITS bit bloom filter of
+ * the hashes of its names, so that a search can pass over
+ * a scope that surely does not hold the name
+ */
+#define BLOOM_BITS 256
+#define BLOOM_WORDS (BLOOM_BITS / 64)
 
 
 
@@ -35,9 +47,14 @@ typedef struct SymbolEntryRec
 	NodeType type;
 	SymbolKind kind;
 	LineUsage lineUsage;
+	LineUsage lastUsage;
 	int memoryLocation;
+	int offset;
+	int listingBucket;
 	TreeNode *node;
+	struct ScopeEntryRec *scope;
 	struct SymbolEntryRec *next;
+	struct SymbolEntryRec *nextInScope;
 } SymbolEntryRec, *SymbolEntryList;
 
 typedef struct ScopeEntryRec
@@ -46,14 +63,30 @@ typedef struct ScopeEntryRec
 	ErrorState status;
 	TreeNode *functionNode;
 	SymbolEntryList symbols[HASH_TABLE_SIZE];
+	unsigned long long bloom[BLOOM_WORDS];
+	struct FrozenScopeRec *frozen;
 	int symbolCount;
+	int frameSize;
 	int nestedScopeCount;
+	int depth;
+	SymbolEntryRec *firstSymbol;
+	SymbolEntryRec *lastSymbol;
 	struct ScopeEntryRec *parentScope;
 	struct ScopeEntryRec *next;
+	struct ScopeEntryRec *nextWithName;
 } ScopeEntryRec, *ScopeEntryList;
 
 
 
+/* Names looked up in the symbol table must come from
+ * CopyName, which hashes them once with the SymtabHash
+ * function. NameHash returns that stored hash and
+ * HashName computes a hash of the given kind
+ */
+char* CopyName(char *s);
+unsigned NameHash(char *name);
+unsigned HashName(const char *key, int length, int kind);
+
 ScopeEntryRec* InsertScope(char *name, ScopeEntryRec *parentScope, TreeNode *functionNode);
 SymbolEntryRec* InsertSymbol(ScopeEntryRec *activeScope, char *name, NodeType type, SymbolKind kind, int lineno, TreeNode *node);
 SymbolEntryRec* InsertSymbolIntoScope(ScopeEntryRec *activeScope, char *name, int lineno);
@@ -61,6 +94,36 @@ SymbolEntryRec* SearchSymbol(ScopeEntryRec *activeScope, char *name);
 SymbolEntryRec* SearchSymbolInScope(ScopeEntryRec *activeScope, char *name);
 SymbolEntryRec* SearchSymbolByKind(ScopeEntryRec *activeScope, char *name, SymbolKind kind);
 
+/* All scopes are kept in one list in creation order.
+ * LastScope returns its tail, ResetScopes empties it and
+ * AppendScopes links an already built run of scopes
+ * (first ... last, chained by next) back to its end
+ */
+ScopeEntryRec* LastScope(void);
+void ResetScopes(void);
+void AppendScopes(ScopeEntryRec *first, ScopeEntryRec *last);
+
+/* FreezeScopes turns every scope into a compact read-only
+ * table once it is complete; lookups then no longer walk
+ * bucket chains and several threads may share the tables.
+ * Inserting into a frozen scope makes it chained again,
+ * and so does ThawSymbol, which returns the chained record
+ * of a symbol found by a lookup; a symbol must be thawed
+ * before it is changed
+ */
+void FreezeScopes(void);
+SymbolEntryRec* ThawSymbol(SymbolEntryRec *symbol);
+
+/* DisplaySymbolTable prints the symbol table as text
+ * tables. ExportSymbolTable prints it in the given
+ * SymtabFormat (text, JSON or CSV)
+ */
 void DisplaySymbolTable(FILE *listing, ScopeEntryRec *rootScope);
+void ExportSymbolTable(FILE *out, ScopeEntryRec *rootScope, int format);
+
+/* DisplaySymtabStats prints lookup counters and hash
+ * bucket occupancy for the current unit (--symtab-stats)
+ */
+void DisplaySymtabStats(FILE *out);
 
 #endif
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Compile each test/golden/*.cm and compare what the compiler
+# prints with the expected output next to it (name.out). The
+# first line of a case may be a comment giving the flags to
+# compile it with:  /* flags: --frames --no-ir */
+# and that line or the next may name other cases whose
+# interfaces it imports:  /* import: lib */
+# Cases are compiled in a scratch directory, so that no code
+# file is left behind. With -u the expected outputs are
+# written instead of compared.
+# usage: golden.sh [-u] [compiler] [case.cm...]
+
+UPDATE=0
+if [ "$1" = "-u" ]; then UPDATE=1; shift; fi
+CC_BIN=${1:-./cminus_semantic}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- "$(dirname "$0")"/golden/*.cm
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+CC_BIN=$(cd "$(dirname "$CC_BIN")" && pwd)/$(basename "$CC_BIN")
+
+failed=0
+for f in "$@"; do
+	name=$(basename "$f" .cm)
+	expected=${f%.cm}.out
+	flags=$(sed -n '1s/^\/\* flags: \(.*\) \*\/$/\1/p' "$f")
+	for lib in $(sed -n '1,2s/^\/\* import: \(.*\) \*\/$/\1/p' "$f"); do
+		cp "$(dirname "$f")/$lib.cm" "$DIR/$lib.cm"
+		(cd "$DIR" && "$CC_BIN" --emit-interface="$lib.if" "$lib.cm" > /dev/null 2>&1)
+		flags="$flags --import=$lib.if"
+	done
+	cp "$f" "$DIR/$name.cm"
+	(cd "$DIR" && "$CC_BIN" $flags "$name.cm" > "$name.txt" 2>&1)
+	if [ $UPDATE = 1 ]; then
+		cp "$DIR/$name.txt" "$expected"
+	elif diff -u "$expected" "$DIR/$name.txt" > "$DIR/$name.diff"; then
+		echo "ok      $name"
+	else
+		echo "FAILED  $name"
+		cat "$DIR/$name.diff"
+		failed=1
+	fi
+done
+exit $failed
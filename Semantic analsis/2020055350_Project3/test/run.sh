@@ -0,0 +1,60 @@
+#!/bin/sh
+# Compile each test/run/*.cm, run the code on TM and compare
+# what it outputs with the expected output next to it
+# (name.out). Every case is compiled once with each set of
+# flags in CONFIGS, and each must print the same. The first
+# line of a case may give the values input() reads:
+#   /* input: 2147483647 -2147483647 */
+# With -u the expected outputs are written (from the first
+# set of flags) instead of compared.
+# usage: run.sh [-u] [compiler] [tm] [case.cm...]
+
+UPDATE=0
+if [ "$1" = "-u" ]; then UPDATE=1; shift; fi
+CC_BIN=${1:-./cminus_semantic}
+TM_BIN=${2:-./tm}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- "$(dirname "$0")"/run/*.cm
+CONFIGS=${CONFIGS:-"-|--no-simplify|--no-peephole|--no-sccp|--no-licm|--no-inline|--no-ir|--no-ir --no-simplify"}
+LIMIT=${LIMIT:-1000000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+CC_BIN=$(cd "$(dirname "$CC_BIN")" && pwd)/$(basename "$CC_BIN")
+TM_BIN=$(cd "$(dirname "$TM_BIN")" && pwd)/$(basename "$TM_BIN")
+
+failed=0
+for f in "$@"; do
+	name=$(basename "$f" .cm)
+	expected=${f%.cm}.out
+	inputs=$(sed -n '1s/^\/\* input: \(.*\) \*\/$/\1/p' "$f")
+	cp "$f" "$DIR/$name.cm"
+	ok=1
+	IFS='|'
+	for flags in $CONFIGS; do
+		IFS=' '
+		[ "$flags" = "-" ] && flags=
+		rm -f "$DIR/$name.tm"
+		(cd "$DIR" && "$CC_BIN" $flags "$name.cm" > /dev/null 2>&1)
+		if [ -f "$DIR/$name.tm" ]; then
+			{ printf 'g %d\n' "$LIMIT"; for v in $inputs; do echo "$v"; done; } |
+				"$TM_BIN" "$DIR/$name.tm" | sed -n 's/.*OUT instruction prints: //p' > "$DIR/$name.txt"
+		else
+			echo "no code" > "$DIR/$name.txt"
+		fi
+		if [ $UPDATE = 1 ]; then
+			cp "$DIR/$name.txt" "$expected"
+			break
+		elif ! diff -u "$expected" "$DIR/$name.txt" > "$DIR/$name.diff"; then
+			echo "FAILED  $name ${flags:-(default flags)}"
+			cat "$DIR/$name.diff"
+			ok=0
+			failed=1
+		fi
+		IFS='|'
+	done
+	IFS=' '
+	[ $UPDATE = 1 ] || [ $ok = 0 ] || echo "ok      $name"
+done
+exit $failed
@@ -0,0 +1,177 @@
+/****************************************************/
+/* File: timing.c                                   */
+/* Per-phase time and memory report                 */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "timing.h"
+#include <time.h>
+#include <sys/resource.h>
+
+typedef struct PhaseTotals
+{
+	double wall;
+	double cpu;
+	long allocations;
+	long bytes;
+	long peakRss;
+	long entries;
+} PhaseTotals;
+
+static const char *phaseNames[PHASE_COUNT] = {"scan", "parse", "symtab", "typecheck", "optimize", "codegen", "listing"};
+
+/* -1 while no phase is running */
+static int currentPhase = -1;
+static PhaseTotals totals[PHASE_COUNT];
+
+/* counters when the current phase was last entered */
+static double startWall, startCpu;
+static long startAllocations, startBytes;
+
+/* last sample of the resident set and when it was taken */
+static long rssSample;
+static double rssSampleWall = -1;
+
+static double seconds(clockid_t clock)
+{
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* peakRss returns the high-water mark of the resident
+ * set of the process so far, in kilobytes
+ */
+static long peakRss(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/* switchPhase closes the interval of the running phase
+ * and opens one for phase. The scanner is entered for
+ * every token, and reading the CPU clock or the resident
+ * set is a system call; around it CPU time is taken to be
+ * wall time (scanning and parsing run on one thread) and
+ * the resident set is sampled at most once a millisecond
+ */
+static void switchPhase(int phase, int exact)
+{
+	double wall = seconds(CLOCK_MONOTONIC);
+	int scanning = phase == ScanPhase || currentPhase == ScanPhase;
+	double cpu = scanning && !exact ? startCpu + (wall - startWall) : seconds(CLOCK_PROCESS_CPUTIME_ID);
+	long allocations, bytes;
+
+	allocStats(&allocations, &bytes);
+	if (exact || rssSampleWall < 0 || wall - rssSampleWall >= 1e-3)
+	{
+		rssSample = peakRss();
+		rssSampleWall = wall;
+	}
+	if (currentPhase >= 0)
+	{
+		PhaseTotals *p = &totals[currentPhase];
+		long rss = rssSample;
+		p->wall += wall - startWall;
+		p->cpu += cpu - startCpu;
+		p->allocations += allocations - startAllocations;
+		p->bytes += bytes - startBytes;
+		if (rss > p->peakRss) p->peakRss = rss;
+	}
+	if (phase >= 0) ++totals[phase].entries;
+	currentPhase = phase;
+	startWall = wall;
+	startCpu = cpu;
+	startAllocations = allocations;
+	startBytes = bytes;
+}
+
+int enterPhase(int phase)
+{
+	int previous = currentPhase;
+	if (TimeReport != TimeReportNone && phase != currentPhase) switchPhase(phase, FALSE);
+	return previous;
+}
+
+void leavePhase(int previous)
+{
+	if (TimeReport != TimeReportNone && previous != currentPhase) switchPhase(previous, FALSE);
+}
+
+void resetTimeReport(void)
+{
+	memset(totals, 0, sizeof(totals));
+	currentPhase = -1;
+	rssSampleWall = -1;
+}
+
+/* cpuEstimated tells whether the CPU time of phase is not
+ * measured on its own (see switchPhase)
+ */
+static int cpuEstimated(int phase)
+{
+	return (phase == ScanPhase || phase == ParsePhase) && totals[ScanPhase].entries > 0;
+}
+
+static void printText(FILE *out, PhaseTotals *sum)
+{
+	int i;
+	fprintf(out, "\nTime report\n");
+	fprintf(out, " Phase        Wall (ms)   CPU (ms)    Allocs       Bytes  Peak RSS (KB)\n");
+	fprintf(out, " ----------  ----------  ----------  --------  ----------  -------------\n");
+	for (i = 0; i <= PHASE_COUNT; ++i)
+	{
+		PhaseTotals *p = i < PHASE_COUNT ? &totals[i] : sum;
+		if (i == PHASE_COUNT) fprintf(out, " ----------  ----------  ----------  --------  ----------  -------------\n");
+		else if (p->entries == 0) continue;
+		fprintf(out, " %-10s  %10.3f  %9.3f%c  %8ld  %10ld  %13ld\n", i < PHASE_COUNT ? phaseNames[i] : "total",
+			p->wall * 1e3, p->cpu * 1e3, i < PHASE_COUNT && cpuEstimated(i) ? '*' : ' ', p->allocations, p->bytes,
+			p->peakRss);
+	}
+	if (cpuEstimated(ScanPhase))
+		fprintf(out, " * estimated: scan CPU time is taken to be its wall time, and parse\n"
+			"   is charged the rest of the CPU time the two take together\n");
+}
+
+static void printJson(FILE *out, PhaseTotals *sum)
+{
+	int i, first = TRUE;
+	fprintf(out, "{\n  \"phases\": [");
+	for (i = 0; i < PHASE_COUNT; ++i)
+	{
+		PhaseTotals *p = &totals[i];
+		if (p->entries == 0) continue;
+		fprintf(out, "%s\n    {\"phase\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"cpu_estimated\": %s, "
+			"\"allocations\": %ld, \"bytes\": %ld, \"peak_rss_kb\": %ld}",
+			first ? "" : ",", phaseNames[i], p->wall * 1e3, p->cpu * 1e3, cpuEstimated(i) ? "true" : "false",
+			p->allocations, p->bytes, p->peakRss);
+		first = FALSE;
+	}
+	fprintf(out, "\n  ],\n  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocations\": %ld, "
+		"\"bytes\": %ld, \"peak_rss_kb\": %ld}\n}\n",
+		sum->wall * 1e3, sum->cpu * 1e3, sum->allocations, sum->bytes, sum->peakRss);
+}
+
+void printTimeReport(FILE *out, int format)
+{
+	PhaseTotals sum;
+	int i;
+
+	/* close the interval of a phase still running */
+	if (currentPhase >= 0) switchPhase(currentPhase, TRUE);
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < PHASE_COUNT; ++i)
+	{
+		sum.wall += totals[i].wall;
+		sum.cpu += totals[i].cpu;
+		sum.allocations += totals[i].allocations;
+		sum.bytes += totals[i].bytes;
+		if (totals[i].peakRss > sum.peakRss) sum.peakRss = totals[i].peakRss;
+	}
+	if (format == TimeReportJson) printJson(out, &sum);
+	else
+		printText(out, &sum);
+	fflush(out);
+}
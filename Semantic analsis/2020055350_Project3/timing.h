@@ -0,0 +1,42 @@
+/****************************************************/
+/* File: timing.h                                   */
+/* Per-phase time and memory report                 */
+/****************************************************/
+
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include "globals.h"
+
+typedef enum
+{
+	ScanPhase,
+	ParsePhase,
+	SymtabPhase,
+	TypeCheckPhase,
+	OptimizePhase,
+	CodeGenPhase,
+	ListingPhase,
+	PHASE_COUNT
+} CompilerPhase;
+
+/* Function enterPhase charges what follows to phase and
+ * returns the phase that was running, which leavePhase
+ * resumes. Phases nest: time spent scanning while the
+ * parser runs is charged to the scanner only. Nothing
+ * is measured unless TimeReport is set
+ */
+int enterPhase(int phase);
+void leavePhase(int previous);
+
+/* Procedure printTimeReport prints wall and CPU time,
+ * allocations (heap and unit) and the peak resident set
+ * of every phase since the last resetTimeReport, as a
+ * table or as JSON (a TimeReportKind). The CPU time of
+ * scan and parse is only measured for the two together;
+ * the report marks their split as estimated
+ */
+void printTimeReport(FILE *out, int format);
+void resetTimeReport(void);
+
+#endif
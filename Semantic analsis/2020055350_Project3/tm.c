@@ -18,8 +18,8 @@
 #endif
 
 /******* const *******/
-#define   IADDR_SIZE  1024 /* increase for large programs */
-#define   DADDR_SIZE  1024 /* increase for large programs */
+#define   IADDR_LIMIT 16777216 /* largest program */
+#define   DADDR_SIZE  4096 /* increase for large programs */
 #define   NO_REGS 8
 #define   PC_REG  7
 
@@ -67,7 +67,8 @@ typedef enum {
    srHALT,
    srIMEM_ERR,
    srDMEM_ERR,
-   srZERODIVIDE
+   srZERODIVIDE,
+   srEOF
    } STEPRESULT;
 
 typedef struct {
@@ -82,8 +83,14 @@ int iloc = 0 ;
 int dloc = 0 ;
 int traceflag = FALSE;
 int icountflag = FALSE;
-
-INSTRUCTION iMem [IADDR_SIZE];
+int memcount = 0; /* data memory accesses of the last 'go' */
+
+/* instruction memory grows as the program is read;
+ * iSize is one past the highest location loaded
+ */
+INSTRUCTION * iMem = NULL;
+int iSize = 0;
+int iCapacity = 0;
 int dMem [DADDR_SIZE];
 int reg [NO_REGS];
 
@@ -97,10 +104,10 @@ char * opCodeTab[]
 
 char * stepResultTab[]
         = {"OK","Halted","Instruction Memory Fault",
-           "Data Memory Fault","Division by 0"
+           "Data Memory Fault","Division by 0","End of input"
           };
 
-char pgmName[20];
+char pgmName[120];
 FILE *pgm  ;
 
 char in_Line[LINESIZE] ;
@@ -111,6 +118,19 @@ char word[WORDSIZE] ;
 char ch  ;
 int done  ;
 
+/********************************************/
+/* readLine reads a line of standard input into
+ * in_Line; it returns FALSE at the end of input
+ */
+int readLine (void)
+{ if (fgets(in_Line, LINESIZE, stdin) == NULL)
+  { in_Line[0] = '\0';
+    return FALSE;
+  }
+  in_Line[strcspn(in_Line, "\n")] = '\0';
+  return TRUE;
+} /* readLine */
+
 /********************************************/
 int opClass( int c )
 { if      ( c <= opRRLim) return ( opclRR );
@@ -121,7 +141,7 @@ int opClass( int c )
 /********************************************/
 void writeInstruction ( int loc )
 { printf( "%5d: ", loc) ;
-  if ( (loc >= 0) && (loc < IADDR_SIZE) )
+  if ( (loc >= 0) && (loc < iSize) )
   { printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
     switch ( opClass(iMem[loc].iop) )
     { case opclRR: printf("%1d,%1d", iMem[loc].iarg2, iMem[loc].iarg3);
@@ -218,6 +238,37 @@ int error( char * msg, int lineNo, int instNo)
 } /* error */
 
 /********************************************/
+/* Procedure growIMem makes room for locations up
+ * to (not including) size; a location the program
+ * does not set holds HALT 0,0,0
+ */
+void growIMem( int size )
+{ if (size > iCapacity)
+  { int n = iCapacity == 0 ? 1024 : iCapacity ;
+    while (n < size) n *= 2 ;
+    iMem = realloc(iMem, n * sizeof(INSTRUCTION)) ;
+    if (iMem == NULL)
+    { printf("Out of memory for instructions\n") ;
+      exit(1) ;
+    }
+    iCapacity = n ;
+  }
+  while (iSize < size)
+  { iMem[iSize].iop = opHALT ;
+    iMem[iSize].iarg1 = 0 ;
+    iMem[iSize].iarg2 = 0 ;
+    iMem[iSize].iarg3 = 0 ;
+    iSize++ ;
+  }
+} /* growIMem */
+
+/********************************************/
+/* The instructions are read in one pass and stored
+ * as they come. Code is normally in location order,
+ * so memory just grows at the end; a location out of
+ * order (as in code from a backpatching compiler) is
+ * stored all the same
+ */
 int readInstructions (void)
 { OPCODE op;
   int arg1, arg2, arg3;
@@ -227,25 +278,26 @@ int readInstructions (void)
   dMem[0] = DADDR_SIZE - 1 ;
   for (loc = 1 ; loc < DADDR_SIZE ; loc++)
       dMem[loc] = 0 ;
-  for (loc = 0 ; loc < IADDR_SIZE ; loc++)
-  { iMem[loc].iop = opHALT ;
-    iMem[loc].iarg1 = 0 ;
-    iMem[loc].iarg2 = 0 ;
-    iMem[loc].iarg3 = 0 ;
-  }
+  iSize = 0 ;
   lineNo = 0 ;
-  while (! feof(pgm))
-  { fgets( in_Line, LINESIZE-2, pgm  ) ;
-    inCol = 0 ; 
+  while (fgets( in_Line, LINESIZE-2, pgm ) != NULL)
+  { inCol = 0 ; 
     lineNo++;
     lineLen = strlen(in_Line)-1 ;
     if (in_Line[lineLen]=='\n') in_Line[lineLen] = '\0' ;
-    else in_Line[++lineLen] = '\0';
+    else
+    { int ch ;
+      /* the rest of a long line (a comment) is skipped */
+      while ((ch = getc(pgm)) != EOF && ch != '\n') ;
+      in_Line[++lineLen] = '\0';
+    }
     if ( (nonBlank()) && (in_Line[inCol] != '*') )
     { if (! getNum())
         return error("Bad location", lineNo,-1);
       loc = num;
-      if (loc > IADDR_SIZE)
+      if (loc < 0)
+        return error("Bad location",lineNo,loc);
+      if (loc >= IADDR_LIMIT)
         return error("Location too large",lineNo,loc);
       if (! skipCh(':'))
         return error("Missing colon", lineNo,loc);
@@ -293,6 +345,7 @@ int readInstructions (void)
         arg3 = num;
         break;
         }
+      growIMem(loc+1);
       iMem[loc].iop = op;
       iMem[loc].iarg1 = arg1;
       iMem[loc].iarg2 = arg2;
@@ -311,10 +364,18 @@ STEPRESULT stepTM (void)
   int ok ;
 
   pc = reg[PC_REG] ;
-  if ( (pc < 0) || (pc > IADDR_SIZE)  )
+  if ( pc < 0 )
       return srIMEM_ERR ;
   reg[PC_REG] = pc + 1 ;
-  currentinstruction = iMem[ pc ] ;
+  if ( pc < iSize )
+      currentinstruction = iMem[ pc ] ;
+  else
+  { /* past the program memory holds HALT 0,0,0 */
+    currentinstruction.iop = opHALT ;
+    currentinstruction.iarg1 = 0 ;
+    currentinstruction.iarg2 = 0 ;
+    currentinstruction.iarg3 = 0 ;
+  }
   switch (opClass(currentinstruction.iop) )
   { case opclRR :
     /***********************************/
@@ -354,7 +415,7 @@ STEPRESULT stepTM (void)
       { printf("Enter value for IN instruction: ") ;
         fflush (stdin);
         fflush (stdout);
-        gets(in_Line);
+        if (! readLine ()) return srEOF ;
         lineLen = strlen(in_Line) ;
         inCol = 0;
         ok = getNum();
@@ -378,8 +439,8 @@ STEPRESULT stepTM (void)
       break;
 
     /*************** RM instructions ********************/
-    case opLD :    reg[r] = dMem[m] ;  break;
-    case opST :    dMem[m] = reg[r] ;  break;
+    case opLD :    reg[r] = dMem[m] ; memcount++ ;  break;
+    case opST :    dMem[m] = reg[r] ; memcount++ ;  break;
 
     /*************** RA instructions ********************/
     case opLDA :    reg[r] = m ; break;
@@ -399,7 +460,7 @@ STEPRESULT stepTM (void)
 /********************************************/
 int doCommand (void)
 { char cmd;
-  int stepcnt=0, i;
+  int stepcnt=0, steplimit=0, i;
   int printcnt;
   int stepResult;
   int regNo, loc;
@@ -407,7 +468,7 @@ int doCommand (void)
   { printf ("Enter command: ");
     fflush (stdin);
     fflush (stdout);
-    gets(in_Line);
+    if (! readLine ()) return FALSE;
     lineLen = strlen(in_Line);
     inCol = 0;
   }
@@ -427,8 +488,9 @@ int doCommand (void)
       printf("Commands are:\n");
       printf("   s(tep <n>      "\
              "Execute n (default 1) TM instructions\n");
-      printf("   g(o            "\
-             "Execute TM instructions until HALT\n");
+      printf("   g(o <n>        "\
+             "Execute TM instructions until HALT\n"\
+             "                  (or at most n of them)\n");
       printf("   r(egs          "\
              "Print the contents of the registers\n");
       printf("   i(Mem <b <n>>  "\
@@ -439,7 +501,7 @@ int doCommand (void)
              "Toggle instruction trace\n");
       printf("   p(rint         "\
              "Toggle print of total instructions executed"\
-             " ('go' only)\n");
+             " and memory accesses ('go' only)\n");
       printf("   c(lear         "\
              "Reset simulator for new execution of program\n");
       printf("   h(elp          "\
@@ -462,7 +524,12 @@ int doCommand (void)
       else   printf("Step count?\n");
       break;
 
-    case 'g' :   stepcnt = 1 ;     break;
+    case 'g' :
+    /***********************************/
+      stepcnt = 1 ;
+      steplimit = 0 ;
+      if ( ! atEOL () && getNum () ) steplimit = abs(num);
+      break;
 
     case 'r' :
     /***********************************/
@@ -482,7 +549,7 @@ int doCommand (void)
       if ( ! atEOL ())
         printf ("Instruction locations?\n");
       else
-      { while ((iloc >= 0) && (iloc < IADDR_SIZE)
+      { while ((iloc >= 0) && (iloc < iSize)
                 && (printcnt > 0) )
         { writeInstruction(iloc);
           iloc++ ;
@@ -530,14 +597,18 @@ int doCommand (void)
   if ( stepcnt > 0 )
   { if ( cmd == 'g' )
     { stepcnt = 0;
-      while (stepResult == srOKAY)
+      memcount = 0;
+      while ((stepResult == srOKAY) &&
+             ((steplimit == 0) || (stepcnt < steplimit)))
       { iloc = reg[PC_REG] ;
         if ( traceflag ) writeInstruction( iloc ) ;
         stepResult = stepTM ();
         stepcnt++;
       }
       if ( icountflag )
-        printf("Number of instructions executed = %d\n",stepcnt);
+      { printf("Number of instructions executed = %d\n",stepcnt);
+        printf("Number of memory accesses = %d\n",memcount);
+      }
     }
     else
     { while ((stepcnt > 0) && (stepResult == srOKAY))
@@ -557,7 +628,7 @@ int doCommand (void)
 /* E X E C U T I O N   B E G I N S   H E R E */
 /********************************************/
 
-main( int argc, char * argv[] )
+int main( int argc, char * argv[] )
 { if (argc != 2)
   { printf("usage: %s <filename>\n",argv[0]);
     exit(1);
@@ -0,0 +1,941 @@
+/****************************************************/
+/* File: tmgen.c                                    */
+/* TM code generation from the intermediate         */
+/* representation                                   */
+/****************************************************/
+
+#include "globals.h"
+#include "code.h"
+#include "ir.h"
+#include "tmgen.h"
+#include <limits.h>
+
+/* the activation record is that of cgen.c: the return
+ * address at 0(mp), then the frame words, then the
+ * homes of temps, then the record of a callee
+ */
+#define FRAME_HEADER 1
+
+/* registers 0 to NREGS-1 hold values */
+#define NREGS 5
+
+#define NEVER INT_MAX
+
+/* a vreg used in more than one block */
+#define MANY_BLOCKS (-2)
+
+/* registers a block entered from later blocks may
+ * expect to hold values: the others are left for the
+ * branch of the block that jumps back
+ */
+#define MAX_CARRIED (NREGS - 2)
+
+static IrFunction *function = NULL;
+
+/* per vreg: the block it is used in (or MANY_BLOCKS),
+ * its home word from mp (or -1), the register holding
+ * it (or -1), and the position of its next use in the
+ * current block
+ */
+static int *blockOf = NULL;
+static int *home = NULL;
+static int *regOf = NULL;
+static int *nextUse = NULL;
+static int homeCount = 0;
+
+/* per register: the vreg it holds (or -1), whether that
+ * value is not in its home, and whether the instruction
+ * being generated still needs it
+ */
+static int regVreg[NREGS];
+static int regDirty[NREGS];
+static int regLocked[NREGS];
+
+/* per block, by id, NREGS words each: the vreg left in
+ * each register at its end (or -1), and for a block
+ * also entered from blocks laid out after it, the vreg
+ * they must leave in each register before going to it.
+ * lastBack is the last of those blocks (or -1), and
+ * carried marks the vregs expected by the blocks whose
+ * range of blocks up to it holds the current one
+ */
+static int *exitState = NULL;
+static int *entryState = NULL;
+static int *lastBack = NULL;
+static int *carried = NULL;
+
+/* uses holds, for each instruction of the current
+ * block, the next use after it of the vreg in each of
+ * its slots (dest, a, b, c, then args); first is the
+ * first slot of each instruction
+ */
+static int *uses = NULL;
+static int useCapacity = 0;
+static int *first = NULL;
+static int firstCapacity = 0;
+
+/* instructions whose displacement is counted from the
+ * end of the frame, known once the function is done
+ */
+typedef struct
+{
+	int loc;
+	int sign;
+} FramePatch;
+
+static FramePatch *patches = NULL;
+static int patchCount = 0, patchCapacity = 0;
+
+/* functions gives the label of each function's code;
+ * defined tells whether its body has been emitted
+ */
+typedef struct FunctionLabelRec
+{
+	char *name;
+	int label;
+	int defined;
+	struct FunctionLabelRec *next;
+} FunctionLabelRec;
+
+static FunctionLabelRec *functions = NULL;
+
+static FunctionLabelRec *functionOf(char *name)
+{
+	FunctionLabelRec *l;
+	for (l = functions; l != NULL; l = l->next)
+		if (strcmp(l->name, name) == 0) return l;
+	l = malloc(sizeof(FunctionLabelRec));
+	l->name = name;
+	l->label = newLabel();
+	l->defined = FALSE;
+	l->next = functions;
+	functions = l;
+	return l;
+}
+
+static int isLocalTemp(int v)
+{
+	return function->vregs[v].word < 0 && blockOf[v] != MANY_BLOCKS;
+}
+
+static int homeOf(int v)
+{
+	if (home[v] < 0)
+		home[v] = function->vregs[v].word >= 0 ? FRAME_HEADER + function->vregs[v].word
+											   : FRAME_HEADER + function->frameSize + homeCount++;
+	return home[v];
+}
+
+static void emitFrameRM(char *op, int r, int d, int sign, char *c)
+{
+	if (patchCount == patchCapacity)
+	{
+		patchCapacity = patchCapacity == 0 ? 64 : 2 * patchCapacity;
+		patches = realloc(patches, patchCapacity * sizeof(FramePatch));
+	}
+	patches[patchCount].loc = codeSize;
+	patches[patchCount++].sign = sign;
+	emitRM(op, r, d, mp, c);
+}
+
+/********************************************/
+/* registers                                */
+/********************************************/
+
+static void unbind(int r)
+{
+	if (regVreg[r] >= 0) regOf[regVreg[r]] = -1;
+	regVreg[r] = -1;
+	regDirty[r] = FALSE;
+}
+
+static void bind(int r, int v, int dirty)
+{
+	if (regOf[v] >= 0 && regOf[v] != r) unbind(regOf[v]);
+	unbind(r);
+	regVreg[r] = v;
+	regDirty[r] = dirty;
+	regOf[v] = r;
+}
+
+static void spill(int r)
+{
+	if (regDirty[r])
+	{
+		emitRM("ST", r, homeOf(regVreg[r]), mp, "spill temp");
+		regDirty[r] = FALSE;
+	}
+}
+
+/* distance tells how soon v is used again; a value the
+ * enclosing loop expects on its next turn comes before
+ * the ones not used again in the block
+ */
+static int distance(int v)
+{
+	return nextUse[v] == NEVER && carried[v] ? NEVER - 1 : nextUse[v];
+}
+
+/* allocReg returns a register the current instruction
+ * does not need, preferring a free one, then one whose
+ * value is in memory, then the one used last
+ */
+static int allocReg(void)
+{
+	int r, best = -1, bestClean = -1;
+	for (r = 0; r < NREGS; r++)
+		if (!regLocked[r] && regVreg[r] < 0) return r;
+	for (r = 0; r < NREGS; r++)
+	{
+		int v = regVreg[r];
+		if (regLocked[r]) continue;
+		if (!regDirty[r] && (bestClean < 0 || distance(v) > distance(regVreg[bestClean]))) bestClean = r;
+		if (best < 0 || distance(v) > distance(regVreg[best])) best = r;
+	}
+	r = bestClean >= 0 ? bestClean : best;
+	if (r < 0)
+	{
+		emitComment("BUG: out of registers");
+		return ac;
+	}
+	spill(r);
+	unbind(r);
+	return r;
+}
+
+static int lock(int r)
+{
+	regLocked[r] = TRUE;
+	return r;
+}
+
+/* use returns a register holding operand o, loading it
+ * if need be
+ */
+static int use(IrOperand o)
+{
+	int r;
+	if (o.kind == IrReg && regOf[o.val] >= 0) return lock(regOf[o.val]);
+	r = lock(allocReg());
+	if (o.kind == IrImm) emitRM("LDC", r, o.val, 0, "load const");
+	else if (o.kind == IrReg)
+	{
+		if (isLocalTemp(o.val) && home[o.val] < 0) emitComment("BUG: temp used before it is set");
+		emitRM("LD", r, homeOf(o.val), mp, "load vreg");
+		bind(r, o.val, FALSE);
+	}
+	return r;
+}
+
+/* release frees the register of operand o, at slot s
+ * of the instruction being generated, if it dies there;
+ * the result may go to it
+ */
+static void release(IrOperand o, int s)
+{
+	if (o.kind == IrReg)
+	{
+		nextUse[o.val] = uses[s];
+		if (uses[s] == NEVER && isLocalTemp(o.val) && regOf[o.val] >= 0)
+		{
+			regLocked[regOf[o.val]] = FALSE;
+			unbind(regOf[o.val]);
+		}
+	}
+}
+
+static void unlockAll(void)
+{
+	int r;
+	for (r = 0; r < NREGS; r++) regLocked[r] = FALSE;
+}
+
+/* define returns the register for the value of v set
+ * by the instruction at slot s, the one v is in if any,
+ * as its old value is read before it is written;
+ * finish stores it home if v lives in memory
+ */
+static int define(int v, int s)
+{
+	int r = regOf[v] >= 0 ? regOf[v] : allocReg();
+	nextUse[v] = uses[s];
+	return r;
+}
+
+static void finish(int v, int r)
+{
+	bind(r, v, isLocalTemp(v));
+	if (!isLocalTemp(v)) emitRM("ST", r, homeOf(v), mp, "store vreg");
+	else if (nextUse[v] == NEVER)
+		unbind(r);
+}
+
+static void forgetAll(void)
+{
+	int r;
+	for (r = 0; r < NREGS; r++) unbind(r);
+}
+
+/********************************************/
+/* next uses                                */
+/********************************************/
+
+static int slotCount(IrInstr *i)
+{
+	return 4 + (i->op == IrCall ? i->nargs : 0);
+}
+
+static void noteUse(IrOperand o, int s, int k)
+{
+	if (o.kind == IrReg)
+	{
+		uses[s] = nextUse[o.val];
+		nextUse[o.val] = k;
+	}
+}
+
+/* findUses fills uses for block b, and nextUse with the
+ * first use in b of each vreg
+ */
+static void findUses(IrBlock *b)
+{
+	IrInstr *i;
+	int n = 0, slots = 0, k, a;
+	for (i = b->first; i != NULL; i = i->next)
+	{
+		n++;
+		slots += slotCount(i);
+	}
+	if (n + 1 > firstCapacity)
+	{
+		firstCapacity = 2 * (n + 1);
+		first = realloc(first, firstCapacity * sizeof(int));
+	}
+	if (slots > useCapacity)
+	{
+		useCapacity = 2 * slots;
+		uses = realloc(uses, useCapacity * sizeof(int));
+	}
+	k = 0;
+	slots = 0;
+	for (i = b->first; i != NULL; i = i->next)
+	{
+		first[k++] = slots;
+		slots += slotCount(i);
+	}
+	for (i = b->first; i != NULL; i = i->next)
+	{
+		if (i->dest >= 0) nextUse[i->dest] = NEVER;
+		if (i->a.kind == IrReg) nextUse[i->a.val] = NEVER;
+		if (i->b.kind == IrReg) nextUse[i->b.val] = NEVER;
+		if (i->c.kind == IrReg) nextUse[i->c.val] = NEVER;
+		for (a = 0; i->op == IrCall && a < i->nargs; a++)
+			if (i->args[a].kind == IrReg) nextUse[i->args[a].val] = NEVER;
+	}
+	for (i = b->last, k = n - 1; i != NULL; i = i->prev, k--)
+	{
+		int s = first[k];
+		if (i->dest >= 0)
+		{
+			uses[s] = nextUse[i->dest];
+			nextUse[i->dest] = NEVER;
+		}
+		for (a = i->op == IrCall ? i->nargs - 1 : -1; a >= 0; a--) noteUse(i->args[a], s + 4 + a, k);
+		noteUse(i->c, s + 3, k);
+		noteUse(i->b, s + 2, k);
+		noteUse(i->a, s + 1, k);
+	}
+}
+
+/********************************************/
+/* instructions                             */
+/********************************************/
+
+static int *labels = NULL; /* code label of each block */
+
+/* Function relopJump returns the jump taken when the
+ * value compare leaves for comparison op says it holds,
+ * or with negate set, that it fails
+ */
+static char *relopJump(TokenType op, int negate)
+{
+	if (negate)
+		op = op == LT ? GE : op == LE ? GT : op == GT ? LE : op == GE ? LT : op == EQ ? NE : EQ;
+	return op == LT ? "JLT" : op == LE ? "JLE" : op == GT ? "JGT" : op == GE ? "JGE" : op == EQ ? "JEQ" : "JNE";
+}
+
+/* compare leaves in rd a value that is negative, zero
+ * or positive as a of comparison or branch i is less
+ * than, equal to or greater than b, with a in ra and b
+ * in rb (if not a constant), and returns the register
+ * it is in. a - b does for == and !=, but for an
+ * ordering it overflows when the signs differ, so the
+ * signs are compared first
+ */
+static int compare(IrInstr *i, int ra, int rb, int rd)
+{
+	int k = i->b.val;
+	int order = i->relop != EQ && i->relop != NE;
+	if (rb >= 0)
+	{
+		if (order)
+		{
+			emitRM("JLT", ra, 3, pc, "compare: a negative");
+			emitRM("JGE", rb, 5, pc, "compare: same signs");
+			emitRM("LDC", rd, 1, 0, "compare: greater");
+			emitRM("LDA", pc, 4, pc, "compare: done");
+			emitRM("JLT", rb, 2, pc, "compare: same signs");
+			emitRM("LDC", rd, -1, 0, "compare: less");
+			emitRM("LDA", pc, 1, pc, "compare: done");
+		}
+		emitRO("SUB", rd, ra, rb, "compare");
+		return rd;
+	}
+	if (k == 0) return ra;
+	if (order)
+	{
+		/* a - k only overflows for an a of the other sign */
+		emitRM(k > 0 ? "JGE" : "JLT", ra, 2, pc, "compare: same signs");
+		emitRM("LDC", rd, k > 0 ? -1 : 1, 0, k > 0 ? "compare: less" : "compare: greater");
+		emitRM("LDA", pc, 1, pc, "compare: done");
+	}
+	emitRM("LDA", rd, (int)(0u - (unsigned)k), ra, "compare with const");
+	return rd;
+}
+
+/* address returns the register the word of load or
+ * store i is addressed from and puts the displacement
+ * in disp; ri and rp hold the index and the pointer, if
+ * any, and rt is set to their sum if need be
+ */
+static int address(IrInstr *i, int ri, int rp, int rt, int *disp)
+{
+	int k = i->a.kind == IrImm ? i->a.val : 0;
+	switch (i->space)
+	{
+	case IrGlobal:
+		/* an element of a global array is addressed by its
+		 * index alone, as gp is 0
+		 */
+		*disp = i->disp + k;
+		return i->a.kind == IrReg ? ri : gp;
+	case IrFrame:
+		*disp = FRAME_HEADER + i->disp + k;
+		if (i->a.kind != IrReg) return mp;
+		emitRO("ADD", rt, ri, mp, "element address");
+		return rt;
+	default:
+		*disp = k;
+		if (i->a.kind != IrReg) return rp;
+		emitRO("ADD", rt, ri, rp, "element address");
+		return rt;
+	}
+}
+
+static int needsSum(IrInstr *i)
+{
+	return i->a.kind == IrReg && i->space != IrGlobal;
+}
+
+/* isPure tells whether i can be left out when its value
+ * is not used
+ */
+static int isPure(IrInstr *i)
+{
+	return i->op == IrCopy || i->op == IrAdd || i->op == IrSub || i->op == IrMul || i->op == IrCmp ||
+		   i->op == IrAddr;
+}
+
+static void genCall(IrInstr *i, int s)
+{
+	int k, r;
+	for (k = 0; k < i->nargs; k++)
+	{
+		r = use(i->args[k]);
+		emitFrameRM("ST", r, FRAME_HEADER + k, 1, "call: store argument");
+		release(i->args[k], s + 4 + k);
+		unlockAll();
+	}
+	/* the callee may use every register */
+	for (r = 0; r < NREGS; r++)
+		if (regVreg[r] >= 0 && nextUse[regVreg[r]] != NEVER) spill(r);
+	forgetAll();
+	emitFrameRM("LDA", mp, 0, 1, "call: push frame");
+	emitRM("LDA", ac, 1, pc, "call: return address");
+	emitRM_Label("LDA", pc, functionOf(i->name)->label, "call: jump to function");
+	emitFrameRM("LDA", mp, 0, -1, "call: pop frame");
+	if (i->dest >= 0)
+	{
+		nextUse[i->dest] = uses[s];
+		finish(i->dest, ac);
+	}
+}
+
+/* Procedure genInstr generates code for instruction i,
+ * not the last of its block, whose uses start at slot s
+ */
+static void genInstr(IrInstr *i, int s)
+{
+	int ra, rb, rc, rd, base, d;
+	IrOperand o;
+	if (i->dest >= 0 && isLocalTemp(i->dest) && uses[s] == NEVER && isPure(i))
+	{
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		return;
+	}
+	switch (i->op)
+	{
+	case IrCopy:
+		if (i->a.kind == IrImm)
+		{
+			rd = define(i->dest, s);
+			emitRM("LDC", rd, i->a.val, 0, "load const");
+		}
+		else
+		{
+			ra = use(i->a);
+			if (!isLocalTemp(i->dest) && (!isLocalTemp(i->a.val) || uses[s + 1] != NEVER))
+			{
+				/* the value stays where it is */
+				if (regOf[i->dest] >= 0) unbind(regOf[i->dest]);
+				nextUse[i->dest] = uses[s];
+				emitRM("ST", ra, homeOf(i->dest), mp, "store vreg");
+				release(i->a, s + 1);
+				break;
+			}
+			release(i->a, s + 1);
+			rd = define(i->dest, s);
+			if (rd != ra) emitRM("LDA", rd, 0, ra, "copy");
+		}
+		finish(i->dest, rd);
+		break;
+	case IrAdd:
+	case IrSub:
+		if (i->op == IrAdd && i->a.kind == IrImm && i->b.kind == IrReg)
+		{
+			o = i->a;
+			i->a = i->b;
+			i->b = o;
+			d = uses[s + 1];
+			uses[s + 1] = uses[s + 2];
+			uses[s + 2] = d;
+		}
+		if (i->b.kind == IrImm)
+		{
+			ra = use(i->a);
+			release(i->a, s + 1);
+			rd = define(i->dest, s);
+			emitRM("LDA", rd, i->op == IrAdd ? i->b.val : -i->b.val, ra, i->op == IrAdd ? "op +" : "op -");
+			finish(i->dest, rd);
+			break;
+		}
+		/* fall through */
+	case IrMul:
+	case IrDiv:
+		ra = use(i->a);
+		rb = use(i->b);
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		rd = define(i->dest, s);
+		emitRO(i->op == IrAdd ? "ADD" : i->op == IrSub ? "SUB" : i->op == IrMul ? "MUL" : "DIV", rd, ra, rb,
+			   i->op == IrAdd ? "op +" : i->op == IrSub ? "op -" : i->op == IrMul ? "op *" : "op /");
+		finish(i->dest, rd);
+		break;
+	case IrCmp:
+		ra = use(i->a);
+		rb = i->b.kind == IrReg ? use(i->b) : -1;
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		rd = define(i->dest, s);
+		emitRM(relopJump(i->relop, FALSE), compare(i, ra, rb, rd), 2, pc, "br if true");
+		emitRM("LDC", rd, 0, 0, "false case");
+		emitRM("LDA", pc, 1, pc, "unconditional jmp");
+		emitRM("LDC", rd, 1, 0, "true case");
+		finish(i->dest, rd);
+		break;
+	case IrLoad:
+		ra = i->a.kind == IrReg ? use(i->a) : -1;
+		rb = i->space == IrPointer ? use(i->b) : -1;
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		rd = define(i->dest, s);
+		base = address(i, ra, rb, rd, &d);
+		emitRM("LD", rd, d, base, "load");
+		finish(i->dest, rd);
+		break;
+	case IrStore:
+		rc = use(i->c);
+		ra = i->a.kind == IrReg ? use(i->a) : -1;
+		rb = i->space == IrPointer ? use(i->b) : -1;
+		base = address(i, ra, rb, needsSum(i) ? allocReg() : -1, &d);
+		emitRM("ST", rc, d, base, "store");
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		release(i->c, s + 3);
+		break;
+	case IrAddr:
+		rd = define(i->dest, s);
+		if (i->space == IrGlobal) emitRM("LDA", rd, i->disp, gp, "load array address");
+		else
+			emitRM("LDA", rd, FRAME_HEADER + i->disp, mp, "load array address");
+		finish(i->dest, rd);
+		break;
+	case IrIn:
+		rd = define(i->dest, s);
+		emitRO("IN", rd, 0, 0, "input");
+		finish(i->dest, rd);
+		break;
+	case IrOut:
+		ra = use(i->a);
+		release(i->a, s + 1);
+		emitRO("OUT", ra, 0, 0, "output");
+		break;
+	case IrCall:
+		genCall(i, s);
+		break;
+	default:
+		emitComment("BUG: Unknown instruction");
+		break;
+	}
+	unlockAll();
+}
+
+/* expects tells whether block b, if entered from a
+ * later one, expects register r to hold a value
+ */
+static int expects(IrBlock *b, int r)
+{
+	return b != NULL && entryState[b->id * NREGS + r] >= 0;
+}
+
+/* Procedure reenter loads the values block b expects,
+ * for a jump back to it. Only values in their homes are
+ * left in registers at the end of a block
+ */
+static void reenter(IrBlock *b)
+{
+	int r;
+	for (r = 0; r < NREGS; r++)
+	{
+		int v = entryState[b->id * NREGS + r];
+		if (v < 0 || regVreg[r] == v) continue;
+		unbind(r);
+		emitRM("LD", r, homeOf(v), mp, "reload for loop");
+		bind(r, v, FALSE);
+	}
+}
+
+/* Procedure genEnd generates code for the last
+ * instruction of block b, whose uses start at slot s;
+ * next is the block laid out after b, or NULL. A jump
+ * or branch to next falls through
+ */
+static void genEnd(IrBlock *b, int s, IrBlock *next)
+{
+	IrInstr *i = b->last;
+	IrBlock *back;
+	int ra, rb, r, t;
+	switch (i->op)
+	{
+	case IrJump:
+		if (b->succ[0]->id <= b->id) reenter(b->succ[0]);
+		if (b->succ[0] != next) emitRM_Label("LDA", pc, labels[b->succ[0]->id], "jmp");
+		break;
+	case IrBranch:
+		back = b->succ[0]->id <= b->id ? b->succ[0] : b->succ[1]->id <= b->id ? b->succ[1] : NULL;
+		ra = use(i->a);
+		rb = i->b.kind == IrReg ? use(i->b) : -1;
+		release(i->a, s + 1);
+		release(i->b, s + 2);
+		if (back != NULL)
+		{
+			/* the operands are not needed past the compare,
+			 * which must not be in a register reenter loads
+			 */
+			unlockAll();
+			for (r = 0; r < NREGS; r++)
+				if (expects(back, r)) lock(r);
+			if (rb < 0 && i->b.val == 0 && expects(back, ra) && regVreg[ra] != entryState[back->id * NREGS + ra])
+			{
+				t = lock(allocReg());
+				emitRM("LDA", t, 0, ra, "copy");
+				ra = t;
+			}
+		}
+		t = compare(i, ra, rb, rb >= 0 || i->b.val != 0 ? lock(allocReg()) : -1);
+		if (back != NULL) reenter(back);
+		if (b->succ[0] == next) emitRM_Label(relopJump(i->relop, TRUE), t, labels[b->succ[1]->id], "br if false");
+		else
+		{
+			emitRM_Label(relopJump(i->relop, FALSE), t, labels[b->succ[0]->id], "br if true");
+			if (b->succ[1] != next) emitRM_Label("LDA", pc, labels[b->succ[1]->id], "jmp");
+		}
+		break;
+	case IrRet:
+		if (i->a.kind == IrImm) emitRM("LDC", ac, i->a.val, 0, "return value");
+		else if (i->a.kind == IrReg && regOf[i->a.val] < 0)
+			emitRM("LD", ac, homeOf(i->a.val), mp, "return value");
+		else if (i->a.kind == IrReg)
+		{
+			ra = use(i->a);
+			if (ra != ac) emitRM("LDA", ac, 0, ra, "return value");
+		}
+		emitRM("LD", pc, 0, mp, "function: return");
+		break;
+	default:
+		genInstr(i, s);
+		break;
+	}
+	unlockAll();
+}
+
+static void noteBlock(int v, int k)
+{
+	if (v < 0) return;
+	if (blockOf[v] == -1) blockOf[v] = k;
+	else if (blockOf[v] != k)
+		blockOf[v] = MANY_BLOCKS;
+}
+
+static int vregIn(IrOperand o)
+{
+	return o.kind == IrReg ? o.val : -1;
+}
+
+/* findBlocks sets blockOf for each vreg of function */
+static void findBlocks(void)
+{
+	IrInstr *i;
+	int k, a;
+	for (k = 0; k < function->nvregs; k++) blockOf[k] = -1;
+	for (k = 0; k < function->nblocks; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			noteBlock(i->dest, k);
+			noteBlock(vregIn(i->a), k);
+			noteBlock(vregIn(i->b), k);
+			noteBlock(vregIn(i->c), k);
+			for (a = 0; a < i->nargs; a++) noteBlock(vregIn(i->args[a]), k);
+		}
+}
+
+static int usesVreg(IrInstr *i, int v)
+{
+	int a;
+	if (vregIn(i->a) == v || vregIn(i->b) == v || vregIn(i->c) == v) return TRUE;
+	for (a = 0; a < i->nargs; a++)
+		if (vregIn(i->args[a]) == v) return TRUE;
+	return FALSE;
+}
+
+/* useCount counts the instructions of blocks from to
+ * to that use v, up to the first call, which takes
+ * every register
+ */
+static int useCount(int v, int from, int to)
+{
+	IrInstr *i;
+	int k, n = 0;
+	for (k = from; k <= to; k++)
+		for (i = function->blocks[k]->first; i != NULL; i = i->next)
+		{
+			if (usesVreg(i, v)) n++;
+			if (i->op == IrCall) return n;
+		}
+	return n;
+}
+
+/* Procedure enterBlock sets what the registers hold on
+ * entry to block k: what every predecessor laid out
+ * before it leaves in them. If k is also entered from
+ * later blocks (a loop), it expects the values it would
+ * have, or those left by the block before it if it has
+ * no such predecessor, that the blocks up to the last of
+ * them use most before a call; those blocks load them
+ * before going back to it (see reenter)
+ */
+static void enterBlock(int k)
+{
+	IrBlock *b = function->blocks[k];
+	int keep[NREGS], count[NREGS];
+	int r, n, v, earlier = FALSE, blocked = FALSE, kept = 0;
+	for (r = 0; r < NREGS; r++) keep[r] = k == 0 ? -1 : regVreg[r];
+	lastBack[k] = -1;
+	for (n = 0; n < b->npreds; n++)
+	{
+		IrBlock *p = b->preds[n];
+		if (p->id >= k)
+		{
+			if (p->id > lastBack[k]) lastBack[k] = p->id;
+			/* a branch can load the values of one target only */
+			if (p->last->op == IrBranch && p->succ[0] != p->succ[1] && p->succ[0]->id <= p->id &&
+				p->succ[1]->id <= p->id)
+				blocked = TRUE;
+			continue;
+		}
+		for (r = 0; r < NREGS; r++)
+			if (!earlier || keep[r] != exitState[p->id * NREGS + r]) keep[r] = earlier ? -1 : exitState[p->id * NREGS + r];
+		earlier = TRUE;
+	}
+	if (!earlier && lastBack[k] < 0)
+		for (r = 0; r < NREGS; r++) keep[r] = -1;
+	for (r = 0; r < NREGS; r++)
+	{
+		v = keep[r] >= 0 && isLocalTemp(keep[r]) ? -1 : keep[r];
+		keep[r] = v;
+		count[r] = v >= 0 && lastBack[k] >= 0 && !blocked ? useCount(v, k, lastBack[k]) : 0;
+		if (lastBack[k] >= 0 && count[r] == 0) keep[r] = -1;
+		if (keep[r] >= 0) kept++;
+	}
+	for (; lastBack[k] >= 0 && kept > MAX_CARRIED; kept--)
+	{
+		int least = -1;
+		for (r = 0; r < NREGS; r++)
+			if (keep[r] >= 0 && (least < 0 || count[r] < count[least])) least = r;
+		keep[least] = -1;
+	}
+	forgetAll();
+	for (r = 0; r < NREGS; r++)
+	{
+		entryState[k * NREGS + r] = lastBack[k] >= 0 ? keep[r] : -1;
+		if (keep[r] >= 0) bind(r, keep[r], FALSE);
+	}
+	/* mark what the loops around k expect */
+	for (v = 0; v < function->nvregs; v++) carried[v] = FALSE;
+	for (n = 0; n <= k; n++)
+		if (lastBack[n] >= k)
+			for (r = 0; r < NREGS; r++)
+				if (entryState[n * NREGS + r] >= 0) carried[entryState[n * NREGS + r]] = TRUE;
+}
+
+/* Procedure genFunction generates code for f */
+static void genFunction(IrFunction *f)
+{
+	FunctionLabelRec *l = functionOf(f->name);
+	IrInstr *i;
+	int k, r, v, n, frame;
+	function = f;
+	blockOf = malloc(f->nvregs * sizeof(int));
+	home = malloc(f->nvregs * sizeof(int));
+	regOf = malloc(f->nvregs * sizeof(int));
+	nextUse = malloc(f->nvregs * sizeof(int));
+	labels = malloc(f->nblocks * sizeof(int));
+	exitState = malloc(f->nblocks * NREGS * sizeof(int));
+	entryState = malloc(f->nblocks * NREGS * sizeof(int));
+	lastBack = malloc(f->nblocks * sizeof(int));
+	carried = malloc(f->nvregs * sizeof(int));
+	for (v = 0; v < f->nvregs; v++)
+	{
+		home[v] = -1;
+		regOf[v] = -1;
+		nextUse[v] = NEVER;
+	}
+	for (k = 0; k < f->nblocks; k++) labels[k] = newLabel();
+	findBlocks();
+	homeCount = 0;
+	patchCount = 0;
+	for (r = 0; r < NREGS; r++)
+	{
+		regVreg[r] = -1;
+		regDirty[r] = FALSE;
+		regLocked[r] = FALSE;
+	}
+	emitComment(f->name);
+	placeLabel(l->label);
+	l->defined = TRUE;
+	emitRM("ST", ac, 0, mp, "function: store return address");
+	for (k = 0; k < f->nblocks; k++)
+	{
+		IrBlock *b = f->blocks[k];
+		enterBlock(k);
+		for (r = 0; r < NREGS; r++)
+			if (regVreg[r] >= 0) nextUse[regVreg[r]] = NEVER;
+		findUses(b);
+		placeLabel(labels[k]);
+		for (i = b->first, n = 0; i != NULL; i = i->next, n++)
+		{
+			if (TraceCode)
+			{
+				char buf[256];
+				if (i == b->first)
+				{
+					sprintf(buf, "B%d:", b->id);
+					emitComment(buf);
+				}
+				formatInstr(buf, sizeof(buf), f, b, i);
+				emitComment(buf);
+			}
+			if (i == b->last) genEnd(b, first[n], k + 1 < f->nblocks ? f->blocks[k + 1] : NULL);
+			else
+				genInstr(i, first[n]);
+		}
+		for (r = 0; r < NREGS; r++)
+			exitState[k * NREGS + r] = regVreg[r] >= 0 && !isLocalTemp(regVreg[r]) ? regVreg[r] : -1;
+	}
+	/* calls push a record past the homes of temps */
+	frame = FRAME_HEADER + f->frameSize + homeCount;
+	for (k = 0; k < patchCount; k++) codeBuffer[patches[k].loc].d += patches[k].sign * frame;
+	free(blockOf);
+	free(home);
+	free(regOf);
+	free(nextUse);
+	free(labels);
+	free(exitState);
+	free(entryState);
+	free(lastBack);
+	free(carried);
+	labels = NULL;
+	exitState = entryState = lastBack = carried = NULL;
+	function = NULL;
+}
+
+/**********************************************/
+/* the primary function of the code generator */
+/**********************************************/
+void tmGen(IrProgram *program, char *codefile)
+{
+	char *s = malloc(strlen(codefile) + 7);
+	IrFunction *f;
+	FunctionLabelRec *l;
+	strcpy(s, "File: ");
+	strcat(s, codefile);
+	emitComment("C-Minus Compilation to TM Code");
+	emitComment(s);
+	free(s);
+	/* generate standard prelude: main's record starts
+	 * after the global data
+	 */
+	emitComment("Standard prelude:");
+	emitRM("LDA", mp, program->globals, gp, "main frame follows the globals");
+	emitRM("LDA", ac, 1, pc, "return address");
+	emitRM_Label("LDA", pc, functionOf("main")->label, "jump to main");
+	emitComment("End of execution.");
+	emitRO("HALT", 0, 0, 0, "");
+	emitComment("End of standard prelude.");
+	for (f = program->functions; f != NULL; f = f->next) genFunction(f);
+	/* finish: a call to a function with no body is an
+	 * error
+	 */
+	for (l = functions; l != NULL; l = l->next)
+		if (!l->defined)
+		{
+			fprintf(listing, "Code generation error: function %s has no body in this unit\n", l->name);
+			placeLabel(l->label);
+			Error = TRUE;
+		}
+	resolveLabels();
+	while (functions != NULL)
+	{
+		l = functions->next;
+		free(functions);
+		functions = l;
+	}
+	free(uses);
+	free(first);
+	free(patches);
+	uses = first = NULL;
+	useCapacity = firstCapacity = 0;
+	patches = NULL;
+	patchCount = patchCapacity = 0;
+}
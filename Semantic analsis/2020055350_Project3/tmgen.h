@@ -0,0 +1,23 @@
+/****************************************************/
+/* File: tmgen.h                                    */
+/* TM code generation from the intermediate         */
+/* representation                                   */
+/****************************************************/
+
+#ifndef _TMGEN_H_
+#define _TMGEN_H_
+
+#include "ir.h"
+
+/* Procedure tmGen generates code for program into the
+ * code buffer (see code.h), with the activation records
+ * and calling sequence of cgen.c. Each vreg that is a
+ * variable, or is used in more than one block, lives in
+ * a word of the frame and is stored when it is set;
+ * within a block, values are kept in registers 0 to 4
+ * as long as they fit. The second parameter (codefile)
+ * is printed as a comment in the code file
+ */
+void tmGen(IrProgram *program, char *codefile);
+
+#endif
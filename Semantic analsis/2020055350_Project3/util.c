@@ -9,6 +9,12 @@
 #include "util.h"
 
 #include "globals.h"
+#include <stdatomic.h>
+
+/* the allocations made here are the ones counted */
+#undef malloc
+#undef calloc
+#undef realloc
 
 /* Procedure printToken prints a token
  * and its lexeme to the listing file
@@ -115,8 +121,116 @@ void printToken(TokenType token,
  */
  
 
+/* The memory of a compilation unit is carved out of
+ * large arena blocks, so freeUnit only has to walk the
+ * block list. Requests larger than a quarter block get
+ * a block of their own
+ */
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct ArenaBlock {
+    struct ArenaBlock * next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+/* arena is the block list unitAlloc carves from: the
+ * unit's, or the one useArena chose
+ */
+static ArenaBlock * unitArena = NULL;
+static ArenaBlock ** arena = &unitArena;
+
+/* totals for the time report: unitAlloc requests, and
+ * heap allocations, which type checking threads may make
+ * at once. The arena blocks are not counted again. Heap
+ * allocations are only counted once allocStats has been
+ * called, so that the atomic counters cost nothing
+ * without a report
+ */
+static long unitAllocations = 0;
+static long unitAllocatedBytes = 0;
+static int countHeap = FALSE;
+static atomic_long heapAllocations = 0;
+static atomic_long heapAllocatedBytes = 0;
+
+void allocStats(long * count, long * bytes) {
+    countHeap = TRUE;
+    * count = unitAllocations + atomic_load(&heapAllocations);
+    * bytes = unitAllocatedBytes + atomic_load(&heapAllocatedBytes);
+}
+
+static void countHeapAllocation(size_t size) {
+    if (!countHeap) return;
+    atomic_fetch_add(&heapAllocations, 1);
+    atomic_fetch_add(&heapAllocatedBytes, (long) size);
+}
+
+void * countedMalloc(size_t size) {
+    countHeapAllocation(size);
+    return malloc(size);
+}
+
+void * countedCalloc(size_t count, size_t size) {
+    countHeapAllocation(count * size);
+    return calloc(count, size);
+}
+
+/* a realloc counts as an allocation of the new size */
+void * countedRealloc(void * p, size_t size) {
+    countHeapAllocation(size);
+    return realloc(p, size);
+}
+
+void * unitAlloc(size_t size) {
+    ArenaBlock * block;
+    size = (size + 7) & ~(size_t) 7;
+    unitAllocations++;
+    unitAllocatedBytes += size;
+    if (size > ARENA_BLOCK_SIZE / 4) {
+        block = (ArenaBlock * ) malloc(sizeof(ArenaBlock) + size);
+        if (block == NULL) return NULL;
+        block -> size = block -> used = size;
+        if (* arena == NULL) {
+            block -> next = NULL;
+            * arena = block;
+        } else {
+            block -> next = (* arena) -> next;
+            (* arena) -> next = block;
+        }
+        return block -> data;
+    }
+    if (* arena == NULL || (* arena) -> used + size > (* arena) -> size) {
+        block = (ArenaBlock * ) malloc(sizeof(ArenaBlock) + ARENA_BLOCK_SIZE);
+        if (block == NULL) return NULL;
+        block -> size = ARENA_BLOCK_SIZE;
+        block -> used = 0;
+        block -> next = * arena;
+        * arena = block;
+    }
+    block = * arena;
+    block -> used += size;
+    return block -> data + block -> used - size;
+}
+
+void freeArena(Arena * owner) {
+    while (* owner != NULL) {
+        ArenaBlock * next = (* owner) -> next;
+        free(* owner);
+        * owner = next;
+    }
+}
+
+void freeUnit(void) {
+    freeArena(&unitArena);
+}
+
+void useArena(Arena * owner) {
+    arena = owner != NULL ? owner : &unitArena;
+}
+
 TreeNode * newTreeNode(NodeKind kind) {
-    TreeNode * t = (TreeNode * ) malloc(sizeof(TreeNode));
+    TreeNode * t = (TreeNode * ) unitAlloc(sizeof(TreeNode));
     if (t == NULL) {
         fprintf(listing, "Out of memory error at line %d\n", lineno);
         return t;
@@ -125,6 +239,7 @@ TreeNode * newTreeNode(NodeKind kind) {
     int i;
     for (i = 0; i < MAXCHILDREN; i++) t -> child[i] = NULL;
     t -> sibling = NULL;
+    t -> lastSibling = NULL;
     t -> lineno = lineno;
     t -> kind = kind;
     t -> type = None;
@@ -132,10 +247,26 @@ TreeNode * newTreeNode(NodeKind kind) {
     t -> val = 0;
     t -> conflict = FALSE;
     t -> token = -1;
+    t -> scope = NULL;
 
     return t;
 }
 
+/* The head of a sibling list remembers its last node
+ * in lastSibling, so appending does not walk the list
+ */
+TreeNode * appendSibling(TreeNode * list, TreeNode * t) {
+    TreeNode * last;
+    if (list == NULL) return t;
+    if (t == NULL) return list;
+    last = list -> lastSibling != NULL ? list -> lastSibling : list;
+    while (last -> sibling != NULL) last = last -> sibling;
+    last -> sibling = t;
+    while (last -> sibling != NULL) last = last -> sibling;
+    list -> lastSibling = last;
+    return list;
+}
+
 /* Function copyString allocates and makes a new
  * copy of an existing string
  */
@@ -144,7 +275,7 @@ char * copyString(char * s) {
     char * t;
     if (s == NULL) return NULL;
     n = strlen(s) + 1;
-    t = malloc(n);
+    t = unitAlloc(n);
     if (t == NULL) fprintf(listing, "Out of memory error at line %d\n", lineno);
     else
         strcpy(t, s);
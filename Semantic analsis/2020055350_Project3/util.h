@@ -27,11 +27,44 @@ TreeNode* newTreeNode(NodeKind);
  */
 // TreeNode *newExpNode(ExpKind);
 
+/* Function appendSibling appends the sibling list t to
+ * list and returns the head of the joined list
+ */
+TreeNode *appendSibling(TreeNode *list, TreeNode *t);
+
 /* Function copyString allocates and makes a new
  * copy of an existing string
  */
 char *copyString(char *);
 
+/* Function unitAlloc allocates memory that belongs to
+ * the current compilation unit (tree nodes, strings,
+ * scopes and symbols). It is not thread safe
+ */
+void *unitAlloc(size_t);
+
+/* Procedure freeUnit releases everything allocated by
+ * unitAlloc since the previous freeUnit
+ */
+void freeUnit(void);
+
+/* An Arena holds unitAlloc memory that outlives the
+ * unit, such as a function that --watch keeps for the
+ * next one (an empty Arena is NULL). useArena makes
+ * unitAlloc allocate from arena, or from the unit again
+ * if arena is NULL; freeArena releases an arena
+ */
+typedef struct ArenaBlock *Arena;
+void useArena(Arena *arena);
+void freeArena(Arena *arena);
+
+/* Procedure allocStats returns the number of allocations
+ * (unitAlloc calls, and heap allocations through the
+ * wrappers of globals.h from the first allocStats call
+ * on) and the bytes they asked for
+ */
+void allocStats(long *count, long *bytes);
+
 /* procedure printTree prints a syntax tree to the
  * listing file using indentation to indicate subtrees
  */